@@ -0,0 +1,87 @@
+#!/usr/bin/env python
+#
+# gdb_raw_bridge.py: expose the Black Magic Probe's raw vendor-bulk GDB
+# transport as a pty, bypassing the CDC-ACM/tty layer on the host.
+#
+# The firmware must be built with PLATFORM_HAS_GDB_RAW.  Run this
+# script, then point GDB at the printed pty:
+#   (gdb) target extended-remote /dev/pts/N
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import os
+import sys
+import select
+import threading
+
+import usb.core
+import usb.util
+
+BMP_VID = 0x1d50
+BMP_PID = 0x6018
+EP_OUT = 0x06
+EP_IN = 0x86
+PACKET_SIZE = 64
+
+
+def find_raw_interface(dev):
+    cfg = dev.get_active_configuration()
+    for iface in cfg:
+        if iface.bInterfaceClass == 0xFF and \
+           iface.bInterfaceSubClass == 0xFF:
+            return iface
+    return None
+
+
+def usb_to_pty(dev, fd):
+    while True:
+        try:
+            data = dev.read(EP_IN, PACKET_SIZE, timeout=0)
+        except usb.core.USBError:
+            continue
+        if len(data):
+            os.write(fd, data.tobytes())
+
+
+def main():
+    dev = usb.core.find(idVendor=BMP_VID, idProduct=BMP_PID)
+    if dev is None:
+        sys.exit("Black Magic Probe not found")
+
+    iface = find_raw_interface(dev)
+    if iface is None:
+        sys.exit("no raw GDB interface: firmware built "
+                 "without PLATFORM_HAS_GDB_RAW?")
+
+    if dev.is_kernel_driver_active(iface.bInterfaceNumber):
+        dev.detach_kernel_driver(iface.bInterfaceNumber)
+    usb.util.claim_interface(dev, iface.bInterfaceNumber)
+
+    master, slave = os.openpty()
+    print("GDB pty: %s" % os.ttyname(slave))
+
+    reader = threading.Thread(target=usb_to_pty, args=(dev, master))
+    reader.daemon = True
+    reader.start()
+
+    while True:
+        select.select([master], [], [])
+        data = os.read(master, PACKET_SIZE)
+        if not data:
+            break
+        dev.write(EP_OUT, data)
+
+
+if __name__ == "__main__":
+    main()
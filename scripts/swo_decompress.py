@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+#
+# swo_decompress.py: decode the Black Magic Probe's compressed SWO
+# trace stream (monitor swo_compress enable).
+#
+# The stream is coded in 4-byte groups:
+#   0x00       followed by a literal group (4 bytes)
+#   0x80 | h   the group in dictionary slot h (64 slots)
+#   0xC0 | n   the previous group repeated n more times (1..63)
+# The dictionary is updated on every literal group, with slot h the
+# top 6 bits of the group's Knuth multiplicative hash, mirroring the
+# firmware encoder.
+#
+# Usage: swo_decompress.py < compressed > raw
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import sys
+import struct
+
+def main():
+    stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+    stdout = getattr(sys.stdout, 'buffer', sys.stdout)
+    dictionary = [0] * 64
+    last_group = None
+
+    def emit(group):
+        stdout.write(struct.pack('<I', group))
+
+    while True:
+        tok = stdin.read(1)
+        if not tok:
+            break
+        tok = ord(tok)
+        if tok == 0x00:
+            lit = stdin.read(4)
+            if len(lit) < 4:
+                break
+            group = struct.unpack('<I', lit)[0]
+            h = ((group * 2654435761) & 0xffffffff) >> 26
+            dictionary[h] = group
+            last_group = group
+            emit(group)
+        elif (tok & 0xC0) == 0x80:
+            last_group = dictionary[tok & 0x3F]
+            emit(last_group)
+        elif (tok & 0xC0) == 0xC0:
+            if last_group is None:
+                break
+            for _ in range(tok & 0x3F):
+                emit(last_group)
+        else:
+            sys.stderr.write("bad token 0x%02x, stream out of sync\n"
+                             % tok)
+            break
+    stdout.flush()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+#
+# wirelog.py: decode the Black Magic Probe's binary wire event log
+# (hosted builds with ENABLE_WIRELOG=1, flushed to $BMP_WIRELOG or
+# wirelog.bin; see src/include/wirelog.h).
+#
+# Records are 16 bytes, little endian:
+#   u32 seq, u32 us, u8 event, u8 request, u16 b, u32 c
+# The request byte carries APnDP, RnW and the register address in the
+# SWD header layout, so each line shows which register the transaction
+# targeted.
+#
+# Usage: wirelog.py [wirelog.bin]
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import sys
+import struct
+
+RECORD = struct.Struct("<IIBBHI")
+
+EVENTS = {
+	0: "xfer",
+	1: "wait",
+	2: "fault",
+	3: "parity",
+	4: "timeout",
+}
+
+def decode_request(req):
+	apndp = (req >> 1) & 1
+	rnw = (req >> 2) & 1
+	addr = ((req >> 3) & 3) << 2
+	return "%s %s A%x" % ("AP" if apndp else "DP",
+	                      "rd" if rnw else "wr", addr)
+
+if __name__ == "__main__":
+	path = sys.argv[1] if len(sys.argv) > 1 else "wirelog.bin"
+	data = open(path, "rb").read()
+
+	last_us = None
+	for off in range(0, len(data) - RECORD.size + 1, RECORD.size):
+		seq, us, event, req, b, c = RECORD.unpack_from(data, off)
+		delta = us - last_us if last_us is not None else 0
+		last_us = us
+
+		name = EVENTS.get(event, "ev%d" % event)
+		line = "%9d %10d.%06ds +%7dus %-7s %s" % (
+			seq, us / 1000000, us % 1000000, delta, name,
+			decode_request(req))
+		if event == 0:		# xfer: b=RnW, c=data
+			line += " data %08x" % c
+		elif event == 1:	# wait: b=retry count, c=backoff us
+			line += " retry %d backoff %dus" % (b, c)
+		elif event == 3:	# parity: c=data as read
+			line += " data %08x" % c
+		print(line)
@@ -29,6 +29,13 @@
 #include "target.h"
 #include "morse.h"
 #include "version.h"
+#include "swdptap.h"
+#include "jtagtap.h"
+#include "gdb_main.h"
+#include "crc32.h"
+#include "stats.h"
+#include "profile.h"
+#include "wirelog.h"
 
 #ifdef PLATFORM_HAS_TRACESWO
 #	include "traceswo.h"
@@ -52,11 +59,29 @@ static bool cmd_targets(void);
 static bool cmd_morse(void);
 static bool cmd_connect_srst(target *t, int argc, const char **argv);
 static bool cmd_hard_srst(void);
+static bool cmd_reset_timing(target *t, int argc, const char **argv);
+static bool cmd_fill(target *t, int argc, const char **argv);
+static bool cmd_swd_freq(target *t, int argc, const char **argv);
+static bool cmd_jtag_freq(target *t, int argc, const char **argv);
+static bool cmd_mem_cache(target *t, int argc, const char **argv);
+static bool cmd_autoscan(target *t, int argc, const char **argv);
+static bool cmd_verify_writes(target *t, int argc, const char **argv);
+static bool cmd_crc32(target *t, int argc, const char **argv);
+static bool cmd_bench(target *t, int argc, const char **argv);
+static bool cmd_stats(target *t, int argc, const char **argv);
+#ifdef ENABLE_PROFILE
+static bool cmd_profile(target *t, int argc, const char **argv);
+#endif
+#ifdef ENABLE_WIRELOG
+static bool cmd_wirelog(target *t, int argc, const char **argv);
+#endif
 #ifdef PLATFORM_HAS_POWER_SWITCH
 static bool cmd_target_power(target *t, int argc, const char **argv);
 #endif
 #ifdef PLATFORM_HAS_TRACESWO
-static bool cmd_traceswo(void);
+static bool cmd_traceswo(target *t, int argc, const char **argv);
+static bool cmd_swo_filter(target *t, int argc, const char **argv);
+static bool cmd_swo_compress(target *t, int argc, const char **argv);
 #endif
 #ifdef PLATFORM_HAS_DEBUG
 static bool cmd_debug_bmp(target *t, int argc, const char **argv);
@@ -71,11 +96,29 @@ const struct command_s cmd_list[] = {
 	{"morse", (cmd_handler)cmd_morse, "Display morse error message" },
 	{"connect_srst", (cmd_handler)cmd_connect_srst, "Configure connect under SRST: (enable|disable)" },
 	{"hard_srst", (cmd_handler)cmd_hard_srst, "Force a pulse on the hard SRST line - disconnects target" },
+	{"reset_timing", (cmd_handler)cmd_reset_timing, "Display or set reset timing: [pulse_us [settle_us [halt_poll_ms]]]" },
+	{"fill", (cmd_handler)cmd_fill, "Fill memory with a byte value: <addr> <len> <val>" },
+	{"swd_freq", (cmd_handler)cmd_swd_freq, "Display or set the SWCLK frequency: (Hz)" },
+	{"jtag_freq", (cmd_handler)cmd_jtag_freq, "Display or set the TCK frequency: (Hz)" },
+	{"mem_cache", (cmd_handler)cmd_mem_cache, "Cache memory reads while the target is halted: (enable|disable)" },
+	{"autoscan", (cmd_handler)cmd_autoscan, "Scan and attach on first GDB attach: (enable|disable)" },
+	{"verify_writes", (cmd_handler)cmd_verify_writes, "Read back and verify all memory writes: (enable|disable)" },
+	{"crc32", (cmd_handler)cmd_crc32, "Print CRC32 of target memory: <address> <length>" },
+	{"bench", (cmd_handler)cmd_bench, "Measure wire throughput to scratch RAM: <address> [length]" },
+	{"stats", (cmd_handler)cmd_stats, "Display wire traffic counters: [reset]" },
+#ifdef ENABLE_PROFILE
+	{"profile", (cmd_handler)cmd_profile, "Display hot path cycle profiles: [reset]" },
+#endif
+#ifdef ENABLE_WIRELOG
+	{"wirelog", (cmd_handler)cmd_wirelog, "Flush the wire event log to disk" },
+#endif
 #ifdef PLATFORM_HAS_POWER_SWITCH
 	{"tpwr", (cmd_handler)cmd_target_power, "Supplies power to the target: (enable|disable)"},
 #endif
 #ifdef PLATFORM_HAS_TRACESWO
-	{"traceswo", (cmd_handler)cmd_traceswo, "Start trace capture" },
+	{"traceswo", (cmd_handler)cmd_traceswo, "Start trace capture: [baudrate (NRZ backends only)]" },
+	{"swo_filter", (cmd_handler)cmd_swo_filter, "Forward only selected ITM ports: (off|<mask> [strip])" },
+	{"swo_compress", (cmd_handler)cmd_swo_compress, "Compress the trace stream: (enable|disable)" },
 #endif
 #ifdef PLATFORM_HAS_DEBUG
 	{"debug_bmp", (cmd_handler)cmd_debug_bmp, "Output BMP \"debug\" strings to the second vcom: (enable|disable)"},
@@ -88,7 +131,7 @@ static bool connect_assert_srst;
 bool debug_bmp;
 #endif
 
-int command_process(target *t, char *cmd)
+static int command_process_single(target *t, char *cmd)
 {
 	const struct command_s *c;
 	int argc = 0;
@@ -104,12 +147,14 @@ int command_process(target *t, char *cmd)
 	for(argc = 0, argv[argc] = strtok(cmd, " \t");
 		argv[argc]; argv[++argc] = strtok(NULL, " \t"));
 
+	size_t cmdlen = argc ? strlen(argv[0]) : 0;
+
 	/* Look for match and call handler */
 	for(c = cmd_list; c->cmd; c++) {
 		/* Accept a partial match as GDB does.
 		 * So 'mon ver' will match 'monitor version'
 		 */
-		if ((argc == 0) || !strncmp(argv[0], c->cmd, strlen(argv[0])))
+		if ((argc == 0) || !strncmp(argv[0], c->cmd, cmdlen))
 			return !c->handler(t, argc, argv);
 	}
 
@@ -119,6 +164,26 @@ int command_process(target *t, char *cmd)
 	return target_command(t, argc, argv);
 }
 
+int command_process(target *t, char *cmd)
+{
+	int ret = 0;
+
+	/* One qRcmd packet may batch several commands separated by ';',
+	 * saving scripted sequences a packet round-trip per command.
+	 * Execution stops at the first failing command. */
+	while (cmd) {
+		char *next = strchr(cmd, ';');
+		if (next)
+			*next++ = '\0';
+		ret = command_process_single(t, cmd);
+		if (ret)
+			break;
+		cmd = next;
+	}
+
+	return ret;
+}
+
 bool cmd_version(void)
 {
 	gdb_outf("Black Magic Probe (Firmware " FIRMWARE_VERSION ") (Hardware Version %d)\n", platform_hwversion());
@@ -259,10 +324,273 @@ static bool cmd_hard_srst(void)
 {
 	target_list_free();
 	platform_srst_set_val(true);
+	if (target_srst_pulse_us)
+		platform_delay_us(target_srst_pulse_us);
 	platform_srst_set_val(false);
 	return true;
 }
 
+static bool cmd_fill(target *t, int argc, const char **argv)
+{
+	if (!t) {
+		gdb_out("No target attached\n");
+		return false;
+	}
+	if (argc < 4) {
+		gdb_out("usage: fill <addr> <len> <val>\n");
+		return false;
+	}
+	uint32_t addr = strtoul(argv[1], NULL, 0);
+	uint32_t len = strtoul(argv[2], NULL, 0);
+	uint8_t val = strtoul(argv[3], NULL, 0);
+	if (target_mem_fill(t, addr, val, len)) {
+		gdb_out("Fill failed\n");
+		return false;
+	}
+	return true;
+}
+
+static bool cmd_reset_timing(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		target_srst_pulse_us = atol(argv[1]);
+	if (argc > 2)
+		target_reset_settle_us = atol(argv[2]);
+	if (argc > 3)
+		target_halt_poll_ms = atol(argv[3]);
+	gdb_outf("SRST pulse %uus, post-reset settle %uus, halt poll %ums\n",
+	         target_srst_pulse_us, target_reset_settle_us,
+	         target_halt_poll_ms);
+	return true;
+}
+
+static bool cmd_swd_freq(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		swdptap_pin_frequency(atol(argv[1]));
+
+	uint32_t freq = swdptap_get_frequency();
+	if (freq == 0)
+		gdb_out("SWCLK frequency is fixed on this platform\n");
+	else
+		gdb_outf("SWCLK frequency: %"PRIu32"Hz (approximate)\n", freq);
+	return true;
+}
+
+static bool cmd_jtag_freq(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		jtagtap_set_frequency(atol(argv[1]));
+
+	uint32_t freq = jtagtap_get_frequency();
+	if (freq == 0)
+		gdb_out("TCK frequency is fixed on this platform\n");
+	else
+		gdb_outf("TCK frequency: %"PRIu32"Hz (approximate)\n", freq);
+	return true;
+}
+
+static bool cmd_mem_cache(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		gdb_mem_cache_enabled = !strcmp(argv[1], "enable");
+	gdb_outf("Memory read cache: %s\n",
+		 gdb_mem_cache_enabled ? "enabled" : "disabled");
+	return true;
+}
+
+static bool cmd_autoscan(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		gdb_autoscan_enabled = !strcmp(argv[1], "enable");
+	gdb_outf("Scan on first attach: %s\n",
+		 gdb_autoscan_enabled ? "enabled" : "disabled");
+	return true;
+}
+
+static bool cmd_verify_writes(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1)
+		target_mem_verify_enabled = !strcmp(argv[1], "enable");
+	gdb_outf("Write verification: %s\n",
+		 target_mem_verify_enabled ? "enabled" : "disabled");
+	return true;
+}
+
+struct wire_stats wire_stats;
+
+static bool cmd_stats(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if ((argc > 1) && !strcmp(argv[1], "reset")) {
+		memset(&wire_stats, 0, sizeof(wire_stats));
+		return true;
+	}
+	gdb_outf("SWD accesses:  %"PRIu32" (%"PRIu32" WAIT, %"PRIu32
+	         " FAULT, %"PRIu32" parity)\n",
+	         wire_stats.swd_access, wire_stats.swd_wait,
+	         wire_stats.swd_fault, wire_stats.swd_parity);
+	gdb_outf("Target memory: %"PRIu32" bytes read, %"PRIu32
+	         " bytes written\n",
+	         wire_stats.mem_read_bytes, wire_stats.mem_write_bytes);
+	gdb_outf("GDB packets:   %"PRIu32" in, %"PRIu32" out\n",
+	         wire_stats.gdb_rx_packets, wire_stats.gdb_tx_packets);
+	gdb_outf("USB-UART:      %"PRIu32" overruns, %"PRIu32" dropped\n",
+	         wire_stats.uart_overruns, wire_stats.uart_drops);
+	return true;
+}
+
+#ifdef ENABLE_PROFILE
+struct profile_record profile_records[PROFILE_NUM_SITES];
+
+static const char *profile_site_names[PROFILE_NUM_SITES] = {
+	"swd_xfer", "gdb_dispatch", "usb_send",
+};
+
+void profile_sample(enum profile_site site, uint32_t cycles)
+{
+	struct profile_record *r = &profile_records[site];
+	if (!r->count || (cycles < r->min))
+		r->min = cycles;
+	if (cycles > r->max)
+		r->max = cycles;
+	r->total += cycles;
+	r->count++;
+}
+
+static bool cmd_profile(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if ((argc > 1) && !strcmp(argv[1], "reset")) {
+		memset(profile_records, 0, sizeof(profile_records));
+		return true;
+	}
+	for (int i = 0; i < PROFILE_NUM_SITES; i++) {
+		struct profile_record *r = &profile_records[i];
+		gdb_outf("%-12s %9"PRIu32" samples  min %"PRIu32
+		         "  avg %"PRIu32"  max %"PRIu32" cycles\n",
+		         profile_site_names[i], r->count,
+		         r->count ? r->min : 0,
+		         r->count ? (uint32_t)(r->total / r->count) : 0,
+		         r->max);
+	}
+	return true;
+}
+#endif
+
+#ifdef ENABLE_WIRELOG
+static bool cmd_wirelog(target *t, int argc, const char **argv)
+{
+	(void)t;
+	(void)argc;
+	(void)argv;
+	wirelog_flush();
+	gdb_out("Wire event log flushed\n");
+	return true;
+}
+#endif
+
+/* Computes the checksum probe-side over the SWD/JTAG wire, so scripted
+ * verification doesn't have to read the image back over the serial
+ * link.  GDB's own compare-sections uses the qCRC packet and takes the
+ * same fast path. */
+static bool cmd_crc32(target *t, int argc, const char **argv)
+{
+	if (!t) {
+		gdb_out("No target attached\n");
+		return false;
+	}
+	if (argc < 3) {
+		gdb_out("usage: monitor crc32 <address> <length>\n");
+		return false;
+	}
+
+	uint32_t addr = strtoul(argv[1], NULL, 0);
+	uint32_t len = strtoul(argv[2], NULL, 0);
+	uint32_t crc = generic_crc32(t, addr, len);
+
+	if (target_check_error(t)) {
+		gdb_outf("Read error at 0x%08"PRIx32"+0x%"PRIx32"\n",
+			 addr, len);
+		return false;
+	}
+
+	gdb_outf("CRC32 of 0x%08"PRIx32"+0x%"PRIx32": 0x%08"PRIx32"\n",
+		 addr, len, crc);
+	return true;
+}
+
+/* Measures end-to-end wire throughput against a scratch RAM region:
+ * block read and write bandwidth through the MEM-AP, and the rate the
+ * halted register file can be read.  Purely probe-side, so platforms
+ * and firmware changes can be compared without an instrumented host.
+ * The scratch region is restored: the write pass puts back what the
+ * read pass fetched. */
+static bool cmd_bench(target *t, int argc, const char **argv)
+{
+	static uint32_t buf[256];
+	platform_timeout to;
+	uint32_t n;
+
+	if (!t) {
+		gdb_out("No target attached\n");
+		return false;
+	}
+	if (argc < 2) {
+		gdb_out("usage: monitor bench <scratch address> [length]\n");
+		return false;
+	}
+
+	uint32_t addr = strtoul(argv[1], NULL, 0);
+	uint32_t len = sizeof(buf);
+	if (argc > 2)
+		len = strtoul(argv[2], NULL, 0);
+	if ((len < 4) || (len > sizeof(buf)))
+		len = sizeof(buf);
+
+	n = 0;
+	platform_timeout_set(&to, 1000);
+	do {
+		if (target_mem_read(t, buf, addr, len)) {
+			gdb_outf("Read error at 0x%08"PRIx32"\n", addr);
+			return false;
+		}
+		n++;
+	} while (!platform_timeout_is_expired(&to));
+	gdb_outf("read : %"PRIu32" KiB/s (%"PRIu32" x %"PRIu32" bytes)\n",
+	         (uint32_t)(((uint64_t)n * len) / 1024), n, len);
+
+	n = 0;
+	platform_timeout_set(&to, 1000);
+	do {
+		if (target_mem_write(t, addr, buf, len)) {
+			gdb_outf("Write error at 0x%08"PRIx32"\n", addr);
+			return false;
+		}
+		n++;
+	} while (!platform_timeout_is_expired(&to));
+	gdb_outf("write: %"PRIu32" KiB/s (%"PRIu32" x %"PRIu32" bytes)\n",
+	         (uint32_t)(((uint64_t)n * len) / 1024), n, len);
+
+	if (target_regs_size(t) <= sizeof(buf)) {
+		n = 0;
+		platform_timeout_set(&to, 1000);
+		do {
+			target_regs_read(t, buf);
+			n++;
+		} while (!platform_timeout_is_expired(&to));
+		gdb_outf("regs : %"PRIu32" register file reads/s\n", n);
+	}
+
+	return true;
+}
+
 #ifdef PLATFORM_HAS_POWER_SWITCH
 static bool cmd_target_power(target *t, int argc, const char **argv)
 {
@@ -277,13 +605,57 @@ static bool cmd_target_power(target *t, int argc, const char **argv)
 #endif
 
 #ifdef PLATFORM_HAS_TRACESWO
-static bool cmd_traceswo(void)
+static bool cmd_traceswo(target *t, int argc, const char **argv)
 {
 	extern char serial_no[9];
+	(void)t;
 	traceswo_init();
+	/* NRZ backends need the rate set to match the target's SWO
+	 * prescaler; Manchester backends ignore this */
+	if (argc > 1)
+		traceswo_setbaud(atol(argv[1]));
 	gdb_outf("%s:%02X:%02X\n", serial_no, 5, 0x85);
 	return true;
 }
+
+/* Configure probe-side ITM demultiplexing.  The mask selects which
+ * stimulus ports are forwarded; with "strip" the packet headers are
+ * removed and only payload bytes reach the host.  "off" restores raw
+ * passthrough of the undecoded stream. */
+static bool cmd_swo_filter(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc < 2) {
+		gdb_out("usage: monitor swo_filter (off|<mask> [strip])\n");
+		return false;
+	}
+	if (!strcmp(argv[1], "off")) {
+		traceswo_filter_set(false, 0, false);
+		gdb_out("SWO filter disabled\n");
+		return true;
+	}
+	uint32_t mask = strtoul(argv[1], NULL, 0);
+	bool strip = (argc > 2) && !strcmp(argv[2], "strip");
+	traceswo_filter_set(true, mask, strip);
+	gdb_outf("Forwarding ITM ports 0x%08"PRIx32"%s\n", mask,
+	         strip ? ", payload only" : "");
+	return true;
+}
+
+/* Toggle trace stream compression.  The host side must decode with
+ * scripts/swo_decompress.py; see traceswo.c for the coding. */
+static bool cmd_swo_compress(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc < 2) {
+		gdb_out("usage: monitor swo_compress (enable|disable)\n");
+		return false;
+	}
+	bool enable = !strcmp(argv[1], "enable");
+	traceswo_compress_set(enable);
+	gdb_outf("SWO compression %s\n", enable ? "enabled" : "disabled");
+	return true;
+}
 #endif
 
 #ifdef PLATFORM_HAS_DEBUG
@@ -29,6 +29,16 @@ void raise_exception(uint32_t type, const char *msg)
 	DEBUG("Exception: %s\n", msg);
 	for (e = innermost_exception; e; e = e->outer) {
 		if (e->mask & type) {
+			if (e->deferred) {
+				/* Record the first failure and resume the
+				 * raiser; the frame stays on the chain for
+				 * the rest of the guarded region. */
+				if (!e->type) {
+					e->type = type;
+					e->msg = msg;
+				}
+				return;
+			}
 			e->type = type;
 			e->msg = msg;
 			innermost_exception = e->outer;
@@ -38,3 +48,18 @@ void raise_exception(uint32_t type, const char *msg)
 	abort();
 }
 
+void exception_defer_begin(struct exception *e, uint32_t type_mask)
+{
+	e->type = 0;
+	e->mask = type_mask;
+	e->deferred = 1;
+	e->outer = innermost_exception;
+	innermost_exception = e;
+}
+
+uint32_t exception_defer_end(struct exception *e)
+{
+	innermost_exception = e->outer;
+	return e->type;
+}
+
@@ -25,6 +25,7 @@
  */
 
 #include "general.h"
+#include "exception.h"
 #include "hex_utils.h"
 #include "gdb_if.h"
 #include "gdb_packet.h"
@@ -34,6 +35,9 @@
 #include "command.h"
 #include "crc32.h"
 #include "morse.h"
+#include "profile.h"
+
+#include <unistd.h>
 
 enum gdb_signal {
 	GDB_SIGINT = 2,
@@ -42,16 +46,294 @@ enum gdb_signal {
 	GDB_SIGLOST = 29,
 };
 
-#define BUF_SIZE	1024
-
 #define ERROR_IF_NO_TARGET()	\
 	if(!cur_target) { gdb_putpacketz("EFF"); break; }
 
 static char pbuf[BUF_SIZE+1];
+/* Register transfer staging for 'g'/'G'.  A fixed buffer instead of a
+ * VLA sized from target_regs_size() keeps the GDB loop's stack frame
+ * constant, and being word-aligned it is safe for the register access
+ * functions that move data as 32-bit quantities.  Handlers never
+ * nest, so one buffer serves both directions. */
+static uint32_t reg_buf[64];
 
 static target *cur_target;
 static target *last_target;
 
+/* With autoscan enabled (see the autoscan monitor command), a vAttach
+ * arriving with no scan results runs the scan itself -- SWD first, JTAG
+ * as the fallback -- and attaches in the same packet exchange.  An
+ * unattended fixture then connects with a bare 'attach 1' instead of
+ * scripting monitor swdp_scan around every reconnect. */
+bool gdb_autoscan_enabled = false;
+
+/* RSP non-stop mode (QNonStop).  With gdb_nonstop set, resume packets
+ * return at once and the target keeps executing while further commands
+ * are serviced; bg_running tracks such a backgrounded target, which is
+ * polled from the packet-wait loop and reports its halt through an
+ * asynchronous %Stop notification instead of a stop reply. */
+static bool gdb_nonstop;
+static bool bg_running;
+
+/* Read-combining cache for 'm' packets.  GDB fragments a struct or
+ * stack read into several small, often overlapping requests, and every
+ * stack unwind re-reads the same frames; while the target stays halted
+ * those bytes cannot change underneath us, so a request wholly inside a
+ * previously read range is answered from here and a request continuing
+ * right after one only fetches the missing bytes.  Invalidated whenever
+ * the target runs or memory is written.  The cache can be switched off
+ * with the mem_cache monitor command for targets where DMA keeps
+ * changing RAM behind a halted core. */
+#define MEM_CACHE_LINE_SIZE 256
+#define MEM_CACHE_LINES 4
+
+static struct mem_cache_line {
+	uint32_t addr;
+	size_t len;	/* 0 = empty */
+	uint8_t data[MEM_CACHE_LINE_SIZE];
+} mem_cache[MEM_CACHE_LINES];
+static unsigned mem_cache_victim;
+
+bool gdb_mem_cache_enabled = true;
+
+static void mem_cache_invalidate(void)
+{
+	for (unsigned i = 0; i < MEM_CACHE_LINES; i++)
+		mem_cache[i].len = 0;
+}
+
+static size_t mem_cache_read(void *dest, uint32_t addr, size_t len)
+{
+	struct mem_cache_line *line;
+	size_t got;
+
+	/* Oversized requests bypass the cache, as do reads made while
+	 * the target executes in non-stop mode: live telemetry must not
+	 * be answered with stale bytes. */
+	if (!gdb_mem_cache_enabled || bg_running ||
+	    (len > MEM_CACHE_LINE_SIZE))
+		return target_mem_read_partial(cur_target, dest, addr, len);
+
+	for (unsigned i = 0; i < MEM_CACHE_LINES; i++) {
+		line = &mem_cache[i];
+		if (!line->len)
+			continue;
+
+		/* Wholly inside a cached range */
+		if ((addr >= line->addr) &&
+		    ((addr + len) <= (line->addr + line->len))) {
+			memcpy(dest, line->data + (addr - line->addr), len);
+			return len;
+		}
+
+		/* Continuing right after a cached range: fetch only the
+		 * missing bytes and extend */
+		if ((addr == (line->addr + line->len)) &&
+		    ((line->len + len) <= MEM_CACHE_LINE_SIZE)) {
+			got = target_mem_read_partial(cur_target,
+					line->data + line->len, addr, len);
+			memcpy(dest, line->data + line->len, got);
+			line->len += got;
+			return got;
+		}
+	}
+
+	/* Anything else starts a fresh line, replaced round-robin */
+	line = &mem_cache[mem_cache_victim];
+	mem_cache_victim = (mem_cache_victim + 1) % MEM_CACHE_LINES;
+	got = target_mem_read_partial(cur_target, line->data, addr, len);
+	line->addr = addr;
+	line->len = got;
+	memcpy(dest, line->data, got);
+	return got;
+}
+
+/* GDB multiprocess extensions: each entry in the target list is
+ * presented as a process whose PID is its 1-based list index (the same
+ * numbering vAttach and the targets command use) with a single thread.
+ * GDB can then keep both cores of a multi-core part attached at once
+ * and switch between them with Hg, instead of paying a detach/rescan
+ * cycle per switch.  Only spoken once GDB offers the extensions in
+ * qSupported. */
+static bool gdb_multiprocess;
+
+struct target_nth_s {
+	int n;
+	target *t;
+};
+
+static void gdb_target_nth_cb(int i, target *t, void *context)
+{
+	struct target_nth_s *s = context;
+	if (i == s->n)
+		s->t = t;
+}
+
+static target *gdb_target_nth(int n)
+{
+	struct target_nth_s s = {n, NULL};
+	target_foreach(gdb_target_nth_cb, &s);
+	return s.t;
+}
+
+static void gdb_target_pid_cb(int i, target *t, void *context)
+{
+	struct target_nth_s *s = context;
+	if (t == s->t)
+		s->n = i;
+}
+
+static int gdb_target_pid(target *t)
+{
+	struct target_nth_s s = {0, t};
+	target_foreach(gdb_target_pid_cb, &s);
+	return s.n;
+}
+
+static void gdb_attached_cb(int i, target *t, void *context)
+{
+	(void)i;
+	if (target_attached(t))
+		(*(int *)context)++;
+}
+
+struct thread_list_s {
+	char *buf;
+	size_t len;
+};
+
+static void gdb_thread_list_cb(int i, target *t, void *context)
+{
+	struct thread_list_s *s = context;
+	size_t o = strlen(s->buf);
+	(void)t;
+	if (gdb_multiprocess)
+		snprintf(s->buf + o, s->len - o, "%sp%x.1",
+		         (o > 1) ? "," : "", i);
+	else
+		snprintf(s->buf + o, s->len - o, "%s%x",
+		         (o > 1) ? "," : "", i);
+}
+
+/* Stop-reply suffix naming the reporting thread, empty unless the
+ * multiprocess extensions are in use */
+static const char *gdb_stop_thread(void)
+{
+	static char tstr[24];
+
+	if (!gdb_multiprocess || !cur_target)
+		return "";
+	snprintf(tstr, sizeof(tstr), "thread:p%x.1;",
+	         gdb_target_pid(cur_target));
+	return tstr;
+}
+
+/* Format the stop reply for a halt reason; sent as a normal reply in
+ * all-stop mode, as an asynchronous %Stop notification in non-stop. */
+static void gdb_report_halt(enum target_halt_reason reason,
+                            target_addr watch, bool notify)
+{
+	char report[40];
+
+	switch (reason) {
+	case TARGET_HALT_ERROR:
+		snprintf(report, sizeof(report), "X%02X", GDB_SIGLOST);
+		morse("TARGET LOST.", true);
+		break;
+	case TARGET_HALT_REQUEST:
+		snprintf(report, sizeof(report), "T%02X%s", GDB_SIGINT,
+		         gdb_stop_thread());
+		break;
+	case TARGET_HALT_WATCHPOINT:
+		snprintf(report, sizeof(report), "T%02Xwatch:%08"PRIX32";%s",
+		         GDB_SIGTRAP, watch, gdb_stop_thread());
+		break;
+	case TARGET_HALT_FAULT:
+		snprintf(report, sizeof(report), "T%02X%s", GDB_SIGSEGV,
+		         gdb_stop_thread());
+		break;
+	default:
+		snprintf(report, sizeof(report), "T%02X%s", GDB_SIGTRAP,
+		         gdb_stop_thread());
+	}
+
+	if (notify)
+		gdb_putnotification_f("Stop:%s", report);
+	else
+		gdb_putpacketz(report);
+}
+
+/* Block until the running target halts, then send the stop reply.
+ * Poll flat out at first -- breakpoints tend to hit soon after resume
+ * -- then decay the poll interval so a long-running target doesn't
+ * have the wire saturated with identical DHCSR reads, and the idle
+ * wait in between gives the trace and UART paths the bus.  A Ctrl-C
+ * drops straight back to fast polling.  The wait for input is not a
+ * sleep: gdb_if_getchar_to() returns as soon as a character arrives,
+ * so only halt detection pays the poll interval, which platforms with
+ * a cheap wire can cap lower. */
+#ifndef GDB_HALT_POLL_MAX_MS
+#define GDB_HALT_POLL_MAX_MS 50
+#endif
+
+static void gdb_halt_wait(void)
+{
+	target_addr watch;
+	enum target_halt_reason reason;
+	unsigned polls = 0;
+	unsigned poll_ms = 0;
+
+	while(!(reason = target_halt_poll(cur_target, &watch))) {
+		unsigned char c = gdb_if_getchar_to(poll_ms);
+		if((c == '\x03') || (c == '\x04')) {
+			target_halt_request(cur_target);
+			poll_ms = 0;
+		} else if ((++polls > 64) &&
+			   (poll_ms < GDB_HALT_POLL_MAX_MS)) {
+			poll_ms = poll_ms ? poll_ms * 2 : 1;
+		}
+	}
+	DEBUG("Halt after %u polls\n", polls);
+	SET_RUN_STATE(0);
+	/* The target ran; anything cached is stale */
+	mem_cache_invalidate();
+	gdb_report_halt(reason, watch, false);
+}
+
+/* Idle hook run from the packet-wait loop: in non-stop mode a resumed
+ * target executes in the background, so check on it between commands
+ * and turn its halt into a %Stop notification. */
+static void gdb_poll_running_target(void)
+{
+	target_addr watch;
+	enum target_halt_reason reason;
+
+	if (!bg_running || !cur_target)
+		return;
+	reason = target_halt_poll(cur_target, &watch);
+	if (!reason)
+		return;
+	bg_running = false;
+	SET_RUN_STATE(0);
+	mem_cache_invalidate();
+	gdb_report_halt(reason, watch, true);
+}
+
+static int gdb_autoscan(void)
+{
+	volatile struct exception e;
+	int devs = -1;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		devs = adiv5_swdp_scan();
+	}
+	if (devs <= 0) {
+		TRY_CATCH (e, EXCEPTION_ALL) {
+			devs = jtag_scan(NULL);
+		}
+	}
+	return devs;
+}
+
 static void handle_q_packet(char *packet, int len);
 static void handle_v_packet(char *packet, int len);
 static void handle_z_packet(char *packet, int len);
@@ -73,6 +355,33 @@ static void gdb_target_printf(struct target_controller *tc,
 	gdb_voutf(fmt, ap);
 }
 
+/* Console writes skip the File-I/O protocol.  Servicing an Fwrite makes
+ * GDB read the data back out of target memory with 'm' packets before
+ * replying, costing several USB round trips per printf(); an 'O' console
+ * packet carries the text in-band and needs no reply at all.  Only
+ * stdout/stderr qualify -- writes to real files still have to reach the
+ * host's file descriptor through Fwrite. */
+static int gdb_fileio_write(struct target_controller *tc,
+                            int fd, target_addr buf, unsigned int count)
+{
+	if ((fd == STDOUT_FILENO) || (fd == STDERR_FILENO)) {
+		char tmp[64];
+		unsigned int sent = 0;
+		while (sent < count) {
+			unsigned int chunk = count - sent;
+			if (chunk > sizeof(tmp))
+				chunk = sizeof(tmp);
+			if (target_mem_read(cur_target, tmp, buf + sent, chunk))
+				break;
+			gdb_out_buf(tmp, chunk);
+			sent += chunk;
+		}
+		tc->errno_ = 0;
+		return sent;
+	}
+	return hostio_write(tc, fd, buf, count);
+}
+
 static struct target_controller gdb_controller = {
 	.destroy_callback = gdb_target_destroy_callback,
 	.printf = gdb_target_printf,
@@ -80,7 +389,7 @@ static struct target_controller gdb_controller = {
 	.open = hostio_open,
 	.close = hostio_close,
 	.read = hostio_read,
-	.write = hostio_write,
+	.write = gdb_fileio_write,
 	.lseek = hostio_lseek,
 	.rename = hostio_rename,
 	.unlink = hostio_unlink,
@@ -101,14 +410,18 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		SET_IDLE_STATE(1);
 		size = gdb_getpacket(pbuf, BUF_SIZE);
 		SET_IDLE_STATE(0);
+		PROFILE_BEGIN(PROFILE_GDB_DISPATCH);
 		switch(pbuf[0]) {
 		/* Implementation of these is mandatory! */
 		case 'g': { /* 'g': Read general registers */
 			ERROR_IF_NO_TARGET();
-			uint8_t arm_regs[target_regs_size(cur_target)];
-			target_regs_read(cur_target, arm_regs);
-			gdb_putpacket(hexify(pbuf, arm_regs, sizeof(arm_regs)),
-			              sizeof(arm_regs) * 2);
+			size_t s = target_regs_size(cur_target);
+			if (s > sizeof(reg_buf)) {
+				gdb_putpacketz("E01");
+				break;
+			}
+			target_regs_read(cur_target, reg_buf);
+			gdb_putpacket(hexify(pbuf, reg_buf, s), s * 2);
 			break;
 			}
 		case 'm': {	/* 'm addr,len': Read len bytes from addr */
@@ -120,18 +433,86 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("m packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			if (target_mem_read(cur_target, mem, addr, len))
+			/* Read straight into pbuf and expand to hex in place,
+			 * skipping the separate staging copy.  A read across
+			 * an unmapped hole answers with the leading good
+			 * bytes as a partial reply, as the protocol allows. */
+			size_t got = mem_cache_read(pbuf, addr, len);
+			if (!got && len)
 				gdb_putpacketz("E01");
 			else
-				gdb_putpacket(hexify(pbuf, mem, len), len*2);
+				gdb_putpacket(hexify_inplace(pbuf, got), got*2);
+			break;
+			}
+		case 'x': {	/* 'x addr,len': Read len bytes binary */
+			/* Same job as 'm' without the hex pass: half the
+			 * wire bytes per dump, and gdb_putpacket() already
+			 * escapes the delimiter characters the same way the
+			 * binary 'X' write path expects. */
+			uint32_t addr, len;
+			ERROR_IF_NO_TARGET();
+			sscanf(pbuf, "x%" SCNx32 ",%" SCNx32, &addr, &len);
+			if (len > sizeof(pbuf) - 1) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			if (!len) {
+				/* GDB probes for support with "x0,0" */
+				gdb_putpacketz("OK");
+				break;
+			}
+			pbuf[0] = 'b';
+			size_t got = mem_cache_read(pbuf + 1, addr, len);
+			if (!got)
+				gdb_putpacketz("E01");
+			else
+				gdb_putpacket(pbuf, got + 1);
+			break;
+			}
+		case 'p': {	/* 'p n': Read single register n */
+			ERROR_IF_NO_TARGET();
+			uint32_t reg;
+			sscanf(pbuf, "p%" SCNx32, &reg);
+			uint32_t val[2];
+			ssize_t s = target_reg_read(cur_target, reg,
+			                            val, sizeof(val));
+			if (s > 0)
+				gdb_putpacket(hexify(pbuf, val, s), s * 2);
+			else
+				/* Empty reply makes GDB fall back to 'g' */
+				gdb_putpacketz("");
+			break;
+			}
+		case 'P': {	/* 'P n=XX': Write single register n */
+			ERROR_IF_NO_TARGET();
+			uint32_t reg;
+			int hex;
+			sscanf(pbuf, "P%" SCNx32 "=%n", &reg, &hex);
+			uint32_t val[2];
+			size_t s = (size - hex) / 2;
+			if (s > sizeof(val)) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			unhexify(val, pbuf + hex, s);
+			ssize_t r = target_reg_write(cur_target, reg, val, s);
+			if (r > 0)
+				gdb_putpacketz("OK");
+			else if (r == 0)
+				gdb_putpacketz("");
+			else
+				gdb_putpacketz("EFF");
 			break;
 			}
 		case 'G': {	/* 'G XX': Write general registers */
 			ERROR_IF_NO_TARGET();
-			uint8_t arm_regs[target_regs_size(cur_target)];
-			unhexify(arm_regs, &pbuf[1], sizeof(arm_regs));
-			target_regs_write(cur_target, arm_regs);
+			size_t s = target_regs_size(cur_target);
+			if (s > sizeof(reg_buf)) {
+				gdb_putpacketz("E01");
+				break;
+			}
+			unhexify(reg_buf, &pbuf[1], s);
+			target_regs_write(cur_target, reg_buf);
 			gdb_putpacketz("OK");
 			break;
 			}
@@ -145,9 +526,9 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("M packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			unhexify(mem, pbuf + hex, len);
-			if (target_mem_write(cur_target, addr, mem, len))
+			unhexify(pbuf + hex, pbuf + hex, len);
+			mem_cache_invalidate();
+			if (target_mem_write(cur_target, addr, pbuf + hex, len))
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacketz("OK");
@@ -165,46 +546,33 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			target_halt_resume(cur_target, single_step);
 			SET_RUN_STATE(1);
 			single_step = false;
+			if (gdb_nonstop) {
+				/* The stop reply comes later, as a %Stop
+				 * notification from the packet-wait poll */
+				bg_running = true;
+				gdb_putpacketz("OK");
+				break;
+			}
 			// Fall through to wait for target halt
 		case '?': {	/* '?': Request reason for target halt */
 			/* This packet isn't documented as being mandatory,
 			 * but GDB doesn't work without it. */
-			target_addr watch;
-			enum target_halt_reason reason;
-
 			if(!cur_target) {
 				/* Report "target exited" if no target */
 				gdb_putpacketz("W00");
 				break;
 			}
-
-			/* Wait for target halt */
-			while(!(reason = target_halt_poll(cur_target, &watch))) {
-				unsigned char c = gdb_if_getchar_to(0);
-				if((c == '\x03') || (c == '\x04')) {
-					target_halt_request(cur_target);
-				}
-			}
-			SET_RUN_STATE(0);
-
-			/* Translate reason to GDB signal */
-			switch (reason) {
-			case TARGET_HALT_ERROR:
-				gdb_putpacket_f("X%02X", GDB_SIGLOST);
-				morse("TARGET LOST.", true);
-				break;
-			case TARGET_HALT_REQUEST:
-				gdb_putpacket_f("T%02X", GDB_SIGINT);
-				break;
-			case TARGET_HALT_WATCHPOINT:
-				gdb_putpacket_f("T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
-				break;
-			case TARGET_HALT_FAULT:
-				gdb_putpacket_f("T%02X", GDB_SIGSEGV);
+			if (gdb_nonstop) {
+				/* Must not block in non-stop mode: a running
+				 * target's halt arrives as a notification */
+				if (bg_running)
+					gdb_putpacketz("OK");
+				else
+					gdb_putpacket_f("T%02X%s", GDB_SIGTRAP,
+					                gdb_stop_thread());
 				break;
-			default:
-				gdb_putpacket_f("T%02X", GDB_SIGTRAP);
 			}
+			gdb_halt_wait();
 			break;
 			}
 		case 'F':	/* Semihosting call finished */
@@ -225,16 +593,63 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			gdb_putpacketz("OK");
 			break;
 
+		case 'H': {	/* 'H op thread-id': Set thread for operations */
+			/* With multiprocess the pid selects the target;
+			 * thread-ids 0 and -1 mean "any" and keep the
+			 * current selection. */
+			int pid = 0;
+			if (pbuf[2] == 'p')
+				sscanf(pbuf + 3, "%x", &pid);
+			if (pid > 0) {
+				target *t = gdb_target_nth(pid);
+				if (!t) {
+					gdb_putpacketz("E01");
+					break;
+				}
+				if (t != cur_target) {
+					mem_cache_invalidate();
+					if (!target_attached(t) &&
+					    !target_attach(t, &gdb_controller)) {
+						gdb_putpacketz("E01");
+						break;
+					}
+					cur_target = t;
+				}
+			}
+			gdb_putpacketz("OK");
+			break;
+			}
+
 		case 0x04:
-		case 'D':	/* GDB 'detach' command. */
-			if(cur_target)
-				target_detach(cur_target);
-			last_target = cur_target;
-			cur_target = NULL;
+		case 'D': {	/* GDB 'detach' command. */
+			int pid = 0;
+			target *t = cur_target;
+			/* With multiprocess, D;pid names the process */
+			if (sscanf(pbuf, "D;%x", &pid) == 1) {
+				t = gdb_target_nth(pid);
+				if (!t) {
+					gdb_putpacketz("E01");
+					break;
+				}
+			}
+			if (t && target_attached(t))
+				target_detach(t);
+			if (t == cur_target) {
+				last_target = cur_target;
+				cur_target = NULL;
+			}
 			gdb_putpacketz("OK");
+			/* The next connection starts with acks again, but
+			 * not while another process is still attached */
+			int attached = 0;
+			target_foreach(gdb_attached_cb, &attached);
+			if (!attached)
+				gdb_set_noackmode(false);
 			break;
+			}
 
 		case 'k':	/* Kill the target */
+			mem_cache_invalidate();
 			if(cur_target) {
 				target_reset(cur_target);
 				target_detach(cur_target);
@@ -245,6 +660,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 
 		case 'r':	/* Reset the target system */
 		case 'R':	/* Restart the target program */
+			mem_cache_invalidate();
 			if(cur_target)
 				target_reset(cur_target);
 			else if(last_target) {
@@ -264,7 +680,23 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("X packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			if (target_mem_write(cur_target, addr, pbuf+bin, len))
+			mem_cache_invalidate();
+			/* Blocks of one repeated byte -- zero-filled bss and
+			 * padding, mostly -- go out as a probe-side fill, so
+			 * they cost debug-link bandwidth only instead of a
+			 * word of USB traffic each. */
+			uint32_t i;
+			for (i = 1; i < len; i++)
+				if (pbuf[bin + i] != pbuf[bin])
+					break;
+			int err;
+			if ((len >= 64) && (i == len))
+				err = target_mem_fill(cur_target, addr,
+				                      pbuf[bin], len);
+			else
+				err = target_mem_write(cur_target, addr,
+				                       pbuf + bin, len);
+			if (err)
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacketz("OK");
@@ -272,6 +704,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			}
 
 		case 'q':	/* General query packet */
+		case 'Q':	/* General set packet */
 			handle_q_packet(pbuf, size);
 			break;
 
@@ -290,6 +723,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			DEBUG("*** Unsupported packet: %s\n", pbuf);
 			gdb_putpacketz("");
 		}
+		PROFILE_END(PROFILE_GDB_DISPATCH);
 	}
 }
 
@@ -297,19 +731,22 @@ static void
 handle_q_string_reply(const char *str, const char *param)
 {
 	unsigned long addr, len;
+	const size_t str_len = strlen(str);
 
 	if (sscanf(param, "%08lx,%08lx", &addr, &len) != 2) {
 		gdb_putpacketz("E01");
 		return;
 	}
-	if (addr < strlen (str)) {
+	if (addr < str_len) {
+		/* Clamp before sizing the reply buffer: len comes off
+		   the wire and would otherwise size the VLA unchecked */
+		if(len > str_len - addr)
+			len = str_len - addr;
 		char reply[len+2];
 		reply[0] = 'm';
-		strncpy (reply + 1, &str[addr], len);
-		if(len > strlen(&str[addr]))
-			len = strlen(&str[addr]);
+		memcpy(reply + 1, &str[addr], len);
 		gdb_putpacket(reply, len + 1);
-	} else if (addr == strlen (str)) {
+	} else if (addr == str_len) {
 		gdb_putpacketz("l");
 	} else
 		gdb_putpacketz("E01");
@@ -324,13 +761,16 @@ handle_q_packet(char *packet, int len)
 		char *data;
 		int datalen;
 
-		/* calculate size and allocate buffer for command */
+		/* Dehexify the command in place; hex shrinks 2:1 so the
+		 * result always fits ahead of its source, and no stack
+		 * allocation sized by packet contents is needed. */
 		datalen = (len - 6) / 2;
-		data = alloca(datalen+1);
-		/* dehexify command */
-		unhexify(data, packet+6, datalen);
+		data = packet + 6;
+		unhexify(data, data, datalen);
 		data[datalen] = 0;	/* add terminating null */
 
+		/* Monitor commands may do anything to the target */
+		mem_cache_invalidate();
 		int c = command_process(cur_target, data);
 		if(c < 0)
 			gdb_putpacketz("");
@@ -340,8 +780,19 @@ handle_q_packet(char *packet, int len)
 			gdb_putpacketz("E");
 
 	} else if (!strncmp (packet, "qSupported", 10)) {
-		/* Query supported protocol features */
-		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+", BUF_SIZE);
+		/* Query supported protocol features.  Multiprocess packet
+		 * forms are only used once GDB has offered them too. */
+		gdb_multiprocess = strstr(packet, "multiprocess+") != NULL;
+		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+;QStartNoAckMode+;multiprocess+;QNonStop+", BUF_SIZE);
+
+	} else if (!strncmp (packet, "QNonStop:", 9)) {
+		gdb_nonstop = packet[9] == '1';
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp (packet, "QStartNoAckMode")) {
+		/* Don't enable until after we've acked this packet */
+		gdb_putpacketz("OK");
+		gdb_set_noackmode(true);
 
 	} else if (strncmp (packet, "qXfer:memory-map:read::", 23) == 0) {
 		/* Read target XML memory map */
@@ -375,6 +826,26 @@ handle_q_packet(char *packet, int len)
 		}
 		gdb_putpacket_f("C%lx", generic_crc32(cur_target, addr, alen));
 
+	} else if (!strcmp(packet, "qfThreadInfo")) {
+		/* One single-threaded process per listed target */
+		char reply[128] = "m";
+		struct thread_list_s s = {reply, sizeof(reply)};
+		if (target_foreach(gdb_thread_list_cb, &s))
+			gdb_putpacketz(reply);
+		else
+			gdb_putpacketz("l");
+
+	} else if (!strcmp(packet, "qsThreadInfo")) {
+		gdb_putpacketz("l");
+
+	} else if (!strcmp(packet, "qC")) {
+		/* Current thread */
+		if (gdb_multiprocess && cur_target)
+			gdb_putpacket_f("QCp%x.1",
+			                gdb_target_pid(cur_target));
+		else
+			gdb_putpacketz("QC1");
+
 	} else {
 		DEBUG("*** Unsupported packet: %s\n", packet);
 		gdb_putpacket("", 0);
@@ -387,17 +858,23 @@ handle_v_packet(char *packet, int plen)
 	unsigned long addr, len;
 	int bin;
 	static uint8_t flash_mode = 0;
+	static int flash_error = 0;
 
 	if (sscanf(packet, "vAttach;%08lx", &addr) == 1) {
 		/* Attach to remote target processor */
+		mem_cache_invalidate();
 		cur_target = target_attach_n(addr, &gdb_controller);
+		if (!cur_target && gdb_autoscan_enabled &&
+		    (gdb_autoscan() > 0))
+			cur_target = target_attach_n(addr, &gdb_controller);
 		if(cur_target)
-			gdb_putpacketz("T05");
+			gdb_putpacket_f("T05%s", gdb_stop_thread());
 		else
 			gdb_putpacketz("E01");
 
 	} else if (!strcmp(packet, "vRun;")) {
 		/* Run target program. For us (embedded) this means reset. */
+		mem_cache_invalidate();
 		if(cur_target) {
 			target_reset(cur_target);
 			gdb_putpacketz("T05");
@@ -417,14 +894,19 @@ handle_v_packet(char *packet, int plen)
 		/* Erase Flash Memory */
 		DEBUG("Flash Erase %08lX %08lX\n", addr, len);
 		if(!cur_target) { gdb_putpacketz("EFF"); return; }
+		mem_cache_invalidate();
 
 		if(!flash_mode) {
 			/* Reset target if first flash command! */
 			/* This saves us if we're interrupted in IRQ context */
 			target_reset(cur_target);
 			flash_mode = 1;
+			flash_error = 0;
 		}
-		if(target_flash_erase(cur_target, addr, len) == 0)
+		/* The erase itself runs lazily, just ahead of the write
+		 * cursor, so the sector erase time hides inside the
+		 * download; see target_flash_erase_defer(). */
+		if(target_flash_erase_defer(cur_target, addr, len) == 0)
 			gdb_putpacketz("OK");
 		else
 			gdb_putpacketz("EFF");
@@ -433,14 +915,135 @@ handle_v_packet(char *packet, int plen)
 		/* Write Flash Memory */
 		len = plen - bin;
 		DEBUG("Flash Write %08lX %08lX\n", addr, len);
-		if(cur_target && target_flash_write(cur_target, addr, (void*)packet + bin, len) == 0)
+		if(!cur_target) { gdb_putpacketz("EFF"); return; }
+		/* Acknowledge before performing the write so the host
+		 * streams the next packet while this one drains over the
+		 * wire.  Errors accumulate and are reported on vFlashDone,
+		 * which GDB checks before declaring the load good.  An
+		 * exception out of the write (stub timeout, target lost)
+		 * must not unwind past the reply already sent -- main()
+		 * would answer "EFF" to a request this "OK" answered and
+		 * desynchronize the stream -- so it folds into
+		 * flash_error too. */
+		gdb_putpacketz("OK");
+		volatile struct exception e;
+		TRY_CATCH (e, EXCEPTION_ALL) {
+			flash_error |= target_flash_write(cur_target, addr,
+			                                  (void*)packet + bin,
+			                                  len);
+		}
+		if (e.type)
+			flash_error |= 1;
+
+	} else if (!strcmp(packet, "vCont?")) {
+		/* Supported continue actions */
+		gdb_putpacketz("vCont;c;C;s;S;t;r");
+
+	} else if (!strncmp(packet, "vCont;", 6)) {
+		/* We run one core at a time, so take the first action and
+		 * apply it to the target its thread-id names, if any. */
+		char action = packet[6];
+		char *tid = strchr(packet + 6, ':');
+		if (tid && (tid[1] == 'p')) {
+			int pid = 0;
+			sscanf(tid + 2, "%x", &pid);
+			target *t = gdb_target_nth(pid);
+			if (t && target_attached(t)) {
+				if (t != cur_target)
+					mem_cache_invalidate();
+				cur_target = t;
+			}
+		}
+		if (!cur_target) {
+			gdb_putpacketz("E01");
+		} else if (action == 't') {
+			/* Stop request; the halt surfaces through the
+			 * packet-wait poll as a %Stop notification */
+			target_halt_request(cur_target);
 			gdb_putpacketz("OK");
-		else
-			gdb_putpacketz("EFF");
+		} else if (action == 'r') {
+			/* 'r start,end': range step.  Keep stepping on the
+			 * probe while PC stays inside [start,end), so a
+			 * source-level step over a line or a call costs one
+			 * packet instead of a USB round trip per
+			 * instruction. */
+			unsigned long low = 0, high = 0;
+			sscanf(packet + 7, "%lx,%lx", &low, &high);
+			if (gdb_nonstop) {
+				/* Degrade to a single step: the blocking
+				 * loop below would stop packets being
+				 * serviced, and GDB just issues the next
+				 * range step itself. */
+				target_halt_resume(cur_target, true);
+				SET_RUN_STATE(1);
+				bg_running = true;
+				gdb_putpacketz("OK");
+				return;
+			}
+			target_addr watch;
+			enum target_halt_reason reason;
+			bool interrupted = false;
+			for (;;) {
+				target_halt_resume(cur_target, true);
+				SET_RUN_STATE(1);
+				while (!(reason = target_halt_poll(cur_target,
+				                                   &watch))) {
+					unsigned char c = gdb_if_getchar_to(0);
+					if ((c == '\x03') || (c == '\x04')) {
+						target_halt_request(cur_target);
+						interrupted = true;
+					}
+				}
+				SET_RUN_STATE(0);
+				/* Anything but a clean step ends the range:
+				 * breakpoints, watchpoints, faults and ^C
+				 * all report straight back to GDB. */
+				if (interrupted ||
+				    (reason != TARGET_HALT_STEPPING))
+					break;
+				uint32_t pc;
+				if (target_reg_read(cur_target, 15, &pc,
+				                    sizeof(pc)) <= 0)
+					break;
+				if ((pc < low) || (pc >= high))
+					break;
+			}
+			mem_cache_invalidate();
+			gdb_report_halt(reason, watch, false);
+
+		} else if ((action == 'c') || (action == 'C') ||
+			   (action == 's') || (action == 'S')) {
+			target_halt_resume(cur_target,
+				(action == 's') || (action == 'S'));
+			SET_RUN_STATE(1);
+			if (gdb_nonstop) {
+				bg_running = true;
+				gdb_putpacketz("OK");
+			} else {
+				gdb_halt_wait();
+			}
+		} else {
+			gdb_putpacketz("E01");
+		}
+
+	} else if (!strcmp(packet, "vStopped")) {
+		/* At most one stop event is pending per notification */
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp(packet, "vCtrlC")) {
+		/* Non-stop interrupt request */
+		if (cur_target) {
+			target_halt_request(cur_target);
+			gdb_putpacketz("OK");
+		} else {
+			gdb_putpacketz("E01");
+		}
 
 	} else if (!strcmp(packet, "vFlashDone")) {
 		/* Commit flash operations. */
-		gdb_putpacketz(target_flash_done(cur_target) ? "EFF" : "OK");
+		flash_error |= target_flash_done(cur_target);
+		gdb_putpacketz(flash_error ? "EFF" : "OK");
+		flash_error = 0;
 		flash_mode = 0;
 
 	} else {
@@ -480,6 +1083,7 @@ handle_z_packet(char *packet, int plen)
 
 void gdb_main(void)
 {
+	gdb_packet_set_idle(gdb_poll_running_target);
 	gdb_main_loop(&gdb_controller, false);
 }
 
@@ -26,10 +26,67 @@
 #include "gdb_if.h"
 #include "gdb_packet.h"
 #include "hex_utils.h"
+#include "stats.h"
 
 #include <stdarg.h>
 
-int gdb_getpacket(char *packet, int size)
+/* Staging buffer for bulk reception.  gdb_if_read() drains whole
+ * transfers from the transport in one go, so the framing loop below
+ * works over memory rather than making a transport call per byte.
+ */
+static unsigned char rx_buf[256];
+static unsigned int rx_len;
+static unsigned int rx_pos;
+
+/* GDB no-acknowledgment mode (QStartNoAckMode) */
+static bool noackmode;
+
+void gdb_set_noackmode(bool enable)
+{
+	noackmode = enable;
+}
+
+static unsigned char gdb_rx_char(void)
+{
+	if (rx_pos == rx_len) {
+		int n = gdb_if_read(rx_buf, sizeof(rx_buf));
+		if (n <= 0)
+			return 0x04; /* Transport gone, treat as EOF */
+		rx_len = n;
+		rx_pos = 0;
+	}
+	return rx_buf[rx_pos++];
+}
+
+/* Called while waiting for the start of a packet, so the main loop can
+ * poll a target left running in non-stop mode between commands. */
+static void (*idle_callback)(void);
+
+void gdb_packet_set_idle(void (*cb)(void))
+{
+	idle_callback = cb;
+}
+
+/* Like gdb_rx_char(), but gives the idle callback a turn every 50ms
+ * while nothing is arriving.  Only used ahead of the packet start, so
+ * a timeout marker colliding with a real 0xFF data byte can't happen
+ * in practice -- nothing but '$', acks and ^C is expected here. */
+static unsigned char gdb_rx_char_idle(void)
+{
+	if (!idle_callback || (rx_pos < rx_len))
+		return gdb_rx_char();
+
+	for (;;) {
+		unsigned char c = gdb_if_getchar_to(50);
+		if (c == 0xFF) {
+			idle_callback();
+			continue;
+		}
+		return c;
+	}
+}
+
+RAMFUNC int gdb_getpacket(char *packet, int size)
 {
 	unsigned char c;
 	unsigned char csum;
@@ -38,12 +95,12 @@ int gdb_getpacket(char *packet, int size)
 
 	while(1) {
 		/* Wait for packet start */
-		while((packet[0] = gdb_if_getchar()) != '$')
+		while((packet[0] = gdb_rx_char_idle()) != '$')
 			if(packet[0] == 0x04) return 1;
 
 		i = 0; csum = 0;
 		/* Capture packet data into buffer */
-		while((c = gdb_if_getchar()) != '#') {
+		while((c = gdb_rx_char()) != '#') {
 
 			if(i == size) break; /* Oh shit */
 
@@ -53,7 +110,7 @@ int gdb_getpacket(char *packet, int size)
 				continue;
 			}
 			if(c == '}') { /* escaped char */
-				c = gdb_if_getchar();
+				c = gdb_rx_char();
 				csum += c + '}';
 				packet[i++] = c ^ 0x20;
 				continue;
@@ -61,18 +118,23 @@ int gdb_getpacket(char *packet, int size)
 			csum += c;
 			packet[i++] = c;
 		}
-		recv_csum[0] = gdb_if_getchar();
-		recv_csum[1] = gdb_if_getchar();
+		recv_csum[0] = gdb_rx_char();
+		recv_csum[1] = gdb_rx_char();
 		recv_csum[2] = 0;
 
 		/* return packet if checksum matches */
 		if(csum == strtol(recv_csum, NULL, 16)) break;
 
+		/* accept the packet anyway if the link is reliable */
+		if(noackmode) break;
+
 		/* get here if checksum fails */
 		gdb_if_putchar('-', 1); /* send nack */
 	}
-	gdb_if_putchar('+', 1); /* send ack */
+	if(!noackmode)
+		gdb_if_putchar('+', 1); /* send ack */
 	packet[i] = 0;
+	STATS_INC(gdb_rx_packets);
 
 #ifdef DEBUG_GDBPACKET
 	DEBUG("%s : ", __func__);
@@ -88,13 +150,16 @@ int gdb_getpacket(char *packet, int size)
 	return i;
 }
 
-void gdb_putpacket(const char *packet, int size)
+RAMFUNC void gdb_putpacket(const char *packet, int size)
 {
 	int i;
 	unsigned char csum;
 	unsigned char c;
 	char xmit_csum[3];
 	int tries = 0;
+	unsigned char ack;
+
+	STATS_INC(gdb_tx_packets);
 
 	do {
 #ifdef DEBUG_GDBPACKET
@@ -110,13 +175,31 @@ void gdb_putpacket(const char *packet, int size)
 			else
 				DEBUG("\\x%02X", c);
 #endif
-			if((c == '$') || (c == '#') || (c == '}')) {
+			if((c == '$') || (c == '#') || (c == '}') || (c == '*')) {
 				gdb_if_putchar('}', 0);
 				gdb_if_putchar(c ^ 0x20, 0);
 				csum += '}' + (c ^ 0x20);
-			} else {
-				gdb_if_putchar(c, 0);
-				csum += c;
+				continue;
+			}
+			gdb_if_putchar(c, 0);
+			csum += c;
+
+			/* Run-length encode repeats of this character as
+			 * "c*n", n being repeat count + 29.  n must stay
+			 * printable and may not be '#' or '$' (counts 6
+			 * and 7), so cap and clip accordingly.  Register
+			 * and erased-flash dumps shrink dramatically. */
+			int runlen = 0;
+			while ((i + 1 + runlen < size) && (runlen < 97) &&
+			       (packet[i + 1 + runlen] == (char)c))
+				runlen++;
+			if (runlen >= 3) {
+				if ((runlen == 6) || (runlen == 7))
+					runlen = 5;
+				gdb_if_putchar('*', 0);
+				gdb_if_putchar(runlen + 29, 0);
+				csum += '*' + runlen + 29;
+				i += runlen;
 			}
 		}
 		gdb_if_putchar('#', 0);
@@ -126,41 +209,98 @@ void gdb_putpacket(const char *packet, int size)
 #ifdef DEBUG_GDBPACKET
 		DEBUG("\n");
 #endif
-	} while((gdb_if_getchar_to(2000) != '+') && (tries++ < 3));
+		if (noackmode)
+			break;
+		/* The ack may already be sitting in the staging buffer */
+		if (rx_pos < rx_len)
+			ack = rx_buf[rx_pos++];
+		else
+			ack = gdb_if_getchar_to(2000);
+	} while((ack != '+') && (tries++ < 3));
 }
 
+/* Staging buffer for formatted replies.  Formatting into this with a
+ * single vsnprintf() pass keeps malloc out of the packet hot path;
+ * replies can't usefully exceed the advertised PacketSize anyway.
+ * Handlers never nest, so one buffer serves them all. */
+static char fmt_buf[BUF_SIZE + 1];
+
 void gdb_putpacket_f(const char *fmt, ...)
 {
 	va_list ap;
-	char *buf;
 	int size;
 
 	va_start(ap, fmt);
-	size = vasprintf(&buf, fmt, ap);
-	gdb_putpacket(buf, size);
-	free(buf);
+	size = vsnprintf(fmt_buf, sizeof(fmt_buf), fmt, ap);
 	va_end(ap);
+	if (size < 0)
+		return;
+	if (size > (int)sizeof(fmt_buf) - 1)
+		size = sizeof(fmt_buf) - 1;
+	gdb_putpacket(fmt_buf, size);
 }
 
-void gdb_out(const char *buf)
+/* Send an asynchronous notification ('%' frame, GDB RSP non-stop).
+ * Notifications are never acknowledged or retransmitted, and the only
+ * event we emit (%Stop) carries no binary data, so no escaping or
+ * run-length encoding is needed. */
+void gdb_putnotification_f(const char *fmt, ...)
 {
-	char *hexdata;
-	int i;
+	va_list ap;
+	int size;
+	unsigned char csum = 0;
+	char xmit_csum[3];
+
+	va_start(ap, fmt);
+	size = vsnprintf(fmt_buf, sizeof(fmt_buf), fmt, ap);
+	va_end(ap);
+	if (size < 0)
+		return;
+	if (size > (int)sizeof(fmt_buf) - 1)
+		size = sizeof(fmt_buf) - 1;
+
+	gdb_if_putchar('%', 0);
+	for (int i = 0; i < size; i++) {
+		gdb_if_putchar(fmt_buf[i], 0);
+		csum += fmt_buf[i];
+	}
+	gdb_if_putchar('#', 0);
+	sprintf(xmit_csum, "%02X", csum);
+	gdb_if_putchar(xmit_csum[0], 0);
+	gdb_if_putchar(xmit_csum[1], 1);
+}
+
+void gdb_out_buf(const char *buf, size_t count)
+{
+	/* Hexify in bounded chunks rather than alloca()ing twice the
+	 * input size; console output may legally span several 'O'
+	 * packets, GDB just prints them in order. */
+	char hexdata[130];
 
-	hexdata = alloca((i = strlen(buf)*2 + 1) + 1);
 	hexdata[0] = 'O';
-	hexify(hexdata+1, buf, strlen(buf));
-	gdb_putpacket(hexdata, i);
+	while (count) {
+		size_t chunk = MIN(count, (sizeof(hexdata) - 2) / 2);
+		hexify(hexdata + 1, buf, chunk);
+		gdb_putpacket(hexdata, chunk*2 + 1);
+		buf += chunk;
+		count -= chunk;
+	}
 }
 
-void gdb_voutf(const char *fmt, va_list ap)
+void gdb_out(const char *buf)
 {
-	char *buf;
+	gdb_out_buf(buf, strlen(buf));
+}
 
-	if (vasprintf(&buf, fmt, ap) < 0)
+void gdb_voutf(const char *fmt, va_list ap)
+{
+	/* gdb_out_buf() copies out of fmt_buf before it is reused */
+	int size = vsnprintf(fmt_buf, sizeof(fmt_buf), fmt, ap);
+	if (size < 0)
 		return;
-	gdb_out(buf);
-	free(buf);
+	if (size > (int)sizeof(fmt_buf) - 1)
+		size = sizeof(fmt_buf) - 1;
+	gdb_out_buf(fmt_buf, size);
 }
 
 void gdb_outf(const char *fmt, ...)
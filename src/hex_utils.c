@@ -24,38 +24,92 @@
 #include "general.h"
 #include "hex_utils.h"
 
-static const char hexdigits[] = "0123456789abcdef";
+/* Expansion of every byte value to its two hex digits, packed as one
+ * 512 character string so each byte converts with a single table load.
+ */
+static const char hex_byte[] =
+	"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* Hex digit to nibble value, zero for everything else */
+static const uint8_t unhex_nibble[256] = {
+	['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+	['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+	['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14,
+	['f'] = 15,
+	['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14,
+	['F'] = 15,
+};
 
 char * hexify(char *hex, const void *buf, size_t size)
 {
 	char *tmp = hex;
 	const uint8_t *b = buf;
 
+	/* Convert four bytes per iteration to keep the loop overhead off
+	 * the per-byte cost on the 'm'/'g' packet hot path. */
+	while (size >= 4) {
+		memcpy(tmp + 0, &hex_byte[b[0] * 2], 2);
+		memcpy(tmp + 2, &hex_byte[b[1] * 2], 2);
+		memcpy(tmp + 4, &hex_byte[b[2] * 2], 2);
+		memcpy(tmp + 6, &hex_byte[b[3] * 2], 2);
+		tmp += 8;
+		b += 4;
+		size -= 4;
+	}
 	while (size--) {
-		*tmp++ = hexdigits[*b >> 4];
-		*tmp++ = hexdigits[*b++ & 0xF];
+		memcpy(tmp, &hex_byte[*b++ * 2], 2);
+		tmp += 2;
 	}
-	*tmp++ = 0;
+	*tmp = 0;
 
 	return hex;
 }
 
-static uint8_t unhex_digit(char hex)
+/* Expand size raw bytes at the start of buf to hex in the same buffer.
+ * buf must have room for size * 2 + 1 characters.  Working from the
+ * end means the output never overtakes the bytes still to convert.
+ */
+char * hexify_inplace(char *buf, size_t size)
 {
-	uint8_t tmp = hex - '0';
-	if(tmp > 9)
-		tmp -= 'A' - '0' - 10;
-	if(tmp > 16)
-		tmp -= 'a' - 'A';
-	return tmp;
+	const uint8_t *b = (const uint8_t *)buf;
+	char *tmp = buf + size * 2;
+
+	*tmp = 0;
+	while (size--) {
+		tmp -= 2;
+		memcpy(tmp, &hex_byte[b[size] * 2], 2);
+	}
+
+	return buf;
 }
 
+/* Also safe for in-place conversion (buf == hex) as the output never
+ * overtakes the input. */
 char * unhexify(void *buf, const char *hex, size_t size)
 {
 	uint8_t *b = buf;
+	const uint8_t *h = (const uint8_t *)hex;
+
+	while (size >= 4) {
+		b[0] = (unhex_nibble[h[0]] << 4) | unhex_nibble[h[1]];
+		b[1] = (unhex_nibble[h[2]] << 4) | unhex_nibble[h[3]];
+		b[2] = (unhex_nibble[h[4]] << 4) | unhex_nibble[h[5]];
+		b[3] = (unhex_nibble[h[6]] << 4) | unhex_nibble[h[7]];
+		b += 4;
+		h += 8;
+		size -= 4;
+	}
 	while (size--) {
-		*b = unhex_digit(*hex++) << 4;
-		*b++ |= unhex_digit(*hex++);
+		*b = unhex_nibble[h[0]] << 4;
+		*b++ |= unhex_nibble[h[1]];
+		h += 2;
 	}
 	return buf;
 }
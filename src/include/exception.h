@@ -54,6 +54,7 @@ struct exception {
 	const char *msg;
 	/* private */
 	uint32_t mask;
+	uint32_t deferred;
 	jmp_buf jmpbuf;
 	struct exception *outer;
 };
@@ -63,6 +64,7 @@ extern struct exception *innermost_exception;
 #define TRY_CATCH(e, type_mask) \
 	(e).type = 0; \
 	(e).mask = (type_mask); \
+	(e).deferred = 0; \
 	(e).outer = innermost_exception; \
 	innermost_exception = (void*)&(e); \
 	if (setjmp(innermost_exception->jmpbuf) == 0) \
@@ -70,5 +72,14 @@ extern struct exception *innermost_exception;
 
 void raise_exception(uint32_t type, const char *msg);
 
+/* Lightweight alternative to TRY_CATCH for high-frequency leaf
+ * operations (status polls and the like): no setjmp frame is saved.
+ * A matching raise is recorded in the frame and the raiser continues,
+ * so the guarded operations must tolerate completing with garbage
+ * results; check exception_defer_end() before using them.  Frames
+ * nest with TRY_CATCH in the usual strictly-nested fashion. */
+void exception_defer_begin(struct exception *e, uint32_t type_mask);
+uint32_t exception_defer_end(struct exception *e);
+
 #endif
 
@@ -21,12 +21,17 @@
 #ifndef __GDB_IF_H
 #define __GDB_IF_H
 
-#if !defined(LIBFTDI)
+#if !defined(LIBFTDI) && !defined(PC_BENCH)
 #include <libopencm3/usb/usbd.h>
 void gdb_usb_out_cb(usbd_device *dev, uint8_t ep);
+void gdb_usb_in_cb(usbd_device *dev, uint8_t ep);
+#if defined(PLATFORM_HAS_GDB_RAW)
+void gdb_usb_raw_out_cb(usbd_device *dev, uint8_t ep);
+#endif
 #endif
 
 int gdb_if_init(void);
+int gdb_if_read(void *buf, int maxlen);
 unsigned char gdb_if_getchar(void);
 unsigned char gdb_if_getchar_to(int timeout);
 void gdb_if_putchar(unsigned char c, int flush);
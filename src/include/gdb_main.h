@@ -23,5 +23,13 @@
 
 void gdb_main(void);
 
+/* Controls the 'm' packet read-combining cache, see the mem_cache
+ * monitor command */
+extern bool gdb_mem_cache_enabled;
+
+/* Scan for targets on first vAttach when none are known, see the
+ * autoscan monitor command */
+extern bool gdb_autoscan_enabled;
+
 #endif
 
@@ -23,12 +23,23 @@
 
 #include <stdarg.h>
 
+/* The packet buffer size determines the PacketSize we advertise to GDB
+ * and so how finely flash loads get chopped up.  Platforms with more
+ * RAM can override this from platform.h. */
+#ifndef BUF_SIZE
+#define BUF_SIZE	1024
+#endif
+
+void gdb_set_noackmode(bool enable);
 int gdb_getpacket(char *packet, int size);
 void gdb_putpacket(const char *packet, int size);
 #define gdb_putpacketz(packet) gdb_putpacket((packet), strlen(packet))
 void gdb_putpacket_f(const char *packet, ...);
+void gdb_putnotification_f(const char *fmt, ...);
+void gdb_packet_set_idle(void (*cb)(void));
 
 void gdb_out(const char *buf);
+void gdb_out_buf(const char *buf, size_t count);
 void gdb_voutf(const char *fmt, va_list);
 void gdb_outf(const char *fmt, ...);
 
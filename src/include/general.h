@@ -38,6 +38,19 @@
 #define DEBUG	printf
 #endif
 
+/* Link hot functions into SRAM on probes that execute from wait-stated
+ * flash.  Sections named .data.* land inside .data in the libopencm3
+ * linker scripts, so the regular startup data copy moves the code to
+ * RAM and no linker script changes are needed; calls from flash get
+ * linker-generated veneers.  Expands to nothing on hosted builds. */
+#ifndef RAMFUNC
+#if defined(STM32F1) || defined(STM32F4)
+#define RAMFUNC __attribute__((section(".data.ramfunc")))
+#else
+#define RAMFUNC
+#endif
+#endif
+
 #define ALIGN(x, n) (((x) + (n) - 1) & ~((n) - 1))
 #undef MIN
 #define MIN(x, y)  (((x) < (y)) ? (x) : (y))
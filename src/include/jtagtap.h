@@ -27,6 +27,12 @@ int jtagtap_init(void);
 
 void jtagtap_reset(void);
 
+/* Clock rate control, provided as weak no-ops in jtagtap_generic.c
+ * for backends with a fixed rate.  jtagtap_get_frequency() returns
+ * zero when the backend has no clock control. */
+void jtagtap_set_frequency(uint32_t hz);
+uint32_t jtagtap_get_frequency(void);
+
 uint8_t jtagtap_next(const uint8_t TMS, const uint8_t TDI);
 /* tap_next executes one state transision in the JTAG TAP state machine:
  * - Ensure TCK is low
@@ -34,6 +34,22 @@ typedef struct platform_timeout platform_timeout;
 void platform_timeout_set(platform_timeout *t, uint32_t ms);
 bool platform_timeout_is_expired(platform_timeout *t);
 void platform_delay(uint32_t ms);
+/* Microsecond-granularity delay for pacing retry and status polls.
+ * platform_delay() is quantized to the heartbeat tick on embedded
+ * platforms and the scheduler on hosted ones, so short waits through
+ * it oversleep by orders of magnitude; this one busy-waits below a
+ * millisecond and must not be used for long delays. */
+void platform_delay_us(uint32_t us);
+
+/* Throttle for register busy-polls.  platform_poll_wait() pauses
+ * between status reads, starting with immediate re-reads and backing
+ * off in doubling steps up to cap_us -- roughly the expected duration
+ * of the operation being waited on.  A flash erase then costs a
+ * handful of status reads over the wire instead of thousands, while
+ * operations that finish early are still caught promptly. */
+typedef struct platform_poll platform_poll;
+void platform_poll_init(platform_poll *p, uint32_t cap_us);
+void platform_poll_wait(platform_poll *p);
 
 const char *platform_target_voltage(void);
 int platform_hwversion(void);
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+/* Optional cycle-accurate profiling of the probe's own hot paths,
+ * compiled in with ENABLE_PROFILE=1.  PROFILE_BEGIN/PROFILE_END
+ * bracket a region and feed min/avg/max statistics per site, read out
+ * with the profile monitor command, so "flashing is slow" reports can
+ * be split into USB, protocol and wire time.  Timebase is the probe
+ * MCU's DWT cycle counter. */
+
+#ifdef ENABLE_PROFILE
+
+enum profile_site {
+	PROFILE_SWD_XFER,	/* one SWD transaction incl. WAIT retries */
+	PROFILE_GDB_DISPATCH,	/* handling one received GDB packet */
+	PROFILE_USB_SEND,	/* handing one buffer to the USB stack */
+	PROFILE_NUM_SITES
+};
+
+struct profile_record {
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t count;
+};
+
+extern struct profile_record profile_records[PROFILE_NUM_SITES];
+
+/* Provided by the platform: a free-running CPU cycle counter */
+uint32_t profile_cycles(void);
+
+void profile_sample(enum profile_site site, uint32_t cycles);
+
+#define PROFILE_BEGIN(site) \
+	uint32_t profile_start_##site = profile_cycles()
+#define PROFILE_END(site) \
+	profile_sample(site, profile_cycles() - profile_start_##site)
+
+#else
+
+#define PROFILE_BEGIN(site) do {} while (0)
+#define PROFILE_END(site) do {} while (0)
+
+#endif
+
+#endif
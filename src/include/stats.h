@@ -0,0 +1,45 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATS_H
+#define __STATS_H
+
+/* Wire-traffic counters for the stats monitor command.  Bumping a
+ * field of the global struct is a single load/increment/store, cheap
+ * enough to leave in the SWD fast path unconditionally. */
+
+struct wire_stats {
+	uint32_t swd_access;		/* SWD transactions attempted */
+	uint32_t swd_wait;		/* WAIT acks retried */
+	uint32_t swd_fault;		/* FAULT acks */
+	uint32_t swd_parity;		/* read parity errors */
+	uint32_t mem_read_bytes;	/* target memory traffic */
+	uint32_t mem_write_bytes;
+	uint32_t gdb_rx_packets;	/* GDB remote protocol packets */
+	uint32_t gdb_tx_packets;
+	uint32_t uart_overruns;		/* USB-UART receiver overruns */
+	uint32_t uart_drops;		/* USB-UART bytes lost to a full ring */
+};
+
+extern struct wire_stats wire_stats;
+
+#define STATS_INC(field) (wire_stats.field++)
+#define STATS_ADD(field, n) (wire_stats.field += (n))
+
+#endif
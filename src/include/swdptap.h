@@ -23,6 +23,17 @@
 
 int swdptap_init(void);
 
+/* Clock rate control, provided as weak no-ops in swdptap_generic.c
+ * for backends with a fixed rate.  swdptap_get_frequency() returns
+ * zero when the backend has no clock control.
+ * swdptap_pin_frequency() also makes the rate the ceiling that each
+ * scan's negotiation starts from; swdptap_set_frequency() changes the
+ * rate below that ceiling without moving it. */
+void swdptap_set_frequency(uint32_t hz);
+uint32_t swdptap_get_frequency(void);
+void swdptap_pin_frequency(uint32_t hz);
+uint32_t swdptap_max_frequency(void);
+
 /* Primitive functions */
 bool swdptap_bit_in(void);
 void swdptap_bit_out(bool val);
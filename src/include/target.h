@@ -47,9 +47,21 @@ const char *target_driver_name(target *t);
 /* Memory access functions */
 const char *target_mem_map(target *t);
 int target_mem_read(target *t, void *dest, target_addr src, size_t len);
+/* As target_mem_read, but reads across unmapped holes in one pass where
+ * the target supports it.  Returns the number of leading bytes that were
+ * read successfully; faulting ranges of dest are zero-filled. */
+size_t target_mem_read_partial(target *t, void *dest, target_addr src, size_t len);
 int target_mem_write(target *t, target_addr dest, const void *src, size_t len);
+/* Fill len bytes at dest with one repeating byte value */
+int target_mem_fill(target *t, target_addr dest, uint8_t val, size_t len);
+/* Read back and compare every memory write, toggled with the
+ * verify_writes monitor command */
+extern bool target_mem_verify_enabled;
 /* Flash memory access functions */
 int target_flash_erase(target *t, target_addr addr, size_t len);
+/* Queue an erase to run lazily, just ahead of subsequent flash writes;
+ * anything still queued is completed by target_flash_done() */
+int target_flash_erase_defer(target *t, target_addr addr, size_t len);
 int target_flash_write(target *t, target_addr dest, const void *src, size_t len);
 int target_flash_done(target *t);
 
@@ -58,6 +70,10 @@ size_t target_regs_size(target *t);
 const char *target_tdesc(target *t);
 void target_regs_read(target *t, void *data);
 void target_regs_write(target *t, const void *data);
+/* Single-register access, returns byte size transferred, 0 if the
+ * target has no single-register support, negative on error. */
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max);
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size);
 
 /* Halt/resume functions */
 enum target_halt_reason {
@@ -70,6 +86,13 @@ enum target_halt_reason {
 	TARGET_HALT_FAULT,
 };
 
+/* Reset timing profile, adjusted with the reset_timing monitor command:
+ * width of the SRST pulse, settle time after release from reset, and the
+ * poll interval while waiting for the core to halt during attach. */
+extern unsigned target_srst_pulse_us;
+extern unsigned target_reset_settle_us;
+extern unsigned target_halt_poll_ms;
+
 void target_reset(target *t);
 void target_halt_request(target *t);
 enum target_halt_reason target_halt_poll(target *t, target_addr *watch);
@@ -0,0 +1,34 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TASKS_H
+#define __TASKS_H
+
+/* Minimal cooperative task layer.  The GDB engine owns the thread of
+ * control; housekeeping pumps (trace decode, UART-to-USB) register
+ * themselves with task_add() and run to completion whenever the engine
+ * passes a yield point.  Yield points sit in the wire-wait loops, so a
+ * long flash write or memory transfer no longer starves the other data
+ * paths.  Tasks run in thread context, must not block, and must not
+ * touch the debug wire. */
+
+typedef void (*task_fn)(void);
+
+void task_add(task_fn fn);
+void task_yield(void);
+
+#endif
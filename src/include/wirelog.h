@@ -0,0 +1,58 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WIRELOG_H
+#define __WIRELOG_H
+
+/* Deferred binary logging of SWD wire events, compiled in with
+ * ENABLE_WIRELOG=1 on the hosted (libftdi) platform.  DEBUG output in
+ * the per-transaction paths goes through printf, and the act of
+ * printing slows the wire enough that timing-sensitive failures stop
+ * reproducing; these macros instead drop fixed 16-byte records into an
+ * in-memory ring with no formatting or I/O on the hot path.  The ring
+ * keeps the most recent events and wirelog_flush() writes them out
+ * once the operation is over -- from the wirelog monitor command, when
+ * the main loop catches an exception, and at exit -- to the file named
+ * by $BMP_WIRELOG (default wirelog.bin).  Decode with
+ * scripts/wirelog.py. */
+
+#ifdef ENABLE_WIRELOG
+
+enum wirelog_event {
+	WIRELOG_SWD_XFER = 0,	/* a=request, b=RnW, c=data moved */
+	WIRELOG_SWD_WAIT,	/* a=request, b=retry count, c=backoff us */
+	WIRELOG_SWD_FAULT,	/* a=request */
+	WIRELOG_SWD_PARITY,	/* a=request, c=data as read */
+	WIRELOG_SWD_TIMEOUT,	/* a=request: WAIT retry budget spent */
+};
+
+void wirelog_emit(uint8_t event, uint8_t a, uint16_t b, uint32_t c);
+void wirelog_flush(void);
+
+#define WIRELOG(event, a, b, c) wirelog_emit((event), (a), (b), (c))
+#define WIRELOG_FLUSH() wirelog_flush()
+
+#else
+
+#define WIRELOG(event, a, b, c) do {} while (0)
+#define WIRELOG_FLUSH() do {} while (0)
+
+#endif
+
+#endif /* __WIRELOG_H */
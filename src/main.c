@@ -29,6 +29,8 @@
 #include "exception.h"
 #include "gdb_packet.h"
 #include "morse.h"
+#include "tasks.h"
+#include "wirelog.h"
 
 int
 main(int argc, char **argv)
@@ -41,12 +43,19 @@ main(int argc, char **argv)
 	platform_init();
 #endif
 
+	/* The GDB engine is the thread of control; everything else runs
+	 * as cooperative tasks at the yield points inside its wire-wait
+	 * and transfer loops (see tasks.h). */
 	while (true) {
 		volatile struct exception e;
+		task_yield();
 		TRY_CATCH(e, EXCEPTION_ALL) {
 			gdb_main();
 		}
 		if (e.type) {
+			/* Preserve the wire events leading up to the
+			 * failure while they are still in the ring */
+			WIRELOG_FLUSH();
 			gdb_putpacketz("EFF");
 			target_list_free();
 			morse("TARGET LOST.", 1);
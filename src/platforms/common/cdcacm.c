@@ -44,6 +44,31 @@
 
 #define DFU_IF_NO 4
 
+/* Interrupt endpoint polling interval: frames at full speed, but an
+ * exponent in microframes at high speed.  The trace bulk endpoint
+ * must also grow to 512 bytes under USB_HS -- high speed requires it
+ * -- while the drain still hands the core 64-byte chunks. */
+#ifdef USB_HS
+#define CDCACM_COMM_INTERVAL	11
+#define TRACE_ENDPOINT_SIZE	512
+#else
+#define CDCACM_COMM_INTERVAL	255
+#define TRACE_ENDPOINT_SIZE	64
+#endif
+
+/* The raw GDB transport interface sits after the optional trace
+ * capture interface, so its interface and string indices shift with
+ * PLATFORM_HAS_TRACESWO. */
+#if defined(PLATFORM_HAS_GDB_RAW)
+#if defined(PLATFORM_HAS_TRACESWO)
+#define GDB_RAW_IF_NO	6
+#define GDB_RAW_STR_IDX	8
+#else
+#define GDB_RAW_IF_NO	5
+#define GDB_RAW_STR_IDX	7
+#endif
+#endif
+
 usbd_device * usbdev;
 
 static int configured;
@@ -77,7 +102,7 @@ static const struct usb_endpoint_descriptor gdb_comm_endp[] = {{
 	.bEndpointAddress = 0x82,
 	.bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
 	.wMaxPacketSize = 16,
-	.bInterval = 255,
+	.bInterval = CDCACM_COMM_INTERVAL,
 }};
 
 static const struct usb_endpoint_descriptor gdb_data_endp[] = {{
@@ -180,7 +205,7 @@ static const struct usb_endpoint_descriptor uart_comm_endp[] = {{
 	.bEndpointAddress = 0x84,
 	.bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
 	.wMaxPacketSize = 16,
-	.bInterval = 255,
+	.bInterval = CDCACM_COMM_INTERVAL,
 }};
 
 static const struct usb_endpoint_descriptor uart_data_endp[] = {{
@@ -317,7 +342,7 @@ static const struct usb_endpoint_descriptor trace_endp[] = {{
 	.bDescriptorType = USB_DT_ENDPOINT,
 	.bEndpointAddress = 0x85,
 	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
-	.wMaxPacketSize = 64,
+	.wMaxPacketSize = TRACE_ENDPOINT_SIZE,
 	.bInterval = 0,
 }};
 
@@ -345,6 +370,53 @@ static const struct usb_iface_assoc_descriptor trace_assoc = {
 	.bFunctionProtocol = 0xFF,
 	.iFunction = 7,
 };
+
+#if defined(PLATFORM_HAS_GDB_RAW)
+/* Vendor-specific bulk interface carrying the same GDB byte stream as
+ * the CDC-ACM channel, minus the host tty layer: no line discipline,
+ * no latency timers, no in-band flow control.  A host-side bridge
+ * (scripts/gdb_raw_bridge.py) exposes it to GDB. */
+static const struct usb_endpoint_descriptor gdb_raw_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x06,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = CDCACM_PACKET_SIZE,
+	.bInterval = 1,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x86,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = CDCACM_PACKET_SIZE,
+	.bInterval = 1,
+}};
+
+const struct usb_interface_descriptor gdb_raw_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = GDB_RAW_IF_NO,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = 0xFF,
+	.bInterfaceSubClass = 0xFF,
+	.bInterfaceProtocol = 0xFF,
+	.iInterface = GDB_RAW_STR_IDX,
+
+	.endpoint = gdb_raw_endp,
+};
+
+static const struct usb_iface_assoc_descriptor gdb_raw_assoc = {
+	.bLength = USB_DT_INTERFACE_ASSOCIATION_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE_ASSOCIATION,
+	.bFirstInterface = GDB_RAW_IF_NO,
+	.bInterfaceCount = 1,
+	.bFunctionClass = 0xFF,
+	.bFunctionSubClass = 0xFF,
+	.bFunctionProtocol = 0xFF,
+	.iFunction = GDB_RAW_STR_IDX,
+};
+#endif
 #endif
 
 static const struct usb_interface ifaces[] = {{
@@ -371,13 +443,21 @@ static const struct usb_interface ifaces[] = {{
 	.iface_assoc = &trace_assoc,
 	.altsetting = &trace_iface,
 #endif
+#if defined(PLATFORM_HAS_GDB_RAW)
+}, {
+	.num_altsetting = 1,
+	.iface_assoc = &gdb_raw_assoc,
+	.altsetting = &gdb_raw_iface,
+#endif
 }};
 
 static const struct usb_config_descriptor config = {
 	.bLength = USB_DT_CONFIGURATION_SIZE,
 	.bDescriptorType = USB_DT_CONFIGURATION,
 	.wTotalLength = 0,
-#if defined(PLATFORM_HAS_TRACESWO)
+#if defined(PLATFORM_HAS_GDB_RAW)
+	.bNumInterfaces = GDB_RAW_IF_NO + 1,
+#elif defined(PLATFORM_HAS_TRACESWO)
 	.bNumInterfaces = 6,
 #else
 	.bNumInterfaces = 5,
@@ -406,6 +486,9 @@ static const char *usb_strings[] = {
 #if defined(PLATFORM_HAS_TRACESWO)
 	"Black Magic Trace Capture",
 #endif
+#if defined(PLATFORM_HAS_GDB_RAW)
+	"Black Magic Raw GDB Transport",
+#endif
 };
 
 static void dfu_detach_complete(usbd_device *dev, struct usb_setup_data *req)
@@ -502,15 +585,15 @@ static void cdcacm_set_config(usbd_device *dev, uint16_t wValue)
 	configured = wValue;
 
 	/* GDB interface */
-#if defined(STM32F4) || defined(LM4F)
 	usbd_ep_setup(dev, 0x01, USB_ENDPOINT_ATTR_BULK,
 	              CDCACM_PACKET_SIZE, gdb_usb_out_cb);
+#if defined(STM32F1) || defined(STM32F4)
+	usbd_ep_setup(dev, 0x81, USB_ENDPOINT_ATTR_BULK,
+	              CDCACM_PACKET_SIZE, gdb_usb_in_cb);
 #else
-	usbd_ep_setup(dev, 0x01, USB_ENDPOINT_ATTR_BULK,
-	              CDCACM_PACKET_SIZE, NULL);
-#endif
 	usbd_ep_setup(dev, 0x81, USB_ENDPOINT_ATTR_BULK,
 	              CDCACM_PACKET_SIZE, NULL);
+#endif
 	usbd_ep_setup(dev, 0x82, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
 
 	/* Serial interface */
@@ -523,7 +606,15 @@ static void cdcacm_set_config(usbd_device *dev, uint16_t wValue)
 #if defined(PLATFORM_HAS_TRACESWO)
 	/* Trace interface */
 	usbd_ep_setup(dev, 0x85, USB_ENDPOINT_ATTR_BULK,
-					64, trace_buf_drain);
+					TRACE_ENDPOINT_SIZE, trace_buf_drain);
+#endif
+
+#if defined(PLATFORM_HAS_GDB_RAW)
+	/* Raw GDB transport, sharing the CDC-ACM channel's stream */
+	usbd_ep_setup(dev, 0x06, USB_ENDPOINT_ATTR_BULK,
+	              CDCACM_PACKET_SIZE, gdb_usb_raw_out_cb);
+	usbd_ep_setup(dev, 0x86, USB_ENDPOINT_ATTR_BULK,
+	              CDCACM_PACKET_SIZE, gdb_usb_in_cb);
 #endif
 
 	usbd_register_control_callback(dev,
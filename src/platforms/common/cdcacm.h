@@ -30,10 +30,21 @@
 
 #include <libopencm3/usb/usbd.h>
 
+/* Bulk endpoint size: 64 bytes at full speed; platforms built for a
+ * high-speed core (USB_HS) get the 512-byte packets the HS bulk spec
+ * mandates, and all the stream buffers scale with this. */
+#ifndef CDCACM_PACKET_SIZE
+#ifdef USB_HS
+#define CDCACM_PACKET_SIZE 	512
+#else
 #define CDCACM_PACKET_SIZE 	64
+#endif
+#endif
 
 #define CDCACM_GDB_ENDPOINT	1
 #define CDCACM_UART_ENDPOINT	3
+/* Vendor bulk endpoint of the raw GDB transport (PLATFORM_HAS_GDB_RAW) */
+#define CDCACM_GDB_RAW_ENDPOINT	6
 
 extern usbd_device *usbdev;
 
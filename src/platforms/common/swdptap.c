@@ -23,12 +23,68 @@
 #include "general.h"
 #include "swdptap.h"
 
+/* A platform may override the unthrottled loop rate estimate if its
+ * core clock makes the default a poor fit. */
+#ifndef SWD_FREQ_UNTHROTTLED
+#define SWD_FREQ_UNTHROTTLED	4000000
+#endif
+#define SWD_FREQ_MIN		100000
+
+/* Delay loop iterations inserted into each SWCLK half period; zero
+ * runs the bit-bang loop flat out. */
+static uint32_t swd_delay_cnt = 0;
+static uint32_t swd_freq = SWD_FREQ_UNTHROTTLED;
+/* Negotiation ceiling: the rate the user pinned with swd_freq, or the
+ * unthrottled maximum.  Scan-time negotiation backs off below it with
+ * swdptap_set_frequency(), and each new scan starts over from here
+ * rather than from wherever a failed scan left SWCLK. */
+static uint32_t swd_freq_max = SWD_FREQ_UNTHROTTLED;
+
+#define SWD_DELAY() do { \
+	for(volatile uint32_t _i = swd_delay_cnt; _i; _i--); \
+} while (0)
+
 int swdptap_init(void)
 {
 	return 0;
 }
 
-static void swdptap_turnaround(uint8_t dir)
+/* The mapping from Hz to delay iterations is only an estimate -- the
+ * flat-out rate depends on the core clock and flash wait states -- but
+ * it is monotonic, which is all the scan-time negotiation and the
+ * swd_freq monitor command need. */
+void swdptap_set_frequency(uint32_t hz)
+{
+	if (hz < SWD_FREQ_MIN)
+		hz = SWD_FREQ_MIN;
+	if (hz >= SWD_FREQ_UNTHROTTLED) {
+		hz = SWD_FREQ_UNTHROTTLED;
+		swd_delay_cnt = 0;
+	} else {
+		swd_delay_cnt = SWD_FREQ_UNTHROTTLED / (2 * hz);
+	}
+	swd_freq = hz;
+}
+
+uint32_t swdptap_get_frequency(void)
+{
+	return swd_freq;
+}
+
+/* Pin the rate as the new negotiation ceiling (the swd_freq monitor
+ * command's entry point, as opposed to a scan-time back-off). */
+void swdptap_pin_frequency(uint32_t hz)
+{
+	swdptap_set_frequency(hz);
+	swd_freq_max = swd_freq;
+}
+
+uint32_t swdptap_max_frequency(void)
+{
+	return swd_freq_max;
+}
+
+static RAMFUNC void swdptap_turnaround(uint8_t dir)
 {
 	static uint8_t olddir = 0;
 
@@ -43,12 +99,14 @@ static void swdptap_turnaround(uint8_t dir)
 	if(dir)
 		SWDIO_MODE_FLOAT();
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 	if(!dir)
 		SWDIO_MODE_DRIVE();
 }
 
-bool swdptap_bit_in(void)
+RAMFUNC bool swdptap_bit_in(void)
 {
 	uint16_t ret;
 
@@ -56,7 +114,9 @@ bool swdptap_bit_in(void)
 
 	ret = gpio_get(SWDIO_PORT, SWDIO_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 
 #ifdef DEBUG_SWD_BITS
 	DEBUG("%d", ret?1:0);
@@ -65,7 +125,7 @@ bool swdptap_bit_in(void)
 	return ret != 0;
 }
 
-void swdptap_bit_out(bool val)
+RAMFUNC void swdptap_bit_out(bool val)
 {
 #ifdef DEBUG_SWD_BITS
 	DEBUG("%d", val);
@@ -75,6 +135,141 @@ void swdptap_bit_out(bool val)
 
 	gpio_set_val(SWDIO_PORT, SWDIO_PIN, val);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
+}
+
+#ifndef DEBUG_SWD_BITS
+/* Strong versions of the sequence functions, overriding the weak
+ * per-bit generics in swdptap_generic.c.  Keeping the whole sequence
+ * in one loop over the inline GPIO accessors, with the turnaround
+ * check hoisted out, removes two function calls and a branch per bit
+ * and several-fold raises the achievable SWCLK rate.  When
+ * DEBUG_SWD_BITS is defined the generic versions are used instead so
+ * the bit trace stays visible. */
+
+RAMFUNC uint32_t swdptap_seq_in(int ticks)
+{
+	uint32_t index = 1;
+	uint32_t ret = 0;
+
+	swdptap_turnaround(1);
+	while (ticks--) {
+		if (gpio_get(SWDIO_PORT, SWDIO_PIN))
+			ret |= index;
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+		index <<= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+	}
+
+	return ret;
+}
+
+RAMFUNC bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
+{
+	uint32_t index = 1;
+	uint8_t parity = 0;
+	uint32_t res = 0;
+
+	swdptap_turnaround(1);
+	while (ticks--) {
+		if (gpio_get(SWDIO_PORT, SWDIO_PIN)) {
+			res |= index;
+			parity ^= 1;
+		}
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+		index <<= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+	}
+	if (gpio_get(SWDIO_PORT, SWDIO_PIN))
+		parity ^= 1;
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
+
+	*ret = res;
+	return parity;
+}
+
+#ifdef SWD_PORT_SHARED
+/* SWDIO and SWCLK live on one GPIO port, so a single BSRR store can
+ * assert the data bit and the falling clock edge together.  The
+ * target latches SWDIO on the rising edge, which stays a store of
+ * its own: two stores per bit instead of three or four.  Each
+ * sequence enters and leaves with SWCLK low like the unfused loops,
+ * so the waveform seen by the target is unchanged. */
+#define SWD_BIT_CELL(val) do { \
+	GPIO_BSRR(SWDIO_PORT) = \
+		((val) ? SWDIO_PIN : (uint32_t)SWDIO_PIN << 16) | \
+		((uint32_t)SWCLK_PIN << 16); \
+	SWD_DELAY(); \
+	GPIO_BSRR(SWDIO_PORT) = SWCLK_PIN; \
+	SWD_DELAY(); \
+} while (0)
+
+RAMFUNC void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	swdptap_turnaround(0);
+	while (ticks--) {
+		SWD_BIT_CELL(MS & 1);
+		MS >>= 1;
+	}
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+}
+
+RAMFUNC void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	uint8_t parity = 0;
+
+	swdptap_turnaround(0);
+	while (ticks--) {
+		SWD_BIT_CELL(MS & 1);
+		parity ^= MS;
+		MS >>= 1;
+	}
+	SWD_BIT_CELL(parity & 1);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+}
+#else
+RAMFUNC void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	swdptap_turnaround(0);
+	while (ticks--) {
+		gpio_set_val(SWDIO_PORT, SWDIO_PIN, MS & 1);
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+		MS >>= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+	}
+}
+
+RAMFUNC void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	uint8_t parity = 0;
+
+	swdptap_turnaround(0);
+	while (ticks--) {
+		gpio_set_val(SWDIO_PORT, SWDIO_PIN, MS & 1);
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+		parity ^= MS;
+		MS >>= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		SWD_DELAY();
+	}
+	gpio_set_val(SWDIO_PORT, SWDIO_PIN, parity & 1);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	SWD_DELAY();
 }
+#endif /* SWD_PORT_SHARED */
+#endif /* !DEBUG_SWD_BITS */
 
@@ -29,3 +29,17 @@ bool platform_timeout_is_expired(platform_timeout *t)
 	return platform_time_ms() > t->time;
 }
 
+void platform_poll_init(platform_poll *p, uint32_t cap_us)
+{
+	p->wait_us = 0;
+	p->cap_us = cap_us;
+}
+
+void platform_poll_wait(platform_poll *p)
+{
+	if (p->wait_us)
+		platform_delay_us(p->wait_us);
+	uint32_t next = p->wait_us ? p->wait_us << 1 : 8;
+	p->wait_us = (next > p->cap_us) ? p->cap_us : next;
+}
+
@@ -24,6 +24,11 @@ struct platform_timeout {
 	uint32_t time;
 };
 
+struct platform_poll {
+	uint32_t wait_us;
+	uint32_t cap_us;
+};
+
 uint32_t platform_time_ms(void);
 
 #endif /* __TIMING_H */
@@ -24,5 +24,21 @@
 
 void traceswo_init(void);
 void trace_buf_drain(usbd_device *dev, uint8_t ep);
+/* Queue bytes for the trace endpoint.  Also carries the PC sampling
+ * profiler's records, so it is safe from thread context. */
+void trace_buf_push(uint8_t *buf, int len);
+
+/* Set the capture baud rate.  Only meaningful for NRZ (UART mode)
+ * backends; Manchester backends recover the bit rate from the coding
+ * and implement this as a no-op. */
+void traceswo_setbaud(uint32_t baud);
+
+/* Probe-side ITM filtering: forward only the stimulus ports in mask,
+ * optionally stripped to bare payload.  Disabled = raw passthrough. */
+void traceswo_filter_set(bool enable, uint32_t mask, bool strip);
+
+/* Compress the outgoing trace stream (scripts/swo_decompress.py
+ * restores it on the host) */
+void traceswo_compress_set(bool enable);
 
 #endif
@@ -0,0 +1,48 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __USB_FIFO_H
+#define __USB_FIFO_H
+
+/* Shared ring-to-packet staging for the UART and trace capture paths.
+ *
+ * Interrupt (or DMA) producers fill a byte ring; a consumer in task
+ * context copies up to one USB packet out with usb_fifo_take() and only
+ * commits the out pointer by however many bytes the endpoint actually
+ * accepted.  The caller therefore passes a local copy of the out
+ * pointer; on a short or refused write the ring simply re-offers the
+ * same bytes next time.
+ */
+
+static inline unsigned usb_fifo_take(const volatile uint8_t *fifo,
+                                     unsigned size, unsigned in,
+                                     unsigned *out,
+                                     uint8_t *packet, unsigned max)
+{
+	unsigned n = 0;
+	unsigned o = *out;
+
+	while ((in != o) && (n < max)) {
+		packet[n++] = fifo[o++];
+		if (o >= size)
+			o = 0;
+	}
+	*out = o;
+	return n;
+}
+
+#endif
@@ -32,6 +32,11 @@
 #include <setjmp.h>
 
 #define PLATFORM_HAS_TRACESWO
+/* Sequence loops come from common/swdptap.c and stm32/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
+/* Plenty of RAM on the F4, so offer GDB much larger packets */
+#define BUF_SIZE 16384
 #define BOARD_IDENT "Black Magic Probe (F4Discovery), (Firmware " FIRMWARE_VERSION ")"
 #define DFU_IDENT   "Black Magic Firmware Upgrade (F4Discovery)"
 
@@ -68,6 +73,8 @@
 #define SWCLK_PORT 	JTAG_PORT
 #define SWDIO_PIN	TMS_PIN
 #define SWCLK_PIN	TCK_PIN
+/* SWDIO and SWCLK share a port: enables the fused BSRR bit cell */
+#define SWD_PORT_SHARED
 
 #define TRST_PORT	GPIOC
 #define TRST_PIN	GPIO1
@@ -95,9 +102,19 @@
 	                GPIO_PUPD_NONE, SWDIO_PIN);
 
 
+/* Built with USB_HS=1 the GDB/UART/trace interfaces ride the OTG_HS
+ * core through an external ULPI PHY: 512-byte bulk endpoints instead
+ * of full speed's 64, which matters once flash loads are no longer
+ * SWD-bound.  Default build keeps the on-board OTG_FS connector. */
+#ifdef USB_HS
+#define USB_DRIVER      stm32f207_usb_driver
+#define USB_IRQ         NVIC_OTG_HS_IRQ
+#define USB_ISR         otg_hs_isr
+#else
 #define USB_DRIVER      stm32f107_usb_driver
 #define USB_IRQ         NVIC_OTG_FS_IRQ
 #define USB_ISR         otg_fs_isr
+#endif
 /* Interrupt priorities.  Low numbers are high priority.
  * For now USART1 preempts USB which may spin while buffer is drained.
  * TIM3 is used for traceswo capture and must be highest priority.
@@ -121,6 +138,16 @@
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
 #define USBUSART_TIM_ISR tim4_isr
 
+/* Hardware flow control for the UART bridge.  RTS is an ordinary GPIO
+ * driven from the receive ring watermarks (USART3's own RTS on PD12
+ * is taken by LED_UART); CTS uses the USART3_CTS alternate function
+ * on PD11 to gate the transmitter in hardware. */
+#define USBUSART_RTS_PORT GPIOD
+#define USBUSART_RTS_PIN  GPIO10
+#define USBUSART_CTS
+#define USBUSART_CTS_PORT GPIOD
+#define USBUSART_CTS_PIN  GPIO11
+
 #define UART_PIN_SETUP() do { \
 	gpio_mode_setup(USBUSART_TX_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE, \
 	                USBUSART_TX_PIN); \
@@ -128,6 +155,12 @@
 	                USBUSART_RX_PIN); \
 	gpio_set_af(USBUSART_TX_PORT, GPIO_AF7, USBUSART_TX_PIN); \
 	gpio_set_af(USBUSART_RX_PORT, GPIO_AF7, USBUSART_RX_PIN); \
+	gpio_mode_setup(USBUSART_RTS_PORT, GPIO_MODE_OUTPUT, \
+	                GPIO_PUPD_NONE, USBUSART_RTS_PIN); \
+	gpio_clear(USBUSART_RTS_PORT, USBUSART_RTS_PIN); \
+	gpio_mode_setup(USBUSART_CTS_PORT, GPIO_MODE_AF, GPIO_PUPD_UP, \
+	                USBUSART_CTS_PIN); \
+	gpio_set_af(USBUSART_CTS_PORT, GPIO_AF7, USBUSART_CTS_PIN); \
     } while(0)
 
 #define TRACE_TIM TIM3
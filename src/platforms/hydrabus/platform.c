@@ -46,7 +46,9 @@ void platform_init(void)
 		scb_reset_core();
 	}
 
-	rcc_clock_setup_hse_3v3(&hse_8mhz_3v3[CLOCK_3V3_48MHZ]);
+	/* Run the F405 at full speed; USB still gets its 48MHz from PLLQ.
+	 * The tap bit-bang loops scale directly with the core clock. */
+	rcc_clock_setup_hse_3v3(&hse_8mhz_3v3[CLOCK_3V3_168MHZ]);
 
 	/* Enable peripherals */
 	rcc_peripheral_enable_clock(&RCC_AHB2ENR, RCC_AHB2ENR_OTGFSEN);
@@ -59,8 +61,11 @@ void platform_init(void)
 		GPIO9 | GPIO11 | GPIO12);
 	gpio_set_af(GPIOA, GPIO_AF10, GPIO9 | GPIO11 | GPIO12);
 
-	GPIOC_OSPEEDR &=~0xF30;
-	GPIOC_OSPEEDR |= 0xA20;
+	/* The F4 pins default to 2MHz drive: take the tap pins to the
+	 * fastest slew rate or the edges cap the shift loops well below
+	 * what the core can toggle. */
+	gpio_set_output_options(JTAG_PORT, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+			TMS_PIN | TCK_PIN | TDI_PIN | TRST_PIN | SRST_PIN);
 	gpio_mode_setup(JTAG_PORT, GPIO_MODE_OUTPUT,
 			GPIO_PUPD_NONE,
 			TMS_PIN | TCK_PIN | TDI_PIN);
@@ -33,6 +33,17 @@
 #include <setjmp.h>
 
 #define PLATFORM_HAS_TRACESWO
+/* Sequence loops come from common/swdptap.c and stm32/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
+/* The 168MHz F405 runs the fused bit-bang loops about twice as fast
+ * as the native probe's F103, so correct the Hz-to-delay estimates */
+#define SWD_FREQ_UNTHROTTLED	8000000
+#define JTAG_FREQ_UNTHROTTLED	8000000
+/* Core clock for the SysTick reload, see platform_init() */
+#define AHB_FREQ_MHZ		168
+/* Plenty of RAM on the F4, so offer GDB much larger packets */
+#define BUF_SIZE 16384
 #define BOARD_IDENT       "Black Magic Probe (HydraBus), (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_DFU   "Black Magic (Upgrade) for HydraBus, (Firmware " FIRMWARE_VERSION ")"
 #define DFU_IDENT         "Black Magic Firmware Upgrade (HydraBus)"
@@ -70,6 +81,8 @@
 #define SWCLK_PORT 	JTAG_PORT
 #define SWDIO_PIN	TMS_PIN
 #define SWCLK_PIN	TCK_PIN
+/* SWDIO and SWCLK share a port: enables the fused BSRR bit cell */
+#define SWD_PORT_SHARED
 
 #define TRST_PORT	GPIOC
 #define TRST_PIN	GPIO5
@@ -113,6 +113,25 @@ void platform_delay(uint32_t ms)
 	while (!platform_timeout_is_expired(&timeout));
 }
 
+void platform_delay_us(uint32_t us)
+{
+	/* The reload value covers one SYSTICKMS period, so the tick rate
+	 * in ticks per microsecond falls out of it; the down-counter
+	 * provides the sub-tick resolution. */
+	uint32_t ticks_per_us = (systick_get_reload() + 1) /
+		(SYSTICKMS * 1000);
+	uint32_t total = us * ticks_per_us;
+	uint32_t last = systick_get_value();
+	uint32_t elapsed = 0;
+
+	while (elapsed < total) {
+		uint32_t now = systick_get_value();
+		elapsed += (last >= now) ? (last - now) :
+			(last + systick_get_reload() + 1 - now);
+		last = now;
+	}
+}
+
 const char *platform_target_voltage(void)
 {
 	return "not supported";
@@ -105,6 +105,8 @@ extern usbd_driver lm4f_usb_driver;
 #define SET_ERROR_STATE(state)	SET_IDLE_STATE(state)
 
 #define PLATFORM_HAS_TRACESWO
+/* Sequence loops come from tm4c/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
 
 inline static void gpio_set_val(uint32_t port, uint8_t pin, uint8_t val) {
 	gpio_write(port, pin, val == 0 ? 0 : 0xff);
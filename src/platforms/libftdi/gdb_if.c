@@ -39,9 +39,12 @@
 
 #include "general.h"
 #include "gdb_if.h"
+#include "gdb_packet.h"
 
 static int gdb_if_serv, gdb_if_conn;
 
+int gdb_if_tcp_port = 2000;
+
 int gdb_if_init(void)
 {
 #ifdef WIN32
@@ -52,22 +55,62 @@ int gdb_if_init(void)
 	int opt;
 
 	addr.sin_family = AF_INET;
-	addr.sin_port = htons(2000);
+	addr.sin_port = htons(gdb_if_tcp_port);
 	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
 	assert((gdb_if_serv = socket(PF_INET, SOCK_STREAM, 0)) != -1);
 	opt = 1;
 	assert(setsockopt(gdb_if_serv, SOL_SOCKET, SO_REUSEADDR, (void*)&opt, sizeof(opt)) != -1);
-	assert(setsockopt(gdb_if_serv, IPPROTO_TCP, TCP_NODELAY, (void*)&opt, sizeof(opt)) != -1);
 
 	assert(bind(gdb_if_serv, (void*)&addr, sizeof(addr)) != -1);
-	assert(listen(gdb_if_serv, 1) != -1);
+	assert(listen(gdb_if_serv, 5) != -1);
 
-	DEBUG("Listening on TCP:2000\n");
+	DEBUG("Listening on TCP:%d\n", gdb_if_tcp_port);
 
 	return 0;
 }
 
+static int gdb_if_accept(void)
+{
+	int conn = accept(gdb_if_serv, NULL, NULL);
+	int opt = 1;
+
+	if (conn < 0)
+		return conn;
+
+	/* NODELAY must be set on the accepted socket; inheriting it from
+	 * the listener is a Linux quirk that can't be relied on.  Without
+	 * it every small reply sits in Nagle against the host's delayed
+	 * ACK, which adds up badly over a stepping session. */
+	assert(setsockopt(conn, IPPROTO_TCP, TCP_NODELAY,
+	                  (void*)&opt, sizeof(opt)) != -1);
+
+	/* The session state in gdb_main -- scan results and attached
+	 * targets -- deliberately survives a dropped connection so that a
+	 * reconnecting client doesn't pay for rediscovery, but the no-ack
+	 * negotiation does not: a fresh client always starts with acks. */
+	gdb_set_noackmode(false);
+	DEBUG("Got connection\n");
+
+	return conn;
+}
+
+int gdb_if_read(void *buf, int maxlen)
+{
+	int i = 0;
+
+	while(i <= 0) {
+		if(gdb_if_conn <= 0)
+			gdb_if_conn = gdb_if_accept();
+		i = recv(gdb_if_conn, buf, maxlen, 0);
+		if(i <= 0) {
+			gdb_if_conn = -1;
+			DEBUG("Dropped broken connection\n");
+			return -1;
+		}
+	}
+	return i;
+}
 
 unsigned char gdb_if_getchar(void)
 {
@@ -75,10 +118,8 @@ unsigned char gdb_if_getchar(void)
 	int i = 0;
 
 	while(i <= 0) {
-		if(gdb_if_conn <= 0) {
-			gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
-			DEBUG("Got connection\n");
-		}
+		if(gdb_if_conn <= 0)
+			gdb_if_conn = gdb_if_accept();
 		i = recv(gdb_if_conn, (void*)&ret, 1, 0);
 		if(i <= 0) {
 			gdb_if_conn = -1;
@@ -115,8 +156,21 @@ void gdb_if_putchar(unsigned char c, int flush)
 	static int bufsize = 0;
 	if (gdb_if_conn > 0) {
 		buf[bufsize++] = c;
-		if (flush || (bufsize == sizeof(buf))) {
-			send(gdb_if_conn, buf, bufsize, 0);
+		if (flush || (bufsize == (int)sizeof(buf))) {
+			/* The whole reply including checksum is already
+			 * contiguous here, so it goes out in one call; just
+			 * mind short writes on large memory dumps. */
+			int sent = 0;
+			while (sent < bufsize) {
+				int i = send(gdb_if_conn, (void*)(buf + sent),
+				             bufsize - sent, 0);
+				if (i <= 0) {
+					gdb_if_conn = -1;
+					DEBUG("Dropped broken connection\n");
+					break;
+				}
+				sent += i;
+			}
 			bufsize = 0;
 		}
 	}
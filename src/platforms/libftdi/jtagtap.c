@@ -101,8 +101,8 @@ jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
 
 	if(ticks) {
 		tmp[index++] = 0x19;
-		tmp[index++] = ticks - 1;
-		tmp[index++] = 0;
+		tmp[index++] = (ticks - 1) & 0xFF;
+		tmp[index++] = (ticks - 1) >> 8;
 		while(ticks--) tmp[index++] = *DI++;
 	}
 
@@ -139,9 +139,11 @@ jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms, const uint8_t *DI, int
 	tmp = alloca(ticks + 9);
 	rsize = ticks;
 	if(ticks) {
+		/* MPSSE takes a 16-bit length here, so a scan of up to
+		 * 64KB is a single command */
 		tmp[index++] = 0x39;
-		tmp[index++] = ticks - 1;
-		tmp[index++] = 0;
+		tmp[index++] = (ticks - 1) & 0xFF;
+		tmp[index++] = (ticks - 1) >> 8;
 		while(ticks--) tmp[index++] = *DI++;
 	}
 
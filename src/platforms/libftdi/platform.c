@@ -28,8 +28,14 @@
 struct ftdi_context *ftdic;
 
 #define BUF_SIZE 4096
-static uint8_t outbuf[BUF_SIZE];
+/* Command accumulation is double-buffered: one buffer can be in flight
+ * on the USB side while the next batch of commands is built up in the
+ * other, so command generation overlaps bus latency. */
+static uint8_t outbuf[2][BUF_SIZE];
+static int outbuf_act = 0;
 static uint16_t bufptr = 0;
+static struct ftdi_transfer_control *write_tc;
+static uint16_t write_tc_size;
 
 static struct cable_desc_s {
 	int vendor;
@@ -140,7 +146,7 @@ void platform_init(int argc, char **argv)
 	uint8_t ftdi_init[9] = {TCK_DIVISOR, 0x01, 0x00, SET_BITS_LOW, 0,0,
 				SET_BITS_HIGH, 0,0};
 
-	while((c = getopt(argc, argv, "c:s:")) != -1) {
+	while((c = getopt(argc, argv, "c:s:p:")) != -1) {
 		switch(c) {
 		case 'c':
 			cablename =  optarg;
@@ -148,6 +154,11 @@ void platform_init(int argc, char **argv)
 		case 's':
 			serial = optarg;
 			break;
+		case 'p':
+			/* One server per probe: pick a distinct port for
+			 * each instance when driving several cables */
+			gdb_if_tcp_port = atoi(optarg);
+			break;
 		}
 	}
 
@@ -239,15 +250,28 @@ bool platform_srst_get_val(void) { return false; }
 
 void platform_buffer_flush(void)
 {
-	assert(ftdi_write_data(ftdic, outbuf, bufptr) == bufptr);
+	if (!bufptr)
+		return;
+
+	/* Reap the transfer still in flight before its buffer is reused;
+	 * submission returns as soon as libusb has the transfer, so the
+	 * next batch of commands builds while this one drains. */
+	if (write_tc) {
+		assert(ftdi_transfer_data_done(write_tc) == write_tc_size);
+		write_tc = NULL;
+	}
+	write_tc = ftdi_write_data_submit(ftdic, outbuf[outbuf_act], bufptr);
+	assert(write_tc != NULL);
+	write_tc_size = bufptr;
 //	printf("FT2232 platform_buffer flush: %d bytes\n", bufptr);
+	outbuf_act ^= 1;
 	bufptr = 0;
 }
 
 int platform_buffer_write(const uint8_t *data, int size)
 {
 	if((bufptr + size) / BUF_SIZE > 0) platform_buffer_flush();
-	memcpy(outbuf + bufptr, data, size);
+	memcpy(outbuf[outbuf_act] + bufptr, data, size);
 	bufptr += size;
 	return size;
 }
@@ -255,6 +279,11 @@ int platform_buffer_write(const uint8_t *data, int size)
 int platform_buffer_read(uint8_t *data, int size)
 {
 	int index = 0;
+	uint8_t send_immediate = SEND_IMMEDIATE;
+
+	/* Ask the chip to return what it has right away, so the read
+	 * doesn't sit out the latency timer waiting for a full packet */
+	platform_buffer_write(&send_immediate, 1);
 	platform_buffer_flush();
 	while((index += ftdi_read_data(ftdic, data + index, size-index)) != size);
 	return size;
@@ -284,6 +313,24 @@ void platform_delay(uint32_t ms)
 	usleep(ms * 1000);
 }
 
+void platform_delay_us(uint32_t us)
+{
+	struct timeval now, end, delta = {0, us};
+
+	if (us >= 1000) {
+		usleep(us);
+		return;
+	}
+
+	/* Sleeping for less than a scheduling quantum oversleeps by an
+	 * order of magnitude; busy-wait the sub-millisecond delays */
+	gettimeofday(&now, NULL);
+	timeradd(&now, &delta, &end);
+	do {
+		gettimeofday(&now, NULL);
+	} while (timercmp(&now, &end, <));
+}
+
 uint32_t platform_time_ms(void)
 {
 	struct timeval tv;
@@ -37,6 +37,15 @@
 #define FT2232_PID	0x6010
 
 #define PLATFORM_HAS_DEBUG
+/* MPSSE drives whole SWD sequences natively; JTAG still goes
+ * per-bit through the generics */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+
+/* The GDB socket wait is select()-driven, so a Ctrl-C wakes the loop
+ * the moment it arrives; with the hosted wire cheap to poll, a low
+ * ceiling on the halt-poll interval keeps breakpoint reaction inside
+ * single-digit milliseconds too. */
+#define GDB_HALT_POLL_MAX_MS 1
 
 #define SET_RUN_STATE(state)
 #define SET_IDLE_STATE(state)
@@ -44,6 +53,9 @@
 
 extern struct ftdi_context *ftdic;
 
+/* TCP port the GDB server listens on; set before gdb_if_init() */
+extern int gdb_if_tcp_port;
+
 void platform_buffer_flush(void);
 int platform_buffer_write(const uint8_t *data, int size);
 int platform_buffer_read(uint8_t *data, int size);
@@ -18,8 +18,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Quick hack for bit-banging SW-DP interface over FT2232.
- * Intended as proof of concept, not for production.
+/* SW-DP interface over FT2232 using MPSSE.
+ *
+ * SWDIO is on the TMS pin, as wired for the old bit-bang hack, so
+ * output sequences go out as TMS shift commands (7 bits per command)
+ * and input sequences sample the pin with GET_BITS_LOW between queued
+ * clock pulses.  Either way a whole sequence is one USB write (plus
+ * one read for inputs) instead of a round-trip per bit.
  */
 
 #include <stdio.h>
@@ -29,21 +34,24 @@
 #include "general.h"
 #include "swdptap.h"
 
+#define SWDIO_BIT	0x08
+
+/* Idle bus state, matching the cable descriptions in platform.c */
+#define DBUS_DATA	0xA0
+#define DBUS_DDR_OUT	0xAB
+#define DBUS_DDR_IN	0xA3
+
 static uint8_t olddir = 0;
 
 int swdptap_init(void)
 {
-	int err;
+	/* The device is already in MPSSE mode from platform_init();
+	 * just drive the bus to the idle state. */
+	uint8_t cmd[3] = {SET_BITS_LOW, DBUS_DATA, DBUS_DDR_OUT};
 
 	assert(ftdic != NULL);
 
-	if((err = ftdi_set_bitmode(ftdic, 0xAB, BITMODE_BITBANG)) != 0) {
-		fprintf(stderr, "ftdi_set_bitmode: %d: %s\n",
-			err, ftdi_get_error_string(ftdic));
-		abort();
-	}
-
-	assert(ftdi_write_data(ftdic, (void*)"\xAB\xA8", 2) == 2);
+	platform_buffer_write(cmd, 3);
 	olddir = 0;
 
 	return 0;
@@ -51,45 +59,112 @@ int swdptap_init(void)
 
 static void swdptap_turnaround(uint8_t dir)
 {
-	platform_buffer_flush();
+	uint8_t cmd[6];
+	int index = 0;
 
 	if (dir == olddir)
 		return;
 	olddir = dir;
 
-	if(dir)	/* SWDIO goes to input */
-		assert(ftdi_set_bitmode(ftdic, 0xA3, BITMODE_BITBANG) == 0);
+	if(dir) { /* SWDIO goes to input */
+		cmd[index++] = SET_BITS_LOW;
+		cmd[index++] = DBUS_DATA;
+		cmd[index++] = DBUS_DDR_IN;
+	}
 
 	/* One clock cycle */
-	ftdi_write_data(ftdic, (void *)"\xAB\xA8", 2);
+	cmd[index++] = 0x4B;
+	cmd[index++] = 0;
+	cmd[index++] = 0;
+
+	if(!dir) { /* SWDIO goes to output */
+		cmd[index++] = SET_BITS_LOW;
+		cmd[index++] = DBUS_DATA;
+		cmd[index++] = DBUS_DDR_OUT;
+	}
 
-	if(!dir) /* SWDIO goes to output */
-		assert(ftdi_set_bitmode(ftdic, 0xAB, BITMODE_BITBANG) == 0);
+	platform_buffer_write(cmd, index);
 }
 
-bool swdptap_bit_in(void)
+/* Queue a pin sample plus one clock pulse per tick, then collect all
+ * the samples in a single read. */
+static void swdptap_sample(uint8_t *pins, int ticks)
 {
-	uint8_t ret;
+	uint8_t cmd[4] = {GET_BITS_LOW, 0x4B, 0, 0};
 
 	swdptap_turnaround(1);
 
-	ftdi_read_pins(ftdic, &ret);
-	ret &= 0x08;
-	ftdi_write_data(ftdic, (void *)"\xA1\xA0", 2);
+	for (int i = 0; i < ticks; i++)
+		platform_buffer_write(cmd, 4);
+	platform_buffer_read(pins, ticks);
+}
+
+uint32_t swdptap_seq_in(int ticks)
+{
+	uint8_t pins[32];
+	uint32_t ret = 0;
+
+	swdptap_sample(pins, ticks);
+	for (int i = 0; i < ticks; i++)
+		if (pins[i] & SWDIO_BIT)
+			ret |= (1 << i);
 
 	return ret;
 }
 
-void swdptap_bit_out(bool val)
+bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
 {
-	uint8_t buf[3] = "\xA0\xA1\xA0";
+	uint8_t pins[33];
+	uint8_t parity = 0;
+
+	*ret = 0;
+	swdptap_sample(pins, ticks + 1);
+	for (int i = 0; i < ticks; i++)
+		if (pins[i] & SWDIO_BIT) {
+			*ret |= (1 << i);
+			parity ^= 1;
+		}
+	if (pins[ticks] & SWDIO_BIT)
+		parity ^= 1;
+
+	return parity;
+}
+
+void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	uint8_t cmd[3];
 
 	swdptap_turnaround(0);
 
-	if (val) {
-		for(int i = 0; i < 3; i++)
-			buf[i] |= 0x08;
+	/* TMS shift commands take up to 7 bits each; the data byte's top
+	 * bit is the static TDI level, so only 7 are usable. */
+	while (ticks) {
+		int n = (ticks > 7) ? 7 : ticks;
+		cmd[0] = 0x4B;
+		cmd[1] = n - 1;
+		cmd[2] = MS & 0x7F;
+		platform_buffer_write(cmd, 3);
+		MS >>= n;
+		ticks -= n;
 	}
-	platform_buffer_write(buf, 3);
 }
 
+void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	uint8_t parity = 0;
+
+	for (uint32_t tmp = MS; tmp; tmp >>= 1)
+		parity ^= tmp & 1;
+	swdptap_seq_out(MS, ticks);
+	swdptap_seq_out(parity, 1);
+}
+
+bool swdptap_bit_in(void)
+{
+	return swdptap_seq_in(1) & 1;
+}
+
+void swdptap_bit_out(bool val)
+{
+	swdptap_seq_out(val, 1);
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Ring-buffered wire event logger, see include/wirelog.h.  The hosted
+ * probe is single threaded (the task layer is cooperative), so being
+ * free of locks only requires that emitting is a few plain stores;
+ * formatting and file I/O happen in wirelog_flush(), after whatever
+ * was being diagnosed has already run at full speed. */
+
+#include "general.h"
+#include "wirelog.h"
+
+#include <sys/time.h>
+
+/* Records kept; power of two.  One megabyte of ring holds the last
+ * 64k transactions, plenty of context around a WAIT storm. */
+#ifndef WIRELOG_RING
+#define WIRELOG_RING 65536
+#endif
+
+struct wirelog_record {
+	uint32_t seq;
+	uint32_t us;		/* since the first record */
+	uint8_t event;
+	uint8_t a;
+	uint16_t b;
+	uint32_t c;
+};
+
+static struct wirelog_record ring[WIRELOG_RING];
+static uint32_t wr_seq;
+static uint32_t wr_flushed;
+
+static uint32_t wirelog_us(void)
+{
+	static struct timeval t0;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	if (!t0.tv_sec)
+		t0 = tv;
+	return (tv.tv_sec - t0.tv_sec) * 1000000 +
+		(tv.tv_usec - t0.tv_usec);
+}
+
+void wirelog_emit(uint8_t event, uint8_t a, uint16_t b, uint32_t c)
+{
+	if (wr_seq == 0) {
+		wirelog_us();	/* pin the timestamp origin */
+		atexit(wirelog_flush);
+	}
+
+	struct wirelog_record *r = &ring[wr_seq & (WIRELOG_RING - 1)];
+	r->seq = wr_seq++;
+	r->us = wirelog_us();
+	r->event = event;
+	r->a = a;
+	r->b = b;
+	r->c = c;
+}
+
+void wirelog_flush(void)
+{
+	static FILE *f;
+
+	if (wr_seq == wr_flushed)
+		return;
+	if (!f) {
+		const char *path = getenv("BMP_WIRELOG");
+		f = fopen(path ? path : "wirelog.bin", "wb");
+		if (!f)
+			return;
+	}
+	/* Anything older than one ring's worth has been overwritten */
+	if (wr_seq - wr_flushed > WIRELOG_RING)
+		wr_flushed = wr_seq - WIRELOG_RING;
+	while (wr_flushed != wr_seq) {
+		fwrite(&ring[wr_flushed & (WIRELOG_RING - 1)],
+		       sizeof(struct wirelog_record), 1, f);
+		wr_flushed++;
+	}
+	fflush(f);
+}
@@ -153,9 +153,10 @@ void platform_init(void)
 		              GPIO_CNF_OUTPUT_OPENDRAIN, PWR_BR_PIN);
 	}
 
-	if (platform_hwversion() > 0) {
-		adc_init();
-	} else {
+	/* The ADC is only needed for target voltage readout, so its
+	 * power-up and calibration run lazily on first use instead of
+	 * holding up the boot path; see platform_target_voltage(). */
+	if (platform_hwversion() == 0) {
 		gpio_clear(GPIOB, GPIO0);
 		gpio_set_mode(GPIOB, GPIO_MODE_INPUT,
 				GPIO_CNF_INPUT_PULL_UPDOWN, GPIO0);
@@ -217,6 +218,12 @@ void platform_target_set_power(bool power)
 
 static void adc_init(void)
 {
+	static bool initialised = false;
+
+	if (initialised)
+		return;
+	initialised = true;
+
 	rcc_periph_clock_enable(RCC_ADC1);
 
 	gpio_set_mode(GPIOB, GPIO_MODE_INPUT,
@@ -231,8 +238,9 @@ static void adc_init(void)
 
 	adc_power_on(ADC1);
 
-	/* Wait for ADC starting up. */
-	for (int i = 0; i < 800000; i++)    /* Wait a bit. */
+	/* Wait out the ADC stabilisation time; tSTAB is 1us, so a few
+	 * hundred cycles are already generous. */
+	for (int i = 0; i < 100; i++)
 		__asm__("nop");
 
 	adc_reset_calibration(ADC1);
@@ -244,6 +252,8 @@ const char *platform_target_voltage(void)
 	if (platform_hwversion() == 0)
 		return gpio_get(GPIOB, GPIO0) ? "OK" : "ABSENT!";
 
+	adc_init();
+
 	static char ret[] = "0.0V";
 	const uint8_t channel = 8;
 	adc_set_regular_sequence(ADC1, 1, (uint8_t*)&channel);
@@ -30,6 +30,12 @@
 
 #define PLATFORM_HAS_TRACESWO
 #define PLATFORM_HAS_POWER_SWITCH
+/* Sequence loops come from common/swdptap.c and stm32/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
+/* Vendor bulk interface carrying the GDB stream without the host tty
+ * layer; the F1 USB core has a spare endpoint pair for it */
+#define PLATFORM_HAS_GDB_RAW
 #ifdef ENABLE_DEBUG
 #define PLATFORM_HAS_DEBUG
 #define USBUART_DEBUG
@@ -82,6 +88,8 @@
 #define SWDIO_DIR_PIN	TMS_DIR_PIN
 #define SWDIO_PIN	TMS_PIN
 #define SWCLK_PIN	TCK_PIN
+/* SWDIO and SWCLK share a port: enables the fused BSRR bit cell */
+#define SWD_PORT_SHARED
 
 #define TRST_PORT	GPIOB
 #define TRST_PIN	GPIO1
@@ -152,11 +160,24 @@
 #define USBUSART_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM4)
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
 #define USBUSART_TIM_ISR tim4_isr
+/* USART1: TX on DMA1 channel 4, RX on channel 5 */
+#define USBUSART_DMA DMA1
+#define USBUSART_DMA_CLK_EN() rcc_periph_clock_enable(RCC_DMA1)
+#define USBUSART_DMA_RX_CHAN DMA_CHANNEL5
+#define USBUSART_DMA_TX_CHAN DMA_CHANNEL4
+#define USBUSART_DMA_TX_IRQ NVIC_DMA1_CHANNEL4_IRQ
+#define USBUSART_DMA_TX_ISR dma1_channel4_isr
 
 #define TRACE_TIM TIM3
 #define TRACE_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM3)
 #define TRACE_IRQ   NVIC_TIM3_IRQ
 #define TRACE_ISR   tim3_isr
+/* TIM3_CH1 capture bursts land via DMA1 channel 6 */
+#define TRACE_DMA   DMA1
+#define TRACE_DMA_CLK_EN() rcc_periph_clock_enable(RCC_DMA1)
+#define TRACE_DMA_CHAN DMA_CHANNEL6
+#define TRACE_DMA_IRQ  NVIC_DMA1_CHANNEL6_IRQ
+#define TRACE_DMA_ISR  dma1_channel6_isr
 
 #ifdef ENABLE_DEBUG
 extern bool debug_bmp;
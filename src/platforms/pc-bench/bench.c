@@ -0,0 +1,141 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Protocol-layer benchmark harness, built with PROBE_HOST=pc-bench.
+ * Runs the GDB packet framing, hex conversion and CRC hot paths
+ * against a loopback transport and simulated target memory, so a
+ * regression in any of them shows up in CI without probe hardware. */
+
+#include "general.h"
+#include "gdb_if.h"
+#include "gdb_packet.h"
+#include "hex_utils.h"
+#include "target.h"
+#include "crc32.h"
+#include "stats.h"
+#include "bench.h"
+
+#include <time.h>
+
+/* Referenced by gdb_packet.c */
+struct wire_stats wire_stats;
+
+#define PAYLOAD_SIZE	1024
+#define HEX_BUF_SIZE	(256 * 1024)
+
+static char pbuf[2 * PAYLOAD_SIZE + 64];
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_getpacket(void)
+{
+	static char stream[PAYLOAD_SIZE + 8];
+	uint8_t csum = 0;
+	int i = 0;
+
+	stream[i++] = '$';
+	for (int j = 0; j < PAYLOAD_SIZE; j++) {
+		stream[i++] = 'A';
+		csum += 'A';
+	}
+	i += sprintf(&stream[i], "#%02x", csum);
+	gdb_if_loopback_load(stream, i);
+
+	const int iters = 100000;
+	double t0 = now_s();
+	for (int j = 0; j < iters; j++)
+		gdb_getpacket(pbuf, sizeof(pbuf));
+	double dt = now_s() - t0;
+
+	printf("gdb_getpacket: %8.0f packets/s  %7.1f MB/s "
+	       "(%d byte payload)\n",
+	       iters / dt, iters * (double)PAYLOAD_SIZE / dt / 1e6,
+	       PAYLOAD_SIZE);
+}
+
+static void bench_putpacket(void)
+{
+	static const char acks[] = "+";
+	static char payload[PAYLOAD_SIZE];
+
+	memset(payload, 'A', sizeof(payload));
+	/* Every transmitted packet waits for one ack byte */
+	gdb_if_loopback_load(acks, sizeof(acks) - 1);
+
+	const int iters = 100000;
+	double t0 = now_s();
+	for (int j = 0; j < iters; j++)
+		gdb_putpacket(payload, sizeof(payload));
+	double dt = now_s() - t0;
+
+	printf("gdb_putpacket: %8.0f packets/s  %7.1f MB/s "
+	       "(%d byte payload)\n",
+	       iters / dt, iters * (double)PAYLOAD_SIZE / dt / 1e6,
+	       PAYLOAD_SIZE);
+}
+
+static void bench_hex(void)
+{
+	static uint8_t bin[HEX_BUF_SIZE];
+	static char hex[2 * HEX_BUF_SIZE + 1];
+
+	for (size_t j = 0; j < sizeof(bin); j++)
+		bin[j] = j * 7;
+
+	const int iters = 100;
+	double t0 = now_s();
+	for (int j = 0; j < iters; j++)
+		hexify(hex, bin, sizeof(bin));
+	double dt = now_s() - t0;
+	printf("hexify:        %7.1f MB/s\n",
+	       iters * (double)HEX_BUF_SIZE / dt / 1e6);
+
+	t0 = now_s();
+	for (int j = 0; j < iters; j++)
+		unhexify(bin, hex, sizeof(bin));
+	dt = now_s() - t0;
+	printf("unhexify:      %7.1f MB/s\n",
+	       iters * (double)HEX_BUF_SIZE / dt / 1e6);
+}
+
+static void bench_crc(void)
+{
+	const int iters = 20;
+	double t0 = now_s();
+	for (int j = 0; j < iters; j++)
+		generic_crc32(NULL, 0, BENCH_MEM_SIZE);
+	double dt = now_s() - t0;
+	printf("crc32:         %7.1f MB/s\n",
+	       iters * (double)BENCH_MEM_SIZE / dt / 1e6);
+}
+
+int main(void)
+{
+	gdb_if_init();
+	bench_getpacket();
+	bench_putpacket();
+	bench_hex();
+	bench_crc();
+	return 0;
+}
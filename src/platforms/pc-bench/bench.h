@@ -0,0 +1,32 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+/* Loopback transport control, implemented by the pc-bench gdb_if.c.
+ * Reads replay the loaded stream, wrapping forever; writes are counted
+ * and discarded. */
+void gdb_if_loopback_load(const void *data, size_t len);
+uint64_t gdb_if_loopback_tx_bytes(void);
+
+/* Simulated target memory backing the CRC benchmark */
+#define BENCH_MEM_SIZE (1024 * 1024)
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Loopback GDB transport for the benchmark harness.  The bench loads a
+ * byte stream which reads replay endlessly, so packet reception can be
+ * timed with no I/O in the loop; transmitted bytes are counted and
+ * dropped. */
+
+#include "general.h"
+#include "gdb_if.h"
+#include "bench.h"
+
+static const uint8_t *loop_data;
+static size_t loop_len;
+static size_t loop_pos;
+static uint64_t tx_bytes;
+
+void gdb_if_loopback_load(const void *data, size_t len)
+{
+	loop_data = data;
+	loop_len = len;
+	loop_pos = 0;
+}
+
+uint64_t gdb_if_loopback_tx_bytes(void)
+{
+	return tx_bytes;
+}
+
+int gdb_if_init(void)
+{
+	return 0;
+}
+
+int gdb_if_read(void *buf, int maxlen)
+{
+	int n = loop_len - loop_pos;
+	if (n > maxlen)
+		n = maxlen;
+	memcpy(buf, loop_data + loop_pos, n);
+	loop_pos += n;
+	if (loop_pos == loop_len)
+		loop_pos = 0;
+	return n;
+}
+
+unsigned char gdb_if_getchar(void)
+{
+	unsigned char c = loop_data[loop_pos++];
+	if (loop_pos == loop_len)
+		loop_pos = 0;
+	return c;
+}
+
+unsigned char gdb_if_getchar_to(int timeout)
+{
+	(void)timeout;
+	return gdb_if_getchar();
+}
+
+void gdb_if_putchar(unsigned char c, int flush)
+{
+	(void)c;
+	(void)flush;
+	tx_bytes++;
+}
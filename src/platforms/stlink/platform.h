@@ -33,6 +33,12 @@
 #include <libopencm3/stm32/f1/memorymap.h>
 #include <libopencm3/usb/usbd.h>
 
+/* Sequence loops come from common/swdptap.c and stm32/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
+
+#define PLATFORM_HAS_TRACESWO
+
 #define BOARD_IDENT       "Black Magic Probe (STLINK), (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_DFU   "Black Magic (Upgrade) for STLink/Discovery, (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_UPD   "Black Magic (DFU Upgrade) for STLink/Discovery, (Firmware " FIRMWARE_VERSION ")"
@@ -88,7 +94,7 @@
 #define IRQ_PRI_USBUSART	(1 << 4)
 #define IRQ_PRI_USBUSART_TIM	(3 << 4)
 #define IRQ_PRI_USB_VBUS	(14 << 4)
-#define IRQ_PRI_TIM3		(0 << 4)
+#define IRQ_PRI_TRACE		(0 << 4)
 
 #define USBUSART USART2
 #define USBUSART_CR1 USART2_CR1
@@ -101,6 +107,21 @@
 #define USBUSART_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM4)
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
 #define USBUSART_TIM_ISR tim4_isr
+/* USART2: TX on DMA1 channel 7, RX on channel 6 */
+#define USBUSART_DMA DMA1
+#define USBUSART_DMA_CLK_EN() rcc_periph_clock_enable(RCC_DMA1)
+#define USBUSART_DMA_RX_CHAN DMA_CHANNEL6
+#define USBUSART_DMA_TX_CHAN DMA_CHANNEL7
+#define USBUSART_DMA_TX_IRQ NVIC_DMA1_CHANNEL7_IRQ
+#define USBUSART_DMA_TX_ISR dma1_channel7_isr
+
+#define TRACE_TIM TIM3
+#define TRACE_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM3)
+#define TRACE_IRQ   NVIC_TIM3_IRQ
+#define TRACE_ISR   tim3_isr
+/* No TRACE_DMA: the TIM3_CH1 capture request shares DMA1 channel 6 with
+ * USART2 RX, which the USB-UART owns, so capture runs from the CC1
+ * interrupt. */
 
 #define DEBUG(...)
 
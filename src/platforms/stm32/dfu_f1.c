@@ -35,11 +35,24 @@
 
 static uint32_t last_erased_page = 0xffffffff;
 
+/* A page that still reads all ones doesn't need erasing again.  The
+ * scan is microseconds against tens of milliseconds for the erase, and
+ * most upgrade images land on pages blanked by the previous upgrade.
+ */
+static bool flash_is_blank(uint32_t addr, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i += 4)
+		if (*(volatile uint32_t*)(addr + i) != 0xffffffff)
+			return false;
+	return true;
+}
+
 void dfu_check_and_do_sector_erase(uint32_t sector)
 {
 	sector &= (~(FLASHBLOCKSIZE - 1));
 	if (sector != last_erased_page) {
-		flash_erase_page(sector);
+		if (!flash_is_blank(sector, FLASHBLOCKSIZE))
+			flash_erase_page(sector);
 		last_erased_page = sector;
 	}
 }
@@ -56,10 +69,20 @@ void dfu_flash_program_buffer(uint32_t baseaddr, void *buf, int len)
 
 uint32_t dfu_poll_timeout(uint8_t cmd, uint32_t addr, uint16_t blocknum)
 {
-	(void)cmd;
-	(void)addr;
-	(void)blocknum;
-	return 100;
+	/* Report how long each operation will actually take instead of a
+	 * flat worst case; the host sleeps this long before polling again,
+	 * so this is pure dead time on the wire.
+	 */
+	if ((blocknum == 0) && (cmd == CMD_ERASE)) {
+		addr &= (~(FLASHBLOCKSIZE - 1));
+		if ((addr == last_erased_page) ||
+		    flash_is_blank(addr, FLASHBLOCKSIZE))
+			return 1;
+		/* Page erase: 20 ms typical, 40 ms max (PM0075) */
+		return 40;
+	}
+	/* Half word programming: 52.5 us max each */
+	return (dfu_function.wTransferSize * 53) / 2000 + 1;
 }
 
 void dfu_protect(dfu_mode_t mode)
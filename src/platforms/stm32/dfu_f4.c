@@ -53,9 +53,25 @@ static void get_sector_num(uint32_t addr)
 	sector_num = i;
 }
 
+/* A sector that still reads all ones doesn't need erasing again.  Even
+ * a 128 kiB scan takes about a millisecond against seconds for the
+ * erase, and most upgrade images land on sectors blanked by the
+ * previous upgrade.
+ */
+static bool flash_is_blank(uint32_t addr, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i += 4)
+		if (*(volatile uint32_t*)(addr + i) != 0xffffffff)
+			return false;
+	return true;
+}
+
 void dfu_check_and_do_sector_erase(uint32_t addr)
 {
 	if(addr == sector_addr[sector_num]) {
+		if (sector_addr[sector_num + 1] &&
+		    flash_is_blank(addr, sector_addr[sector_num + 1] - addr))
+			return;
 		flash_erase_sector((sector_num & 0x1f)<<3, FLASH_PROGRAM_X32);
 	}
 }
@@ -73,12 +89,17 @@ uint32_t dfu_poll_timeout(uint8_t cmd, uint32_t addr, uint16_t blocknum)
 	   Try not to hit USB timeouts*/
 	if ((blocknum == 0) && (cmd == CMD_ERASE)) {
 		get_sector_num(addr);
-		if(addr == sector_addr[sector_num])
+		if(addr == sector_addr[sector_num]) {
+			if (sector_addr[sector_num + 1] &&
+			    flash_is_blank(addr,
+					sector_addr[sector_num + 1] - addr))
+				return 1;
 			return sector_erase_time[sector_num];
+		}
 	}
 
-	/* Programming 256 word with 100 us(max) per word*/
-	return 26;
+	/* Programming with 100 us(max) per word*/
+	return (dfu_function.wTransferSize * 26) / 1024 + 1;
 }
 
 void dfu_protect_enable(void)
@@ -34,8 +34,23 @@
 #include "usbdfu.h"
 
 usbd_device *usbdev;
+
+/* DFU download data arrives in control transfers, so the transfer size is
+ * bounded by the staging buffers below and the buffers by available RAM:
+ * two copies are held (control buffer plus the pending program block).
+ * Bigger transfers mean fewer erase/status round trips per image.
+ */
+#ifndef DFU_TRANSFER_SIZE
+#	if defined(STM32F1)
+		/* F103 parts have 20 kiB RAM */
+#		define DFU_TRANSFER_SIZE 2048
+#	else
+#		define DFU_TRANSFER_SIZE 4096
+#	endif
+#endif
+
 /* We need a special large control buffer for this device: */
-uint8_t usbd_control_buffer[1024];
+uint8_t usbd_control_buffer[DFU_TRANSFER_SIZE];
 
 static uint32_t max_address;
 
@@ -73,7 +88,7 @@ const struct usb_dfu_descriptor dfu_function = {
 	.bDescriptorType = DFU_FUNCTIONAL,
 	.bmAttributes = USB_DFU_CAN_DOWNLOAD | USB_DFU_CAN_UPLOAD | USB_DFU_WILL_DETACH,
 	.wDetachTimeout = 255,
-	.wTransferSize = 1024,
+	.wTransferSize = DFU_TRANSFER_SIZE,
 	.bcdDFUVersion = 0x011A,
 };
 
@@ -25,16 +25,86 @@
 #include "general.h"
 #include "cdcacm.h"
 #include "gdb_if.h"
+#include "profile.h"
+#include "tasks.h"
+
+/* The raw vendor-bulk interface (PLATFORM_HAS_GDB_RAW) carries the
+ * same byte stream as the CDC-ACM channel; whichever interface data
+ * last arrived on owns the session and receives the replies.  The
+ * raw path has no DTR, so the port-closed checks only apply while
+ * CDC-ACM owns the stream. */
+#ifdef PLATFORM_HAS_GDB_RAW
+static volatile bool gdb_raw_active;
+#define GDB_TX_ENDPOINT \
+	(gdb_raw_active ? CDCACM_GDB_RAW_ENDPOINT : CDCACM_GDB_ENDPOINT)
+#else
+#define gdb_raw_active	false
+#define GDB_TX_ENDPOINT	CDCACM_GDB_ENDPOINT
+#endif
 
-static uint32_t count_out;
 static uint32_t count_in;
-static uint32_t out_ptr;
-static uint8_t buffer_out[CDCACM_PACKET_SIZE];
 static uint8_t buffer_in[CDCACM_PACKET_SIZE];
-#ifdef STM32F4
-static volatile uint32_t count_new;
-static uint8_t double_buffer_out[CDCACM_PACKET_SIZE];
-#endif
+
+/* Deep receive FIFO, filled from the OUT endpoint callback at interrupt
+ * time so USB reception proceeds while gdb_main processes the previous
+ * packet.  Indices run free and are masked on access; the size must be
+ * a power of two. */
+#define RX_FIFO_SIZE 1024
+static uint8_t fifo_rx[RX_FIFO_SIZE];
+/* Fifo in index, written only from the OUT endpoint callback */
+static volatile uint32_t fifo_rx_in;
+/* Fifo out index, written only from the consumer */
+static volatile uint32_t fifo_rx_out;
+/* Packet held back because the FIFO was too full to take it; the
+ * endpoint stays NAKed until the consumer makes room */
+static uint8_t buffer_park[CDCACM_PACKET_SIZE];
+static volatile uint32_t count_park;
+/* Double-buffered transmit: a second packet can be parked here while
+ * a transfer is still in flight on the endpoint. */
+static volatile uint32_t count_pend;
+static uint8_t buffer_pend[CDCACM_PACKET_SIZE];
+static volatile bool tx_busy;
+
+void gdb_usb_in_cb(usbd_device *dev, uint8_t ep)
+{
+	(void)ep;
+	if (count_pend) {
+		usbd_ep_write_packet(dev, GDB_TX_ENDPOINT,
+		                     buffer_pend, count_pend);
+		count_pend = 0;
+	} else {
+		tx_busy = false;
+	}
+}
+
+/* Queue one packet for transmission.  If the endpoint is idle start the
+ * transfer directly, otherwise park the data in the pending buffer for
+ * gdb_usb_in_cb() to pick up, so formatting of the next reply overlaps
+ * with the previous packet draining over the wire.
+ */
+static void gdb_if_send(const void *data, uint32_t len)
+{
+	while (1) {
+		asm volatile ("cpsid i; isb");
+		if (!tx_busy) {
+			tx_busy = true;
+			usbd_ep_write_packet(usbdev, GDB_TX_ENDPOINT,
+			                     data, len);
+			break;
+		}
+		if (!count_pend) {
+			memcpy(buffer_pend, data, len);
+			count_pend = len;
+			break;
+		}
+		asm volatile ("cpsie i; isb");
+		/* Both buffers in flight; give up if the host goes away
+		 * while we wait for the interrupt to drain one. */
+		if (!gdb_raw_active && !cdcacm_get_dtr())
+			return;
+	}
+	asm volatile ("cpsie i; isb");
+}
 
 void gdb_if_putchar(unsigned char c, int flush)
 {
@@ -42,12 +112,14 @@ void gdb_if_putchar(unsigned char c, int flush)
 	if(flush || (count_in == CDCACM_PACKET_SIZE)) {
 		/* Refuse to send if USB isn't configured, and
 		 * don't bother if nobody's listening */
-		if((cdcacm_get_config() != 1) || !cdcacm_get_dtr()) {
+		if((cdcacm_get_config() != 1) ||
+		   (!gdb_raw_active && !cdcacm_get_dtr())) {
 			count_in = 0;
 			return;
 		}
-		while(usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT,
-			buffer_in, count_in) <= 0);
+		PROFILE_BEGIN(PROFILE_USB_SEND);
+		gdb_if_send(buffer_in, count_in);
+		PROFILE_END(PROFILE_USB_SEND);
 
 		if (flush && (count_in == CDCACM_PACKET_SIZE)) {
 			/* We need to send an empty packet for some hosts
@@ -56,59 +128,115 @@ void gdb_if_putchar(unsigned char c, int flush)
 			 * that transfer is complete, so we just send a packet
 			 * containing a null byte for now.
 			 */
-			while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT,
-				"\0", 1) <= 0);
+			gdb_if_send("\0", 1);
 		}
 
 		count_in = 0;
 	}
 }
 
-#ifdef STM32F4
-void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
+static void fifo_rx_push(const uint8_t *data, uint32_t len)
 {
-	(void)ep;
-	usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 1);
-	count_new = usbd_ep_read_packet(dev, CDCACM_GDB_ENDPOINT,
-	                                double_buffer_out, CDCACM_PACKET_SIZE);
-	if(!count_new) {
-		usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 0);
+	for (uint32_t i = 0; i < len; i++)
+		fifo_rx[(fifo_rx_in + i) & (RX_FIFO_SIZE - 1)] = data[i];
+	fifo_rx_in += len;
+}
+
+/* Endpoint the parked packet came from, so the unpark path reopens
+ * the right one */
+static volatile uint8_t park_ep = CDCACM_GDB_ENDPOINT;
+
+static void gdb_usb_out_common(usbd_device *dev, uint8_t ep)
+{
+	ep &= 0x7F;
+	usbd_ep_nak_set(dev, ep, 1);
+	uint32_t len = usbd_ep_read_packet(dev, ep,
+	                                   buffer_park, CDCACM_PACKET_SIZE);
+	if ((RX_FIFO_SIZE - (fifo_rx_in - fifo_rx_out)) >= len) {
+		fifo_rx_push(buffer_park, len);
+		usbd_ep_nak_set(dev, ep, 0);
+	} else {
+		/* FIFO too full: park the packet and leave the endpoint
+		 * NAKed until the consumer makes room */
+		count_park = len;
+		park_ep = ep;
 	}
 }
+
+void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
+{
+#ifdef PLATFORM_HAS_GDB_RAW
+	gdb_raw_active = false;
+#endif
+	gdb_usb_out_common(dev, ep);
+}
+
+#ifdef PLATFORM_HAS_GDB_RAW
+void gdb_usb_raw_out_cb(usbd_device *dev, uint8_t ep)
+{
+	gdb_raw_active = true;
+	gdb_usb_out_common(dev, ep);
+}
 #endif
 
-static void gdb_if_update_buf(void)
+/* Reclaim a parked packet once the consumer has made room */
+static void fifo_rx_unpark(void)
 {
-	while (cdcacm_get_config() != 1);
-#ifdef STM32F4
+	if (!count_park)
+		return;
 	asm volatile ("cpsid i; isb");
-	if (count_new) {
-		memcpy(buffer_out, double_buffer_out, count_new);
-		count_out = count_new;
-		count_new = 0;
-		out_ptr = 0;
-		usbd_ep_nak_set(usbdev, CDCACM_GDB_ENDPOINT, 0);
+	if (count_park &&
+	    ((RX_FIFO_SIZE - (fifo_rx_in - fifo_rx_out)) >= count_park)) {
+		fifo_rx_push(buffer_park, count_park);
+		count_park = 0;
+		usbd_ep_nak_set(usbdev, park_ep, 0);
 	}
 	asm volatile ("cpsie i; isb");
-#else
-	count_out = usbd_ep_read_packet(usbdev, CDCACM_GDB_ENDPOINT,
-	                                buffer_out, CDCACM_PACKET_SIZE);
-	out_ptr = 0;
-#endif
+}
+
+int gdb_if_read(void *buf, int maxlen)
+{
+	int n;
+
+	while (fifo_rx_in == fifo_rx_out) {
+		/* Detach if port closed */
+		if (!gdb_raw_active && !cdcacm_get_dtr())
+			return -1;
+
+		while (cdcacm_get_config() != 1);
+		task_yield();
+	}
+
+	n = fifo_rx_in - fifo_rx_out;
+	if (n > maxlen)
+		n = maxlen;
+	for (int i = 0; i < n; i++)
+		((uint8_t *)buf)[i] = fifo_rx[(fifo_rx_out + i) &
+		                              (RX_FIFO_SIZE - 1)];
+	fifo_rx_out += n;
+	fifo_rx_unpark();
+
+	return n;
 }
 
 unsigned char gdb_if_getchar(void)
 {
+	unsigned char c;
 
-	while (!(out_ptr < count_out)) {
+	while (fifo_rx_in == fifo_rx_out) {
 		/* Detach if port closed */
-		if (!cdcacm_get_dtr())
+		if (!gdb_raw_active && !cdcacm_get_dtr())
 			return 0x04;
 
-		gdb_if_update_buf();
+		while (cdcacm_get_config() != 1);
+		task_yield();
 	}
 
-	return buffer_out[out_ptr++];
+	c = fifo_rx[fifo_rx_out & (RX_FIFO_SIZE - 1)];
+	fifo_rx_out++;
+	fifo_rx_unpark();
+
+	return c;
 }
 
 unsigned char gdb_if_getchar_to(int timeout)
@@ -116,15 +244,17 @@ unsigned char gdb_if_getchar_to(int timeout)
 	platform_timeout t;
 	platform_timeout_set(&t, timeout);
 
-	if (!(out_ptr < count_out)) do {
+	/* The FIFO fills at interrupt time, so waiting for a character is
+	 * just watching the ring indices */
+	if (fifo_rx_in == fifo_rx_out) do {
 		/* Detach if port closed */
-		if (!cdcacm_get_dtr())
+		if (!gdb_raw_active && !cdcacm_get_dtr())
 			return 0x04;
+		task_yield();
+	} while (!platform_timeout_is_expired(&t) &&
+	         (fifo_rx_in == fifo_rx_out));
 
-		gdb_if_update_buf();
-	} while (!platform_timeout_is_expired(&t) && !(out_ptr < count_out));
-
-	if(out_ptr < count_out)
+	if (fifo_rx_in != fifo_rx_out)
 		return gdb_if_getchar();
 
 	return -1;
@@ -26,6 +26,43 @@
 #include "jtagtap.h"
 #include "gdb_packet.h"
 
+/* A platform may override the unthrottled loop rate estimate if its
+ * core clock makes the default a poor fit. */
+#ifndef JTAG_FREQ_UNTHROTTLED
+#define JTAG_FREQ_UNTHROTTLED	4000000
+#endif
+#define JTAG_FREQ_MIN		100000
+
+/* Delay loop iterations inserted into each TCK half period; zero
+ * runs the bit-bang loop flat out. */
+static uint32_t jtag_delay_cnt = 0;
+static uint32_t jtag_freq = JTAG_FREQ_UNTHROTTLED;
+
+#define JTAG_DELAY() do { \
+	for(volatile uint32_t _i = jtag_delay_cnt; _i; _i--); \
+} while (0)
+
+/* As with the SWD tap, the mapping from Hz to delay iterations is only
+ * a monotonic estimate, which is all the scan-time negotiation and the
+ * jtag_freq monitor command need. */
+void jtagtap_set_frequency(uint32_t hz)
+{
+	if (hz < JTAG_FREQ_MIN)
+		hz = JTAG_FREQ_MIN;
+	if (hz >= JTAG_FREQ_UNTHROTTLED) {
+		hz = JTAG_FREQ_UNTHROTTLED;
+		jtag_delay_cnt = 0;
+	} else {
+		jtag_delay_cnt = JTAG_FREQ_UNTHROTTLED / (2 * hz);
+	}
+	jtag_freq = hz;
+}
+
+uint32_t jtagtap_get_frequency(void)
+{
+	return jtag_freq;
+}
+
 int jtagtap_init(void)
 {
 	TMS_SET_MODE();
@@ -51,18 +88,88 @@ void jtagtap_reset(void)
 	jtagtap_soft_reset();
 }
 
-inline uint8_t jtagtap_next(uint8_t dTMS, uint8_t dTDI)
+RAMFUNC uint8_t jtagtap_next(uint8_t dTMS, uint8_t dTDI)
 {
 	uint16_t ret;
 
 	gpio_set_val(TMS_PORT, TMS_PIN, dTMS);
 	gpio_set_val(TDI_PORT, TDI_PIN, dTDI);
 	gpio_set(TCK_PORT, TCK_PIN);
+	JTAG_DELAY();
 	ret = gpio_get(TDO_PORT, TDO_PIN);
 	gpio_clear(TCK_PORT, TCK_PIN);
+	JTAG_DELAY();
 
 	//DEBUG("jtagtap_next(TMS = %d, TDI = %d) = %d\n", dTMS, dTDI, ret);
 
 	return ret != 0;
 }
 
+/* Strong versions of the scan sequence functions, overriding the weak
+ * per-bit generics in jtagtap_generic.c.  TMS is constant for all but
+ * the final bit of a shift, so holding it and driving the inline GPIO
+ * accessors in one loop removes a function call and two branches per
+ * TCK cycle, which dominates long IR/DR scans on multi-TAP chains. */
+
+RAMFUNC void jtagtap_tms_seq(uint32_t MS, int ticks)
+{
+	gpio_set(TDI_PORT, TDI_PIN);
+	while (ticks--) {
+		gpio_set_val(TMS_PORT, TMS_PIN, MS & 1);
+		gpio_set(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+		MS >>= 1;
+		gpio_clear(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+	}
+}
+
+RAMFUNC void jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms,
+                         const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+
+	if (!ticks)
+		return;
+	gpio_clear(TMS_PORT, TMS_PIN);
+	while (ticks--) {
+		if (!ticks)
+			gpio_set_val(TMS_PORT, TMS_PIN, final_tms);
+		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
+		gpio_set(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+		if (gpio_get(TDO_PORT, TDO_PIN))
+			*DO |= index;
+		else
+			*DO &= ~index;
+		gpio_clear(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++; DO++;
+		}
+	}
+}
+
+RAMFUNC void jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+
+	if (!ticks)
+		return;
+	gpio_clear(TMS_PORT, TMS_PIN);
+	while (ticks--) {
+		if (!ticks)
+			gpio_set_val(TMS_PORT, TMS_PIN, final_tms);
+		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
+		gpio_set(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+		gpio_clear(TCK_PORT, TCK_PIN);
+		JTAG_DELAY();
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++;
+		}
+	}
+}
+
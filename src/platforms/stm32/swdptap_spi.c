@@ -0,0 +1,191 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Alternate SW-DP backend that shifts the byte-aligned output phases
+ * of each transaction (request headers and write data) through an SPI
+ * peripheral in transmit-only bidirectional mode, reaching the
+ * peripheral clock rate instead of the bit-bang loop rate.  Input
+ * phases (ack, read data) and sub-byte stretches stay bit-banged, as
+ * receive mode on a half-duplex master free-runs the clock and cannot
+ * be stopped on a bit boundary.
+ *
+ * None of the shipped board pinouts route SWDIO to an SPI MOSI pin,
+ * so no platform selects this file by default.  A board that does can
+ * opt in by listing swdptap_spi.c in place of swdptap.c in its
+ * Makefile.inc and defining in platform.h:
+ *   SWD_SPI           the peripheral, e.g. SPI1
+ *   SWD_SPI_CLOCKEN   its clock enable, e.g. RCC_SPI1
+ *   SWD_SPI_MODE_SPI()  switch SWCLK/SWDIO to their AF (SPI) function
+ *   SWD_SPI_MODE_GPIO() hand the pins back to manual GPIO, clock low
+ */
+
+#include "general.h"
+#include "swdptap.h"
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/spi.h>
+
+int swdptap_init(void)
+{
+	rcc_periph_clock_enable(SWD_SPI_CLOCKEN);
+	spi_init_master(SWD_SPI, SPI_CR1_BAUDRATE_FPCLK_DIV_8,
+	                SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+	                SPI_CR1_CPHA_CLK_TRANSITION_1,
+	                SPI_CR1_DFF_8BIT, SPI_CR1_LSBFIRST);
+	spi_enable_software_slave_management(SWD_SPI);
+	spi_set_nss_high(SWD_SPI);
+	spi_set_bidirectional_transmit_only_mode(SWD_SPI);
+	return 0;
+}
+
+static void swdptap_turnaround(uint8_t dir)
+{
+	static uint8_t olddir = 0;
+
+	/* Don't turnaround if direction not changing */
+	if(dir == olddir) return;
+	olddir = dir;
+
+	if(dir)
+		SWDIO_MODE_FLOAT();
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	if(!dir)
+		SWDIO_MODE_DRIVE();
+}
+
+bool swdptap_bit_in(void)
+{
+	uint16_t ret;
+
+	swdptap_turnaround(1);
+
+	ret = gpio_get(SWDIO_PORT, SWDIO_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+
+	return ret != 0;
+}
+
+void swdptap_bit_out(bool val)
+{
+	swdptap_turnaround(0);
+
+	gpio_set_val(SWDIO_PORT, SWDIO_PIN, val);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+}
+
+/* Shift out whole bytes LSB-first through the peripheral */
+static void swd_spi_out(uint32_t MS, int bytes)
+{
+	SWD_SPI_MODE_SPI();
+	spi_enable(SWD_SPI);
+	while (bytes--) {
+		SPI_DR(SWD_SPI) = MS & 0xFF;
+		MS >>= 8;
+		while (!(SPI_SR(SWD_SPI) & SPI_SR_TXE));
+	}
+	while (SPI_SR(SWD_SPI) & SPI_SR_BSY);
+	spi_disable(SWD_SPI);
+	SWD_SPI_MODE_GPIO();
+}
+
+void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	swdptap_turnaround(0);
+	if ((ticks & 7) == 0) {
+		swd_spi_out(MS, ticks >> 3);
+		return;
+	}
+	while (ticks--) {
+		gpio_set_val(SWDIO_PORT, SWDIO_PIN, MS & 1);
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		MS >>= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	}
+}
+
+void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	uint8_t parity = 0;
+
+	for (int i = 0; i < ticks; i++)
+		parity ^= MS >> i;
+
+	swdptap_turnaround(0);
+	if ((ticks & 7) == 0) {
+		swd_spi_out(MS, ticks >> 3);
+	} else {
+		uint32_t data = MS;
+		int n = ticks;
+		while (n--) {
+			gpio_set_val(SWDIO_PORT, SWDIO_PIN, data & 1);
+			gpio_set(SWCLK_PORT, SWCLK_PIN);
+			data >>= 1;
+			gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		}
+	}
+	gpio_set_val(SWDIO_PORT, SWDIO_PIN, parity & 1);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+}
+
+/* Input sequences stay bit-banged; see the file comment */
+uint32_t swdptap_seq_in(int ticks)
+{
+	uint32_t index = 1;
+	uint32_t ret = 0;
+
+	swdptap_turnaround(1);
+	while (ticks--) {
+		if (gpio_get(SWDIO_PORT, SWDIO_PIN))
+			ret |= index;
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		index <<= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	}
+
+	return ret;
+}
+
+bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
+{
+	uint32_t index = 1;
+	uint8_t parity = 0;
+	uint32_t res = 0;
+
+	swdptap_turnaround(1);
+	while (ticks--) {
+		if (gpio_get(SWDIO_PORT, SWDIO_PIN)) {
+			res |= index;
+			parity ^= 1;
+		}
+		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		index <<= 1;
+		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	}
+	if (gpio_get(SWDIO_PORT, SWDIO_PIN))
+		parity ^= 1;
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+
+	*ret = res;
+	return parity;
+}
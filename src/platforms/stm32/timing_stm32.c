@@ -18,23 +18,49 @@
  */
 #include "general.h"
 #include "morse.h"
+#include "profile.h"
 
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/scb.h>
+#ifdef ENABLE_PROFILE
+#	include <libopencm3/cm3/dwt.h>
+#	include <libopencm3/cm3/scs.h>
+#endif
 
 uint8_t running_status;
 static volatile uint32_t time_ms;
 
+/* SysTick counts AHB/8; a platform clocked at something other than the
+ * historic 72MHz overrides this in platform.h so the heartbeat and the
+ * delay loops below stay calibrated. */
+#ifndef AHB_FREQ_MHZ
+#define AHB_FREQ_MHZ 72
+#endif
+
 void platform_timing_init(void)
 {
 	/* Setup heartbeat timer */
 	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB_DIV8);
-	systick_set_reload(900000);	/* Interrupt us at 10 Hz */
+	systick_set_reload(AHB_FREQ_MHZ * 12500);	/* Interrupt us at 10 Hz */
 	SCB_SHPR(11) &= ~((15 << 4) & 0xff);
 	SCB_SHPR(11) |= ((14 << 4) & 0xff);
 	systick_interrupt_enable();
 	systick_counter_enable();
+
+#ifdef ENABLE_PROFILE
+	/* Free-running cycle counter for the profiling hooks */
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+#ifdef ENABLE_PROFILE
+uint32_t profile_cycles(void)
+{
+	return DWT_CYCCNT;
 }
+#endif
 
 void platform_delay(uint32_t ms)
 {
@@ -43,6 +69,25 @@ void platform_delay(uint32_t ms)
 	while (!platform_timeout_is_expired(&timeout));
 }
 
+void platform_delay_us(uint32_t us)
+{
+	/* The reload value covers one 100ms heartbeat period, so the
+	 * SysTick rate in ticks per microsecond falls out of it whatever
+	 * the core clock; the down-counter then provides the resolution
+	 * that time_ms lacks. */
+	uint32_t ticks_per_us = (systick_get_reload() + 1) / 100000;
+	uint32_t total = us * ticks_per_us;
+	uint32_t last = systick_get_value();
+	uint32_t elapsed = 0;
+
+	while (elapsed < total) {
+		uint32_t now = systick_get_value();
+		elapsed += (last >= now) ? (last - now) :
+			(last + systick_get_reload() + 1 - now);
+		last = now;
+	}
+}
+
 void sys_tick_handler(void)
 {
 	if(running_status)
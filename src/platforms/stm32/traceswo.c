@@ -25,49 +25,150 @@
  * ARM DDI 0314H - CoreSight Components Technical Reference Manual
  */
 
-/* TDO/TRACESWO signal comes into pin PA6/TIM3_CH1
+/* TDO/TRACESWO signal comes into a timer capture input selected by the
+ * platform (TRACE_TIM/TRACE_IC_IN, e.g. PA6/TIM3_CH1 on native).
  * Manchester coding is assumed on TRACESWO, so bit timing can be detected.
- * The idea is to use TIM3 input capture modes to capture pulse timings.
- * These can be capture directly to RAM by DMA.
- * The core can then process the buffer to extract the frame.
+ * TIM3 input capture grabs the cycle and high times of each bit, and a
+ * circular DMA channel moves the capture pairs into a ring buffer using
+ * the timer's DMA burst feature.  The ring is decoded a batch at a time
+ * from the DMA half/full-transfer interrupts, so the per-edge interrupt
+ * of the old scheme (which starved everything else above ~200kbaud) is
+ * replaced by one interrupt per half ring.  The timer update interrupt
+ * still fires on line idle to terminate a frame.
+ *
+ * DMA capture needs the platform to provide TRACE_DMA macros (the
+ * channel mapping is device specific); without them the decoder runs
+ * straight from the capture interrupt as before.
  */
 #include "general.h"
 #include "cdcacm.h"
+#include "tasks.h"
+#include "traceswo.h"
 
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/stm32/timer.h>
+#ifdef TRACE_DMA
+#include <libopencm3/stm32/dma.h>
+#endif
 #include <libopencm3/stm32/f1/rcc.h>
 
+/* Most boards land SWO on the timer's TI1 input; platforms where it
+ * arrives on TI2 (e.g. swlink, PB3/TIM2_CH2) override these.  The same
+ * input selector is passed for both capture channels: timer_ic_set_input
+ * flips the CCMR input-select bits for the even channel, so both end up
+ * on the same pin. */
+#ifndef TRACE_IC_IN
+#define TRACE_IC_IN TIM_IC_IN_TI1
+#endif
+#ifndef TRACE_TRIG_IN
+#define TRACE_TRIG_IN TIM_SMCR_TS_IT1FP1
+#endif
+
+/* The slave-mode reset must fire on the rising SWO edge, and the
+ * TIxFPx trigger's active edge follows the trigger channel's CCxP
+ * polarity bit.  So the channel feeding the trigger always captures
+ * the rising edge and holds the cycle time, the other one the falling
+ * edge and the high time.  TI1 capture triggers off CH1; on a TI2FP2
+ * trigger the platform defines TRACE_CC_SWAPPED and the channel roles
+ * swap. */
+#ifdef TRACE_CC_SWAPPED
+#define TRACE_IC_CYCLE   TIM_IC2
+#define TRACE_IC_HIGH    TIM_IC1
+#define TRACE_CCR_CYCLE  TIM_CCR2
+#define TRACE_CCR_HIGH   TIM_CCR1
+#define TRACE_PAIR_CYCLE 1
+#define TRACE_PAIR_HIGH  0
+#define TRACE_SR_CCIF    TIM_SR_CC2IF
+#define TRACE_SR_CCOF    TIM_SR_CC2OF
+#define TRACE_DIER_CCIE  TIM_DIER_CC2IE
+#define TRACE_DIER_CCDE  TIM_DIER_CC2DE
+#else
+#define TRACE_IC_CYCLE   TIM_IC1
+#define TRACE_IC_HIGH    TIM_IC2
+#define TRACE_CCR_CYCLE  TIM_CCR1
+#define TRACE_CCR_HIGH   TIM_CCR2
+#define TRACE_PAIR_CYCLE 0
+#define TRACE_PAIR_HIGH  1
+#define TRACE_SR_CCIF    TIM_SR_CC1IF
+#define TRACE_SR_CCOF    TIM_SR_CC1OF
+#define TRACE_DIER_CCIE  TIM_DIER_CC1IE
+#define TRACE_DIER_CCDE  TIM_DIER_CC1DE
+#endif
+
+#ifdef TRACE_DMA
+/* Capture ring: each entry is a {cycle, high time} pair transferred by
+ * one DMA burst on the CH1 capture event. */
+#define TRACE_RING_PAIRS 64
+static volatile uint16_t trace_ring[TRACE_RING_PAIRS][2];
+static unsigned trace_ring_pos;
+/* Set at frame end (line idle or overflow) for the decode task */
+static volatile bool trace_flush_pending;
+static void trace_task(void);
+#endif
+
 void traceswo_init(void)
 {
 	TRACE_TIM_CLK_EN();
+#ifdef TRACE_DMA
+	TRACE_DMA_CLK_EN();
+#endif
 
 	timer_reset(TRACE_TIM);
 
 	/* Refer to ST doc RM0008 - STM32F10xx Reference Manual.
 	 * Section 14.3.4 - 14.3.6 (General Purpose Timer - Input Capture)
 	 *
-	 * CCR1 captures cycle time, CCR2 captures high time
+	 * One capture channel grabs the cycle time, the other the high
+	 * time (see the TRACE_CC_SWAPPED mapping above)
 	 */
 
-	/* Use TI1 as capture input for CH1 and CH2 */
-	timer_ic_set_input(TRACE_TIM, TIM_IC1, TIM_IC_IN_TI1);
-	timer_ic_set_input(TRACE_TIM, TIM_IC2, TIM_IC_IN_TI1);
+	/* Use the platform's trace input for CH1 and CH2 */
+	timer_ic_set_input(TRACE_TIM, TIM_IC1, TRACE_IC_IN);
+	timer_ic_set_input(TRACE_TIM, TIM_IC2, TRACE_IC_IN);
 
-	/* Capture CH1 on rising edge, CH2 on falling edge */
-	timer_ic_set_polarity(TRACE_TIM, TIM_IC1, TIM_IC_RISING);
-	timer_ic_set_polarity(TRACE_TIM, TIM_IC2, TIM_IC_FALLING);
+	/* Capture the cycle channel on the rising edge, the high-time
+	 * channel on the falling edge */
+	timer_ic_set_polarity(TRACE_TIM, TRACE_IC_CYCLE, TIM_IC_RISING);
+	timer_ic_set_polarity(TRACE_TIM, TRACE_IC_HIGH, TIM_IC_FALLING);
 
-	/* Trigger on Filtered Timer Input 1 (TI1FP1) */
-	timer_slave_set_trigger(TRACE_TIM, TIM_SMCR_TS_IT1FP1);
+	/* Trigger on the filtered trace input (TIxFPx) */
+	timer_slave_set_trigger(TRACE_TIM, TRACE_TRIG_IN);
 
 	/* Slave reset mode: reset counter on trigger */
 	timer_slave_set_mode(TRACE_TIM, TIM_SMCR_SMS_RM);
 
-	/* Enable capture interrupt */
+#ifdef TRACE_DMA
+	/* DMA burst of CCR1 and CCR2 through DMAR on each CH1 capture:
+	 * base address CCR1, burst length 2 transfers */
+	TIM_DCR(TRACE_TIM) = (1 << 8) |
+		(((uint32_t)&TIM_CCR1(TRACE_TIM) - TRACE_TIM) >> 2);
+
+	dma_channel_reset(TRACE_DMA, TRACE_DMA_CHAN);
+	dma_set_peripheral_address(TRACE_DMA, TRACE_DMA_CHAN,
+				   (uint32_t)&TIM_DMAR(TRACE_TIM));
+	dma_set_memory_address(TRACE_DMA, TRACE_DMA_CHAN, (uint32_t)trace_ring);
+	dma_set_number_of_data(TRACE_DMA, TRACE_DMA_CHAN, TRACE_RING_PAIRS * 2);
+	dma_set_read_from_peripheral(TRACE_DMA, TRACE_DMA_CHAN);
+	dma_enable_memory_increment_mode(TRACE_DMA, TRACE_DMA_CHAN);
+	dma_set_peripheral_size(TRACE_DMA, TRACE_DMA_CHAN, DMA_CCR_PSIZE_16BIT);
+	dma_set_memory_size(TRACE_DMA, TRACE_DMA_CHAN, DMA_CCR_MSIZE_16BIT);
+	dma_enable_circular_mode(TRACE_DMA, TRACE_DMA_CHAN);
+	trace_ring_pos = 0;
+	dma_enable_channel(TRACE_DMA, TRACE_DMA_CHAN);
+
+	/* Decoding runs as a cooperative task polling the DMA position,
+	 * so heavy trace no longer steals interrupt time from the debug
+	 * paths; only frame-end framing needs the capture interrupt. */
+	task_add(trace_task);
 	nvic_set_priority(TRACE_IRQ, IRQ_PRI_TRACE);
 	nvic_enable_irq(TRACE_IRQ);
-	timer_enable_irq(TRACE_TIM, TIM_DIER_CC1IE);
+	timer_enable_irq(TRACE_TIM, TRACE_DIER_CCDE);
+#else
+	/* No DMA mapping provided: decode from the capture interrupt */
+	nvic_set_priority(TRACE_IRQ, IRQ_PRI_TRACE);
+	nvic_enable_irq(TRACE_IRQ);
+	timer_enable_irq(TRACE_TIM, TRACE_DIER_CCIE);
+#endif
 
 	/* Enable the capture channels */
 	timer_ic_enable(TRACE_TIM, TIM_IC1);
@@ -79,18 +180,182 @@ void traceswo_init(void)
 static uint8_t trace_usb_buf[64];
 static uint8_t trace_usb_buf_size;
 
+/* ITM packet filter: when enabled the decoded byte stream is parsed
+ * probe-side and only stimulus-port packets selected by the mask are
+ * forwarded, optionally stripped to bare payload.  Sync, overflow,
+ * timestamp and hardware-source packets are consumed here, so at high
+ * trace rates the USB load drops by the filter factor. */
+static bool itm_filter;		/* parser enabled */
+static uint32_t itm_mask;	/* stimulus ports to forward */
+static bool itm_strip;		/* payload only, no headers */
+static uint8_t itm_rem;		/* payload bytes left in this packet */
+static bool itm_fwd;		/* current packet is selected */
+static bool itm_cont;		/* discarding continuation bytes */
+
+void traceswo_filter_set(bool enable, uint32_t mask, bool strip)
+{
+	itm_filter = enable;
+	itm_mask = mask;
+	itm_strip = strip;
+	itm_rem = 0;
+	itm_fwd = false;
+	itm_cont = false;
+}
+
+/* Run flushed bytes through the ITM parser, forwarding what the mask
+ * selects.  Packet state carries across flushes: an ITM packet may
+ * span capture frames. */
+static void trace_itm_flush(uint8_t *buf, unsigned len)
+{
+	uint8_t out[16];
+	unsigned n = 0;
+
+	while (len--) {
+		uint8_t b = *buf++;
+		if (itm_rem) {
+			itm_rem--;
+			if (itm_fwd)
+				out[n++] = b;
+			continue;
+		}
+		if (itm_cont) {
+			itm_cont = !!(b & 0x80);
+			continue;
+		}
+		if ((b & 3) == 0) {
+			/* Protocol packet: sync (0x00), overflow (0x70)
+			 * or timestamp; timestamps chain continuation
+			 * bytes with bit 7 */
+			itm_cont = !!(b & 0x80);
+			continue;
+		}
+		/* Source packet: payload of 1, 2 or 4 bytes follows */
+		itm_rem = 1 << ((b & 3) - 1);
+		/* Forward instrumentation packets on selected ports;
+		 * hardware-source packets (bit 2) are consumed */
+		itm_fwd = !(b & 4) && ((itm_mask >> (b >> 3)) & 1);
+		if (itm_fwd && !itm_strip)
+			out[n++] = b;
+	}
+
+	if (n)
+		trace_buf_push(out, n);
+}
+
+/* Optional compression of the outgoing trace stream, for when USB
+ * full speed is the ceiling.  The stream is coded in 4-byte groups:
+ *
+ *   0x00        followed by a literal group (4 bytes)
+ *   0x80 | h    the group in dictionary slot h (64 slots)
+ *   0xC0 | n    the previous group repeated n more times (1..63)
+ *
+ * The dictionary is updated on every literal group by both ends, with
+ * slot h the top 6 bits of the group's Knuth multiplicative hash, so
+ * no table ever crosses the wire.  Repetitive ITM traffic (periodic
+ * task IDs, mostly-constant counters) codes at a byte or two per
+ * group; scripts/swo_decompress.py restores the raw stream.  Up to
+ * three tail bytes are carried until the next capture completes the
+ * group. */
+static bool trace_compress;
+static uint32_t trace_dict[64];
+static uint32_t trace_last_group;
+static uint8_t trace_rep_count;
+static uint8_t trace_carry[4];
+static uint8_t trace_carry_len;
+
+void traceswo_compress_set(bool enable)
+{
+	trace_compress = enable;
+	memset(trace_dict, 0, sizeof(trace_dict));
+	trace_last_group = ~0;
+	trace_rep_count = 0;
+	trace_carry_len = 0;
+}
+
+static void trace_buf_push_raw(uint8_t *buf, int len);
+
+static void trace_compress_push(uint8_t *buf, int len)
+{
+	uint8_t out[2 * 64];
+	unsigned n = 0;
+
+	while (len) {
+		if (trace_carry_len || (len < 4)) {
+			/* Complete a carried group before taking whole
+			 * groups from the input */
+			trace_carry[trace_carry_len++] = *buf++;
+			len--;
+			if (trace_carry_len < 4) {
+				if (!len)
+					break;
+				continue;
+			}
+			trace_carry_len = 0;
+		} else {
+			memcpy(trace_carry, buf, 4);
+			buf += 4;
+			len -= 4;
+		}
+		uint32_t group = trace_carry[0] | (trace_carry[1] << 8) |
+			((uint32_t)trace_carry[2] << 16) |
+			((uint32_t)trace_carry[3] << 24);
+		trace_carry_len = 0;
+		if (group == trace_last_group) {
+			if (trace_rep_count == 63) {
+				out[n++] = 0xC0 | trace_rep_count;
+				trace_rep_count = 0;
+			}
+			trace_rep_count++;
+			continue;
+		}
+		if (trace_rep_count) {
+			out[n++] = 0xC0 | trace_rep_count;
+			trace_rep_count = 0;
+		}
+		uint8_t h = ((uint32_t)(group * 2654435761U)) >> 26;
+		if (trace_dict[h] == group) {
+			out[n++] = 0x80 | h;
+		} else {
+			trace_dict[h] = group;
+			out[n++] = 0x00;
+			out[n++] = group & 0xff;
+			out[n++] = (group >> 8) & 0xff;
+			out[n++] = (group >> 16) & 0xff;
+			out[n++] = (group >> 24) & 0xff;
+		}
+		trace_last_group = group;
+	}
+
+	if (n)
+		trace_buf_push_raw(out, n);
+}
+
 void trace_buf_push(uint8_t *buf, int len)
 {
+	if (trace_compress) {
+		trace_compress_push(buf, len);
+		return;
+	}
+	trace_buf_push_raw(buf, len);
+}
+
+static void trace_buf_push_raw(uint8_t *buf, int len)
+{
+	/* Called from task context too, so keep the USB stack single
+	 * threaded while the packet is handed over */
+	asm volatile ("cpsid i; isb");
 	if (usbd_ep_write_packet(usbdev, 0x85, buf, len) != len) {
 		if (trace_usb_buf_size + len > 64) {
 			/* Stall if upstream to too slow. */
 			usbd_ep_stall_set(usbdev, 0x85, 1);
 			trace_usb_buf_size = 0;
+			asm volatile ("cpsie i; isb");
 			return;
 		}
 		memcpy(trace_usb_buf + trace_usb_buf_size, buf, len);
 		trace_usb_buf_size += len;
 	}
+	asm volatile ("cpsie i; isb");
 }
 
 void trace_buf_drain(usbd_device *dev, uint8_t ep)
@@ -102,40 +367,74 @@ void trace_buf_drain(usbd_device *dev, uint8_t ep)
 	trace_usb_buf_size = 0;
 }
 
+void traceswo_setbaud(uint32_t baud)
+{
+	/* Manchester coding is self-clocking; nothing to set */
+	(void)baud;
+}
+
 #define ALLOWED_DUTY_ERROR 5
 
-void TRACE_ISR(void)
+/* Interval between timestamp records in the output stream */
+#define TRACE_TS_INTERVAL_MS 100
+
+static uint16_t bt;
+static uint8_t lastbit;
+static uint8_t decbuf[17];
+static uint8_t decbuf_pos;
+static uint8_t halfbit;
+
+/* Insert a timestamp record into the stream at most every
+ * TRACE_TS_INTERVAL_MS, and only at frame boundaries so it can't split
+ * an ITM packet.  The record is a 0xFF,0xFF marker followed by the
+ * probe's millisecond counter, little-endian, for host-side
+ * reconstruction of event timing. */
+static void trace_timestamp(void)
 {
-	uint16_t sr = TIM_SR(TRACE_TIM);
-	uint16_t duty, cycle;
-	static uint16_t bt;
-	static uint8_t lastbit;
-	static uint8_t decbuf[17];
-	static uint8_t decbuf_pos;
-	static uint8_t halfbit;
-	static uint8_t notstart;
-
-	/* Reset decoder state if capture overflowed */
-	if (sr & (TIM_SR_CC1OF | TIM_SR_UIF)) {
-		timer_clear_flag(TRACE_TIM, TIM_SR_CC1OF | TIM_SR_UIF);
-		if (!(sr & (TIM_SR_CC2IF | TIM_SR_CC1IF)))
-			goto flush_and_reset;
-	}
+	static uint32_t last_ts;
+	uint32_t now = platform_time_ms();
 
-	cycle = TIM_CCR1(TRACE_TIM);
-	duty = TIM_CCR2(TRACE_TIM);
+	if ((now - last_ts) < TRACE_TS_INTERVAL_MS)
+		return;
+	last_ts = now;
 
-	/* Reset decoder state if crazy shit happened */
-	if ((bt && (((duty / bt) > 2) || ((duty / bt) == 0))) || (duty == 0))
-		goto flush_and_reset;
+	uint8_t ts[6] = {0xFF, 0xFF,
+			 now & 0xFF, (now >> 8) & 0xFF,
+			 (now >> 16) & 0xFF, (now >> 24) & 0xFF};
+	trace_buf_push(ts, sizeof(ts));
+}
 
-	if(!(sr & TIM_SR_CC1IF)) notstart = 1;
+static void trace_flush(void)
+{
+	timer_set_period(TRACE_TIM, -1);
+	timer_disable_irq(TRACE_TIM, TIM_DIER_UIE);
+	if (decbuf_pos >> 3) {
+		if (itm_filter) {
+			trace_itm_flush(decbuf, decbuf_pos >> 3);
+		} else {
+			trace_buf_push(decbuf, decbuf_pos >> 3);
+			trace_timestamp();
+		}
+	}
+	bt = 0;
+	decbuf_pos = 0;
+	memset(decbuf, 0, sizeof(decbuf));
+}
+
+/* Decode one captured bit: cycle is the rising-to-rising time, duty
+ * the high time.  Same Manchester recovery as the old per-edge ISR,
+ * minus the status-flag juggling -- every DMA burst is a complete
+ * capture pair, and frame end is signalled by the update interrupt
+ * rather than a missing capture. */
+static void trace_decode(uint16_t cycle, uint16_t duty)
+{
+	/* Reset decoder state if crazy shit happened */
+	if ((bt && (((duty / bt) > 2) || ((duty / bt) == 0))) || (duty == 0)) {
+		trace_flush();
+		return;
+	}
 
 	if (!bt) {
-		if (notstart) {
-			notstart = 0;
-			return;
-		}
 		/* First bit, sync decoder */
 		duty -= ALLOWED_DUTY_ERROR;
 		if (((cycle / duty) != 2) &&
@@ -150,8 +449,10 @@ void TRACE_ISR(void)
 	} else {
 		/* If high time is extended we need to flip the bit */
 		if ((duty / bt) > 1) {
-			if (!halfbit) /* lost sync somehow */
-				goto flush_and_reset;
+			if (!halfbit) { /* lost sync somehow */
+				trace_flush();
+				return;
+			}
 			halfbit = 0;
 			lastbit ^= 1;
 		}
@@ -159,27 +460,74 @@ void TRACE_ISR(void)
 		decbuf_pos++;
 	}
 
-	if (!(sr & TIM_SR_CC1IF) || (((cycle - duty) / bt) > 2))
-		goto flush_and_reset;
+	if (((cycle - duty) / bt) > 2) {
+		trace_flush();
+		return;
+	}
 
 	if (((cycle - duty) / bt) > 1) {
 		/* If low time extended we need to pack another bit. */
-		if (halfbit) /* this is a valid stop-bit or we lost sync */
-			goto flush_and_reset;
+		if (halfbit) { /* this is a valid stop-bit or we lost sync */
+			trace_flush();
+			return;
+		}
 		halfbit = 1;
 		lastbit ^= 1;
 		decbuf[decbuf_pos >> 3] |= lastbit << (decbuf_pos & 7);
 		decbuf_pos++;
 	}
 
-	if (decbuf_pos < 128)
-		return;
+	if (decbuf_pos >= 128)
+		trace_flush();
+}
 
-flush_and_reset:
-	timer_set_period(TRACE_TIM, -1);
-	timer_disable_irq(TRACE_TIM, TIM_DIER_UIE);
-	trace_buf_push(decbuf, decbuf_pos >> 3);
-	bt = 0;
-	decbuf_pos = 0;
-	memset(decbuf, 0, sizeof(decbuf));
+#ifdef TRACE_DMA
+/* Decode every capture pair the DMA has landed since the last drain */
+static void trace_drain(void)
+{
+	/* Round down so a pair whose second transfer is still in flight
+	 * isn't consumed half-written */
+	unsigned dma_pos = ((TRACE_RING_PAIRS * 2) -
+		DMA_CNDTR(TRACE_DMA, TRACE_DMA_CHAN)) >> 1;
+
+	while (trace_ring_pos != dma_pos) {
+		trace_decode(trace_ring[trace_ring_pos][TRACE_PAIR_CYCLE],
+			     trace_ring[trace_ring_pos][TRACE_PAIR_HIGH]);
+		trace_ring_pos = (trace_ring_pos + 1) % TRACE_RING_PAIRS;
+	}
+}
+
+/* Decode whatever the DMA has landed, then terminate the frame if the
+ * capture interrupt saw the line go idle.  Runs in task context. */
+static void trace_task(void)
+{
+	trace_drain();
+	if (trace_flush_pending) {
+		trace_flush_pending = false;
+		trace_flush();
+	}
+}
+
+void TRACE_ISR(void)
+{
+	uint16_t sr = TIM_SR(TRACE_TIM);
+
+	timer_clear_flag(TRACE_TIM, TRACE_SR_CCOF | TIM_SR_UIF);
+	/* Line went idle (or capture overflowed): have the decode task
+	 * flush once it has consumed the ring */
+	if (sr & (TRACE_SR_CCOF | TIM_SR_UIF))
+		trace_flush_pending = true;
+}
+#else
+void TRACE_ISR(void)
+{
+	uint16_t sr = TIM_SR(TRACE_TIM);
+
+	timer_clear_flag(TRACE_TIM, TRACE_SR_CCOF | TIM_SR_UIF);
+	if (sr & TRACE_SR_CCIF)
+		trace_decode(TRACE_CCR_CYCLE(TRACE_TIM),
+			     TRACE_CCR_HIGH(TRACE_TIM));
+	if (sr & (TRACE_SR_CCOF | TIM_SR_UIF))
+		trace_flush();
 }
+#endif
@@ -0,0 +1,163 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Alternate TRACESWO backend for NRZ (UART mode) SWO.  A USART with
+ * circular DMA reception sustains multi-megabaud trace, an order of
+ * magnitude beyond what the Manchester edge-timing decoder manages,
+ * at the cost of needing the rate set up front: use
+ * 'monitor traceswo <baudrate>' to match the target's SWO prescaler.
+ *
+ * None of the shipped board pinouts route SWO to a USART RX pin, so
+ * no platform selects this file by default.  A board that does can
+ * opt in by listing traceswo_usart.c in place of traceswo.c in its
+ * Makefile.inc and defining in platform.h:
+ *   TRACE_UART              the peripheral, e.g. USART1
+ *   TRACE_UART_CLK_EN()     its clock enable
+ *   TRACE_UART_PIN_SETUP()  configure the SWO pin as USART RX
+ *   TRACE_UART_IRQ/ISR      the USART interrupt (used for line idle)
+ *   TRACE_UART_DMA          the DMA controller, e.g. DMA1
+ *   TRACE_UART_DMA_CLK_EN() its clock enable
+ *   TRACE_UART_DMA_CHAN     the RX request channel
+ *   TRACE_UART_DMA_IRQ/ISR  that channel's interrupt
+ */
+#include "general.h"
+#include "cdcacm.h"
+
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/f1/rcc.h>
+
+/* Matches the reset default of the TPIU async clock prescaler on a
+ * 72MHz target sensibly; always overridable with 'monitor traceswo' */
+#define TRACE_DEFAULT_BAUD 2250000
+
+#define TRACE_RING_SIZE 256
+static volatile uint8_t trace_ring[TRACE_RING_SIZE];
+static unsigned trace_ring_pos;
+
+static uint8_t trace_usb_buf[64];
+static uint8_t trace_usb_buf_size;
+
+void trace_buf_push(uint8_t *buf, int len)
+{
+	if (usbd_ep_write_packet(usbdev, 0x85, buf, len) != len) {
+		if (trace_usb_buf_size + len > 64) {
+			/* Stall if upstream to too slow. */
+			usbd_ep_stall_set(usbdev, 0x85, 1);
+			trace_usb_buf_size = 0;
+			return;
+		}
+		memcpy(trace_usb_buf + trace_usb_buf_size, buf, len);
+		trace_usb_buf_size += len;
+	}
+}
+
+void trace_buf_drain(usbd_device *dev, uint8_t ep)
+{
+	if (!trace_usb_buf_size)
+		return;
+
+	usbd_ep_write_packet(dev, ep, trace_usb_buf, trace_usb_buf_size);
+	trace_usb_buf_size = 0;
+}
+
+void traceswo_setbaud(uint32_t baud)
+{
+	if (baud)
+		usart_set_baudrate(TRACE_UART, baud);
+}
+
+void traceswo_init(void)
+{
+	TRACE_UART_CLK_EN();
+	TRACE_UART_DMA_CLK_EN();
+	TRACE_UART_PIN_SETUP();
+
+	usart_set_baudrate(TRACE_UART, TRACE_DEFAULT_BAUD);
+	usart_set_databits(TRACE_UART, 8);
+	usart_set_stopbits(TRACE_UART, USART_STOPBITS_1);
+	usart_set_mode(TRACE_UART, USART_MODE_RX);
+	usart_set_parity(TRACE_UART, USART_PARITY_NONE);
+	usart_set_flow_control(TRACE_UART, USART_FLOWCONTROL_NONE);
+
+	dma_channel_reset(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+	dma_set_peripheral_address(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+				   (uint32_t)&USART_DR(TRACE_UART));
+	dma_set_memory_address(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+			       (uint32_t)trace_ring);
+	dma_set_number_of_data(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+			       TRACE_RING_SIZE);
+	dma_set_read_from_peripheral(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+	dma_enable_memory_increment_mode(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+	dma_set_peripheral_size(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+				DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+			    DMA_CCR_MSIZE_8BIT);
+	dma_enable_circular_mode(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+	dma_enable_half_transfer_interrupt(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+	dma_enable_transfer_complete_interrupt(TRACE_UART_DMA,
+					       TRACE_UART_DMA_CHAN);
+	trace_ring_pos = 0;
+	dma_enable_channel(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+
+	/* Bulk data moves from the DMA interrupts; the USART idle-line
+	 * interrupt flushes the tail of a burst promptly.  Same priority
+	 * so they can't preempt each other. */
+	nvic_set_priority(TRACE_UART_DMA_IRQ, IRQ_PRI_TRACE);
+	nvic_enable_irq(TRACE_UART_DMA_IRQ);
+	nvic_set_priority(TRACE_UART_IRQ, IRQ_PRI_TRACE);
+	nvic_enable_irq(TRACE_UART_IRQ);
+	USART_CR1(TRACE_UART) |= USART_CR1_IDLEIE;
+
+	usart_enable_rx_dma(TRACE_UART);
+	usart_enable(TRACE_UART);
+}
+
+/* Push everything the DMA has landed since the last drain */
+static void trace_drain(void)
+{
+	unsigned dma_pos = TRACE_RING_SIZE -
+		DMA_CNDTR(TRACE_UART_DMA, TRACE_UART_DMA_CHAN);
+
+	while (trace_ring_pos != dma_pos) {
+		unsigned len = (dma_pos > trace_ring_pos) ?
+			(dma_pos - trace_ring_pos) :
+			(TRACE_RING_SIZE - trace_ring_pos);
+		if (len > 64)
+			len = 64;
+		trace_buf_push((uint8_t *)&trace_ring[trace_ring_pos], len);
+		trace_ring_pos = (trace_ring_pos + len) % TRACE_RING_SIZE;
+	}
+}
+
+void TRACE_UART_DMA_ISR(void)
+{
+	dma_clear_interrupt_flags(TRACE_UART_DMA, TRACE_UART_DMA_CHAN,
+				  DMA_HTIF | DMA_TCIF);
+	trace_drain();
+}
+
+void TRACE_UART_ISR(void)
+{
+	/* Idle line: the SR read followed by a DR read clears IDLE */
+	(void)USART_SR(TRACE_UART);
+	(void)USART_DR(TRACE_UART);
+	trace_drain();
+}
@@ -21,12 +21,16 @@
 #define __USBDFU_H
 
 #include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/dfu.h>
 
 /* Commands sent with wBlockNum == 0 as per ST implementation. */
 #define CMD_SETADDR	0x21
 #define CMD_ERASE	0x41
 extern uint32_t app_address;
 
+/* DFU functional descriptor, for the negotiated transfer size. */
+extern const struct usb_dfu_descriptor dfu_function;
+
 typedef enum {
     DFU_MODE = 0,
     UPD_MODE = 1
@@ -29,21 +29,91 @@
 
 #include "general.h"
 #include "cdcacm.h"
+#include "tasks.h"
+#include "stats.h"
+#include "usb_fifo.h"
+
+#ifdef USBUSART_DMA
+#include <libopencm3/stm32/dma.h>
+#endif
 
 #define USBUART_TIMER_FREQ_HZ 1000000U /* 1us per tick */
 #define USBUART_RUN_FREQ_HZ 5000U /* 200us (or 100 characters at 2Mbps) */
 
-#define FIFO_SIZE 128
+/* Ring size is overridable from platform.h; boot logs burst at full
+ * line rate, so the default leaves headroom over one USB frame */
+#ifndef USBUART_FIFO_SIZE
+#define USBUART_FIFO_SIZE 512
+#endif
+#define FIFO_SIZE USBUART_FIFO_SIZE
 
 /* RX Fifo buffer */
 static uint8_t buf_rx[FIFO_SIZE];
+#ifdef USBUSART_DMA
+/* With DMA the FIFO is the circular transfer target and the in pointer
+ * is recovered from the DMA counter, so reception needs no interrupts.
+ * The DMA mapping is device specific and comes from the USBUSART_DMA
+ * platform macros; without them the RXNE interrupt fills the FIFO as
+ * before. */
+/* TX double buffer: one packet streaming out by DMA while the USB
+ * callback fills the other.  When both are busy the endpoint is NAKed
+ * until the transfer complete interrupt frees a buffer. */
+static uint8_t buf_tx[2][CDCACM_PACKET_SIZE];
+static uint8_t buf_tx_len[2];
+/* Buffer currently owned by the DMA channel */
+static uint8_t buf_tx_act;
+static bool buf_tx_running;
+static bool buf_tx_pending;
+#else
 /* Fifo in pointer, writes assumed to be atomic, should be only incremented within RX ISR */
-static uint8_t buf_rx_in;
+static uint16_t buf_rx_in;
+#endif
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
-static uint8_t buf_rx_out;
+static uint16_t buf_rx_out;
+#if defined(USBUART_DEBUG) && defined(USBUSART_DMA)
+/* The RX FIFO belongs to the DMA engine, so debug output gets its own
+ * small FIFO, flushed from the timer tick ahead of UART data. */
+static uint8_t buf_dbg[FIFO_SIZE];
+static uint16_t buf_dbg_in;
+static uint16_t buf_dbg_out;
+#endif
 
 static void usbuart_run(void);
 
+/* Optional hardware flow control.  RTS is any free GPIO, driven from
+ * the ring watermarks below (the USART's own RTS only knows about its
+ * one-byte receive buffer); platforms define USBUSART_RTS_PORT/PIN
+ * and configure the pin as an output in UART_PIN_SETUP().  CTS uses
+ * the USART's hardware gating: define USBUSART_CTS and route the CTS
+ * alternate function in UART_PIN_SETUP(). */
+#ifdef USBUSART_RTS_PORT
+#define FIFO_HIGH_WATER		(3 * FIFO_SIZE / 4)
+#define FIFO_LOW_WATER		(FIFO_SIZE / 4)
+
+static void usbuart_rts_update(uint16_t fill)
+{
+	if (fill >= FIFO_HIGH_WATER)
+		gpio_set(USBUSART_RTS_PORT, USBUSART_RTS_PIN);
+	else if (fill <= FIFO_LOW_WATER)
+		gpio_clear(USBUSART_RTS_PORT, USBUSART_RTS_PIN);
+}
+#else
+#define usbuart_rts_update(fill) do { (void)(fill); } while (0)
+#endif
+
+/* The timer tick only paces the pump; the FIFO drain itself runs as a
+ * cooperative task so the USB writes happen in thread context instead
+ * of spinning inside the timer interrupt. */
+static volatile bool uart_tick;
+
+static void usbuart_task(void)
+{
+	if (!uart_tick)
+		return;
+	uart_tick = false;
+	usbuart_run();
+}
+
 void usbuart_init(void)
 {
 	rcc_periph_clock_enable(USBUSART_CLK);
@@ -56,15 +126,59 @@ void usbuart_init(void)
 	usart_set_stopbits(USBUSART, USART_STOPBITS_1);
 	usart_set_mode(USBUSART, USART_MODE_TX_RX);
 	usart_set_parity(USBUSART, USART_PARITY_NONE);
+#ifdef USBUSART_CTS
+	usart_set_flow_control(USBUSART, USART_FLOWCONTROL_CTS);
+#else
 	usart_set_flow_control(USBUSART, USART_FLOWCONTROL_NONE);
+#endif
 
 	/* Finally enable the USART. */
 	usart_enable(USBUSART);
 
+#ifdef USBUSART_DMA
+	USBUSART_DMA_CLK_EN();
+
+	/* RX: circular transfer from the data register into the FIFO */
+	dma_channel_reset(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+	dma_set_peripheral_address(USBUSART_DMA, USBUSART_DMA_RX_CHAN,
+				   (uint32_t)&USART_DR(USBUSART));
+	dma_set_memory_address(USBUSART_DMA, USBUSART_DMA_RX_CHAN,
+			       (uint32_t)buf_rx);
+	dma_set_number_of_data(USBUSART_DMA, USBUSART_DMA_RX_CHAN, FIFO_SIZE);
+	dma_set_read_from_peripheral(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+	dma_enable_memory_increment_mode(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+	dma_set_peripheral_size(USBUSART_DMA, USBUSART_DMA_RX_CHAN,
+				DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(USBUSART_DMA, USBUSART_DMA_RX_CHAN,
+			    DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(USBUSART_DMA, USBUSART_DMA_RX_CHAN,
+			 DMA_CCR_PL_HIGH);
+	dma_enable_circular_mode(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+	dma_enable_channel(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+
+	/* TX: one-shot transfers chained from the USB OUT callback */
+	dma_channel_reset(USBUSART_DMA, USBUSART_DMA_TX_CHAN);
+	dma_set_peripheral_address(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+				   (uint32_t)&USART_DR(USBUSART));
+	dma_set_read_from_memory(USBUSART_DMA, USBUSART_DMA_TX_CHAN);
+	dma_enable_memory_increment_mode(USBUSART_DMA, USBUSART_DMA_TX_CHAN);
+	dma_set_peripheral_size(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+				DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+			    DMA_CCR_MSIZE_8BIT);
+	dma_enable_transfer_complete_interrupt(USBUSART_DMA,
+					       USBUSART_DMA_TX_CHAN);
+	nvic_set_priority(USBUSART_DMA_TX_IRQ, IRQ_PRI_USBUSART);
+	nvic_enable_irq(USBUSART_DMA_TX_IRQ);
+
+	usart_enable_rx_dma(USBUSART);
+	usart_enable_tx_dma(USBUSART);
+#else
 	/* Enable interrupts */
 	USBUSART_CR1 |= USART_CR1_RXNEIE;
 	nvic_set_priority(USBUSART_IRQ, IRQ_PRI_USBUSART);
 	nvic_enable_irq(USBUSART_IRQ);
+#endif
 
 	/* Setup timer for running deferred FIFO processing */
 	USBUSART_TIM_CLK_EN();
@@ -80,10 +194,113 @@ void usbuart_init(void)
 	nvic_set_priority(USBUSART_TIM_IRQ, IRQ_PRI_USBUSART_TIM);
 	nvic_enable_irq(USBUSART_TIM_IRQ);
 
+#ifdef USBUSART_DMA
+	/* No RX interrupt to wake the tick on traffic, so it just runs */
+	timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+#endif
+
 	/* turn the timer on */
 	timer_enable_counter(USBUSART_TIM);
+
+	task_add(usbuart_task);
+}
+
+#ifdef USBUSART_DMA
+/*
+ * Runs deferred processing for usb uart rx, draining the circular DMA
+ * buffer by sending characters to host PC via CDCACM.  The in pointer
+ * is derived from the DMA transfer counter.
+ */
+static void usbuart_run(void)
+{
+	/* Holds the in pointer seen on the previous tick, for idle detection */
+	static uint16_t buf_rx_quiet;
+	uint16_t buf_rx_in = FIFO_SIZE -
+		dma_get_number_of_data(USBUSART_DMA, USBUSART_DMA_RX_CHAN);
+
+	/* The DMA empties the data register, so an overrun here means it
+	 * lost the bus for a full character time: count it as loss */
+	if (USART_SR(USBUSART) & USART_SR_ORE) {
+		STATS_INC(uart_overruns);
+		(void)USART_DR(USBUSART);
+	}
+	usbuart_rts_update((uint16_t)(buf_rx_in - buf_rx_out) % FIFO_SIZE);
+
+	/* forcibly empty fifo if no USB endpoint */
+	if (cdcacm_get_config() != 1)
+	{
+		buf_rx_out = buf_rx_in;
+		return;
+	}
+
+#ifdef USBUART_DEBUG
+	/* flush debug output ahead of UART data; it is rare and small */
+	if (buf_dbg_in != buf_dbg_out)
+	{
+		uint8_t packet_buf[CDCACM_PACKET_SIZE];
+		unsigned buf_out = buf_dbg_out;
+		unsigned packet_size = usb_fifo_take(buf_dbg, FIFO_SIZE,
+						     buf_dbg_in, &buf_out,
+						     packet_buf,
+						     CDCACM_PACKET_SIZE);
+
+		asm volatile ("cpsid i; isb");
+		buf_dbg_out += usbd_ep_write_packet(usbdev,
+				CDCACM_UART_ENDPOINT, packet_buf, packet_size);
+		buf_dbg_out %= FIFO_SIZE;
+		asm volatile ("cpsie i; isb");
+		return;
+	}
+#endif
+
+	/* if fifo empty, nothing further to do */
+	if (buf_rx_in == buf_rx_out) {
+		/* turn off LED */
+		gpio_clear(LED_PORT_UART, LED_UART);
+		return;
+	}
+
+	gpio_set(LED_PORT_UART, LED_UART);
+
+	/* Adaptive latency: while characters are still streaming in, hold
+	 * off until a full packet accumulates; flush partial packets only
+	 * once the line has been quiet for a whole tick. */
+	uint16_t avail = (uint16_t)(buf_rx_in - buf_rx_out) % FIFO_SIZE;
+	if ((avail < CDCACM_PACKET_SIZE) && (buf_rx_in != buf_rx_quiet))
+	{
+		buf_rx_quiet = buf_rx_in;
+		return;
+	}
+
+	uint8_t packet_buf[CDCACM_PACKET_SIZE];
+	unsigned buf_out = buf_rx_out;
+
+	/* copy from uart FIFO into local usb packet buffer */
+	unsigned packet_size = usb_fifo_take(buf_rx, FIFO_SIZE, buf_rx_in,
+					     &buf_out, packet_buf,
+					     CDCACM_PACKET_SIZE);
+
+	/* advance fifo out pointer by amount written */
+	asm volatile ("cpsid i; isb");
+	buf_rx_out += usbd_ep_write_packet(usbdev,
+			CDCACM_UART_ENDPOINT, packet_buf, packet_size);
+	buf_rx_out %= FIFO_SIZE;
+	asm volatile ("cpsie i; isb");
 }
 
+/* Hand the active TX buffer to the DMA channel.  Called with the DMA
+ * interrupt masked, or from the handler itself. */
+static void usbuart_dma_tx_start(void)
+{
+	dma_disable_channel(USBUSART_DMA, USBUSART_DMA_TX_CHAN);
+	dma_set_memory_address(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+			       (uint32_t)buf_tx[buf_tx_act]);
+	dma_set_number_of_data(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+			       buf_tx_len[buf_tx_act]);
+	buf_tx_running = true;
+	dma_enable_channel(USBUSART_DMA, USBUSART_DMA_TX_CHAN);
+}
+#else
 /*
  * Runs deferred processing for usb uart rx, draining RX FIFO by sending
  * characters to host PC via CDCACM.  Allowed to read from FIFO in pointer,
@@ -97,6 +314,8 @@ static void usbuart_run(void)
 		buf_rx_out = buf_rx_in;
 	}
 
+	usbuart_rts_update((uint16_t)(buf_rx_in - buf_rx_out) % FIFO_SIZE);
+
 	/* if fifo empty, nothing further to do */
 	if (buf_rx_in == buf_rx_out) {
 		/* turn off LED, disable IRQ */
@@ -106,28 +325,23 @@ static void usbuart_run(void)
 	else
 	{
 		uint8_t packet_buf[CDCACM_PACKET_SIZE];
-		uint8_t packet_size = 0;
-		uint8_t buf_out = buf_rx_out;
+		unsigned buf_out = buf_rx_out;
 
 		/* copy from uart FIFO into local usb packet buffer */
-		while (buf_rx_in != buf_out && packet_size < CDCACM_PACKET_SIZE)
-		{
-			packet_buf[packet_size++] = buf_rx[buf_out++];
-
-			/* wrap out pointer */
-			if (buf_out >= FIFO_SIZE)
-			{
-				buf_out = 0;
-			}
-
-		}
+		unsigned packet_size = usb_fifo_take(buf_rx, FIFO_SIZE,
+						     buf_rx_in, &buf_out,
+						     packet_buf,
+						     CDCACM_PACKET_SIZE);
 
 		/* advance fifo out pointer by amount written */
+		asm volatile ("cpsid i; isb");
 		buf_rx_out += usbd_ep_write_packet(usbdev,
 				CDCACM_UART_ENDPOINT, packet_buf, packet_size);
 		buf_rx_out %= FIFO_SIZE;
+		asm volatile ("cpsie i; isb");
 	}
 }
+#endif
 
 void usbuart_set_line_coding(struct usb_cdc_line_coding *coding)
 {
@@ -167,6 +381,39 @@ void usbuart_usb_out_cb(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
 
+#ifdef USBUSART_DMA
+	/* Mask the completion interrupt so the running/pending handoff
+	 * below can't race it. */
+	nvic_disable_irq(USBUSART_DMA_TX_IRQ);
+
+	uint8_t next = buf_tx_running ? !buf_tx_act : buf_tx_act;
+	int len = usbd_ep_read_packet(dev, CDCACM_UART_ENDPOINT,
+					buf_tx[next], CDCACM_PACKET_SIZE);
+
+#if defined(BLACKMAGIC)
+	/* Don't bother if uart is disabled.
+	 * This will be the case on mini while we're being debugged.
+	 */
+	if(!(RCC_APB2ENR & RCC_APB2ENR_USART1EN))
+		len = 0;
+#endif
+
+	if (len) {
+		gpio_set(LED_PORT_UART, LED_UART);
+		buf_tx_len[next] = len;
+		if (!buf_tx_running) {
+			buf_tx_act = next;
+			usbuart_dma_tx_start();
+		} else {
+			/* Both buffers in flight: hold off the host until
+			 * the DMA completion chains this one */
+			buf_tx_pending = true;
+			usbd_ep_nak_set(dev, CDCACM_UART_ENDPOINT, 1);
+		}
+	}
+
+	nvic_enable_irq(USBUSART_DMA_TX_IRQ);
+#else
 	char buf[CDCACM_PACKET_SIZE];
 	int len = usbd_ep_read_packet(dev, CDCACM_UART_ENDPOINT,
 					buf, CDCACM_PACKET_SIZE);
@@ -183,11 +430,22 @@ void usbuart_usb_out_cb(usbd_device *dev, uint8_t ep)
 	for(int i = 0; i < len; i++)
 		usart_send_blocking(USBUSART, buf[i]);
 	gpio_clear(LED_PORT_UART, LED_UART);
+#endif
 }
 
 #ifdef USBUART_DEBUG
 int usbuart_debug_write(const char *buf, size_t len)
 {
+#ifdef USBUSART_DMA
+	for (size_t i = 0; i < len; i++) {
+		if (buf[i] == '\n') {
+			buf_dbg[buf_dbg_in++] = '\r';
+			buf_dbg_in %= FIFO_SIZE;
+		}
+		buf_dbg[buf_dbg_in++] = buf[i];
+		buf_dbg_in %= FIFO_SIZE;
+	}
+#else
 	for (size_t i = 0; i < len; i++) {
 		if (buf[i] == '\n') {
 			buf_rx[buf_rx_in++] = '\r';
@@ -198,6 +456,7 @@ int usbuart_debug_write(const char *buf, size_t len)
 	}
 	/* enable deferred processing if we put data in the FIFO */
 	timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+#endif
 	return len;
 }
 #endif
@@ -206,8 +465,33 @@ void usbuart_usb_in_cb(usbd_device *dev, uint8_t ep)
 {
 	(void) dev;
 	(void) ep;
+
+	/* A packet just completed: pend the drain tick now rather than
+	 * waiting out the timer period, so a backlog streams to the host
+	 * at bus rate.  Everything still goes through the tick ISR, which
+	 * keeps FIFO access single-threaded. */
+	timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+	timer_generate_event(USBUSART_TIM, TIM_EGR_UG);
 }
 
+#ifdef USBUSART_DMA
+void USBUSART_DMA_TX_ISR(void)
+{
+	dma_clear_interrupt_flags(USBUSART_DMA, USBUSART_DMA_TX_CHAN,
+				  DMA_TCIF);
+
+	if (buf_tx_pending) {
+		/* chain the parked packet and let the host send more */
+		buf_tx_pending = false;
+		buf_tx_act ^= 1;
+		usbuart_dma_tx_start();
+		usbd_ep_nak_set(usbdev, CDCACM_UART_ENDPOINT, 0);
+	} else {
+		buf_tx_running = false;
+		gpio_clear(LED_PORT_UART, LED_UART);
+	}
+}
+#else
 /*
  * Read a character from the UART RX and stuff it in a software FIFO.
  * Allowed to read from FIFO out pointer, but not write to it.
@@ -217,8 +501,11 @@ void USBUSART_ISR(void)
 {
 	uint32_t err = USART_SR(USBUSART);
 	char c = usart_recv(USBUSART);
-	if (err & (USART_SR_ORE | USART_SR_FE))
+	if (err & (USART_SR_ORE | USART_SR_FE)) {
+		if (err & USART_SR_ORE)
+			STATS_INC(uart_overruns);
 		return;
+	}
 
 	/* Turn on LED */
 	gpio_set(LED_PORT_UART, LED_UART);
@@ -239,14 +526,22 @@ void USBUSART_ISR(void)
 
 		/* enable deferred processing if we put data in the FIFO */
 		timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+
+		usbuart_rts_update((uint16_t)(buf_rx_in - buf_rx_out) %
+		                   FIFO_SIZE);
+	}
+	else
+	{
+		STATS_INC(uart_drops);
 	}
 }
+#endif
 
 void USBUSART_TIM_ISR(void)
 {
 	/* need to clear timer update event */
 	timer_clear_flag(USBUSART_TIM, TIM_SR_UIF);
 
-	/* process FIFO */
-	usbuart_run();
+	/* have the task process the FIFO at the next yield point */
+	uart_tick = true;
 }
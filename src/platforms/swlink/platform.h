@@ -29,6 +29,12 @@
 #include "timing_stm32.h"
 #include "version.h"
 
+/* Sequence loops come from common/swdptap.c and stm32/jtagtap.c */
+#define PLATFORM_HAS_NATIVE_SWD_SEQ
+#define PLATFORM_HAS_NATIVE_JTAG_SEQ
+
+#define PLATFORM_HAS_TRACESWO
+
 #define BOARD_IDENT            "Black Magic Probe (SWLINK), (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_DFU	       "Black Magic (Upgrade), STM8S Discovery, (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_UPD	       "Black Magic (DFU Upgrade), STM8S Discovery, (Firmware " FIRMWARE_VERSION ")"
@@ -51,6 +57,8 @@
 #define SWCLK_PORT 	TCK_PORT
 #define SWDIO_PIN	TMS_PIN
 #define SWCLK_PIN	TCK_PIN
+/* SWDIO and SWCLK share a port: enables the fused BSRR bit cell */
+#define SWD_PORT_SHARED
 
 #define LED_PORT	GPIOA
 #define LED_IDLE_RUN    GPIO8
@@ -98,13 +106,28 @@
 #define USBUSART_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM4)
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
 #define USBUSART_TIM_ISR tim4_isr
-
+/* USART1: TX on DMA1 channel 4, RX on channel 5 */
+#define USBUSART_DMA DMA1
+#define USBUSART_DMA_CLK_EN() rcc_periph_clock_enable(RCC_DMA1)
+#define USBUSART_DMA_RX_CHAN DMA_CHANNEL5
+#define USBUSART_DMA_TX_CHAN DMA_CHANNEL4
+#define USBUSART_DMA_TX_IRQ NVIC_DMA1_CHANNEL4_IRQ
+#define USBUSART_DMA_TX_ISR dma1_channel4_isr
+
+/* SWO comes in on TDO/PB3, which the TIM2 partial remap puts on CH2,
+ * hence the TI2 capture input.  No TRACE_DMA: the TIM2_CH1 capture
+ * request shares DMA1 channel 5 with USART1 RX, which the USB-UART
+ * owns, so capture runs from the CC1 interrupt. */
 #define TRACE_TIM TIM2
 #define TRACE_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM2)
 #define TRACE_IRQ   NVIC_TIM2_IRQ
 #define TRACE_ISR   tim2_isr
 #define TRACE_IC_IN TIM_IC_IN_TI2
 #define TRACE_TRIG_IN TIM_SMCR_TS_IT1FP2
+/* The TI2FP2 trigger follows CH2's polarity, so CH2 must take the
+ * rising (cycle) capture for the slave reset to fire on the rising
+ * edge; CH1 takes the falling (high time) one. */
+#define TRACE_CC_SWAPPED
 
 #define DEBUG(...)
 
@@ -68,6 +68,25 @@ void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
 	usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 0);
 }
 
+int gdb_if_read(void *buf, int maxlen)
+{
+	uint8_t *p = buf;
+	int n = 0;
+
+	while(tail_out == head_out) {
+		/* Detach if port closed */
+		if(!cdcacm_get_dtr())
+			return -1;
+
+		while(cdcacm_get_config() != 1);
+	}
+
+	while((tail_out != head_out) && (n < maxlen))
+		p[n++] = buffer_out[tail_out++ % sizeof(buffer_out)];
+
+	return n;
+}
+
 unsigned char gdb_if_getchar(void)
 {
 
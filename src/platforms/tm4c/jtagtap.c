@@ -41,3 +41,68 @@ jtagtap_next(const uint8_t dTMS, const uint8_t dTDI)
 	return ret != 0;
 }
 
+/* Native sequence loops, replacing the per-bit generics from
+ * jtagtap_generic.c (see PLATFORM_HAS_NATIVE_JTAG_SEQ in platform.h).
+ * TMS only changes on the final bit of a shift, so holding it and
+ * driving the GPIO accessors in one loop removes a function call and
+ * two branches per TCK cycle. */
+
+void
+jtagtap_tms_seq(uint32_t MS, int ticks)
+{
+	gpio_set(TDI_PORT, TDI_PIN);
+	while (ticks--) {
+		gpio_set_val(TMS_PORT, TMS_PIN, MS & 1);
+		gpio_set(TCK_PORT, TCK_PIN);
+		MS >>= 1;
+		gpio_clear(TCK_PORT, TCK_PIN);
+	}
+}
+
+void
+jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms,
+                    const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+
+	if (!ticks)
+		return;
+	gpio_clear(TMS_PORT, TMS_PIN);
+	while (ticks--) {
+		if (!ticks)
+			gpio_set_val(TMS_PORT, TMS_PIN, final_tms);
+		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
+		gpio_set(TCK_PORT, TCK_PIN);
+		if (gpio_get(TDO_PORT, TDO_PIN))
+			*DO |= index;
+		else
+			*DO &= ~index;
+		gpio_clear(TCK_PORT, TCK_PIN);
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++; DO++;
+		}
+	}
+}
+
+void
+jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+
+	if (!ticks)
+		return;
+	gpio_clear(TMS_PORT, TMS_PIN);
+	while (ticks--) {
+		if (!ticks)
+			gpio_set_val(TMS_PORT, TMS_PIN, final_tms);
+		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
+		gpio_set(TCK_PORT, TCK_PIN);
+		gpio_clear(TCK_PORT, TCK_PIN);
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++;
+		}
+	}
+}
+
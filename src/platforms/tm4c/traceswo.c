@@ -29,6 +29,7 @@
 
 #include "general.h"
 #include "cdcacm.h"
+#include "tasks.h"
 
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/lm4f/rcc.h>
@@ -36,6 +37,8 @@
 #include <libopencm3/lm4f/uart.h>
 #include <libopencm3/usb/usbd.h>
 
+static void trace_task(void);
+
 void traceswo_init(void)
 {
 	periph_clock_enable(RCC_GPIOD);
@@ -57,9 +60,9 @@ void traceswo_init(void)
 	// Enable FIFO
 	uart_enable_fifo(TRACEUART);
 
-	// Set FIFO interrupt trigger levels to 4/8 full for RX buffer and
-	// 7/8 empty (1/8 full) for TX buffer
-	uart_set_fifo_trigger_levels(TRACEUART, UART_FIFO_RX_TRIG_1_2, UART_FIFO_TX_TRIG_7_8);
+	// Take whole bursts per interrupt: trigger at 7/8 full and let the
+	// receive timeout cover the tail of a frame
+	uart_set_fifo_trigger_levels(TRACEUART, UART_FIFO_RX_TRIG_7_8, UART_FIFO_TX_TRIG_7_8);
 
 	uart_clear_interrupt_flag(TRACEUART, UART_INT_RX | UART_INT_RT);
 
@@ -76,6 +79,19 @@ void traceswo_init(void)
 	usbd_ep_stall_set(usbdev, 0x85, 0);
 
 	gpio_mode_setup(GPIOD, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO3);
+
+	/* The ring drains from task context so the USB writes stay out of
+	 * the interrupt handlers */
+	task_add(trace_task);
+}
+
+void traceswo_setbaud(uint32_t baud)
+{
+	if (!baud)
+		return;
+	uart_disable(TRACEUART);
+	uart_set_baudrate(TRACEUART, baud);
+	uart_enable(TRACEUART);
 }
 
 void traceswo_baud(unsigned int baud)
@@ -84,7 +100,12 @@ void traceswo_baud(unsigned int baud)
 	uart_set_databits(TRACEUART, 8);
 }
 
-#define FIFO_SIZE 256
+/* Ring size is overridable from platform.h; a deep ring rides out the
+ * stretches where the wire-wait loops don't yield */
+#ifndef TRACESWO_FIFO_SIZE
+#define TRACESWO_FIFO_SIZE 1024
+#endif
+#define FIFO_SIZE TRACESWO_FIFO_SIZE
 
 /* RX Fifo buffer */
 static volatile uint8_t buf_rx[FIFO_SIZE];
@@ -92,15 +113,19 @@ static volatile uint8_t buf_rx[FIFO_SIZE];
 static volatile uint32_t buf_rx_in = 0;
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
 static volatile uint32_t buf_rx_out = 0;
+/* Set by the receive-timeout interrupt (line idle) or on ring overflow:
+ * push out a partial packet instead of waiting for a full one */
+static volatile bool trace_flush_pending;
 
-void trace_buf_push(void)
+static void trace_buf_push(void)
 {
 	size_t len;
+	uint32_t in = buf_rx_in;
 
-	if (buf_rx_in == buf_rx_out) {
+	if (in == buf_rx_out) {
 		return;
-	} else if (buf_rx_in > buf_rx_out) {
-		len = buf_rx_in - buf_rx_out;
+	} else if (in > buf_rx_out) {
+		len = in - buf_rx_out;
 	} else {
 		len = FIFO_SIZE - buf_rx_out;
 	}
@@ -109,27 +134,54 @@ void trace_buf_push(void)
 		len = 64;
 	}
 
+	/* Called from task context too, so keep the USB stack single
+	 * threaded while the packet is handed over */
+	asm volatile ("cpsid i; isb");
 	if (usbd_ep_write_packet(usbdev, 0x85, (uint8_t *)&buf_rx[buf_rx_out], len) == len) {
 		buf_rx_out += len;
 		buf_rx_out %= FIFO_SIZE;
 	}
+	asm volatile ("cpsie i; isb");
 }
 
 void trace_buf_drain(usbd_device *dev, uint8_t ep)
 {
 	(void) dev;
 	(void) ep;
+	/* A packet just completed: chain the next one straight from the
+	 * endpoint callback so a backlog streams at bus rate */
 	trace_buf_push();
 }
 
 void trace_tick(void)
 {
+	/* Periodic safety net from the system tick: don't touch the USB
+	 * stack from here, just make sure the task flushes a stale tail */
+	trace_flush_pending = true;
+}
+
+/* Drain the ring towards the host.  Runs in task context; full packets
+ * go as soon as they accumulate, partial packets once the line has gone
+ * idle. */
+static void trace_task(void)
+{
+	uint32_t in = buf_rx_in;
+
+	if (in == buf_rx_out)
+		return;
+
+	size_t avail = (in - buf_rx_out) % FIFO_SIZE;
+	if ((avail < 64) && !trace_flush_pending)
+		return;
+	trace_flush_pending = false;
+
 	trace_buf_push();
 }
 
 void TRACEUART_ISR(void)
 {
-	uint32_t flush = uart_is_interrupt_source(TRACEUART, UART_INT_RT);
+	if (uart_is_interrupt_source(TRACEUART, UART_INT_RT))
+		trace_flush_pending = true;
 
 	while (!uart_is_rx_fifo_empty(TRACEUART)) {
 		uint32_t c = uart_recv(TRACEUART);
@@ -142,20 +194,15 @@ void TRACEUART_ISR(void)
 			/* insert into FIFO */
 			buf_rx[buf_rx_in++] = c;
 
-			/* wrap out pointer */
+			/* wrap in pointer */
 			if (buf_rx_in >= FIFO_SIZE)
 			{
 				buf_rx_in = 0;
 			}
 		} else {
-			flush = 1;
+			/* ring full: have the task make room */
+			trace_flush_pending = true;
 			break;
 		}
 	}
-
-	if (flush) {
-		/* advance fifo out pointer by amount written */
-		trace_buf_push();
-	}
 }
-
@@ -21,6 +21,8 @@
  */
 #include "general.h"
 #include "cdcacm.h"
+#include "tasks.h"
+#include "usb_fifo.h"
 
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scs.h>
@@ -29,22 +31,32 @@
 #include <libopencm3/lm4f/rcc.h>
 #include <libopencm3/lm4f/uart.h>
 
-#define FIFO_SIZE 128
+/* Ring size is overridable from platform.h; boot logs burst at full
+ * line rate, so the default leaves headroom over one USB frame */
+#ifndef USBUART_FIFO_SIZE
+#define USBUART_FIFO_SIZE 512
+#endif
+#define FIFO_SIZE USBUART_FIFO_SIZE
 
 /* RX Fifo buffer */
 static uint8_t buf_rx[FIFO_SIZE];
 /* Fifo in pointer, writes assumed to be atomic, should be only incremented within RX ISR */
-static uint8_t buf_rx_in;
+static volatile uint16_t buf_rx_in;
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
-static uint8_t buf_rx_out;
+static uint16_t buf_rx_out;
+/* Set by the receive-timeout interrupt: the line went idle with a
+ * partial packet in the ring, so flush it instead of waiting for more */
+static volatile bool uart_idle_flush;
+
+static void usbuart_task(void);
 
 void usbuart_init(void)
 {
 	UART_PIN_SETUP();
-	
+
 	periph_clock_enable(USBUART_CLK);
 	__asm__("nop"); __asm__("nop"); __asm__("nop");
-	
+
 	uart_disable(USBUART);
 
 	/* Setup UART parameters. */
@@ -57,20 +69,25 @@ void usbuart_init(void)
 	// Enable FIFO
 	uart_enable_fifo(USBUART);
 
-	// Set FIFO interrupt trigger levels to 1/8 full for RX buffer and
-	// 7/8 empty (1/8 full) for TX buffer
-	uart_set_fifo_trigger_levels(USBUART, UART_FIFO_RX_TRIG_1_8, UART_FIFO_TX_TRIG_7_8);
+	// Take whole bursts per interrupt: trigger at 7/8 full and let the
+	// receive timeout cover the tail, instead of interrupting every
+	// other character at the 1/8 trigger
+	uart_set_fifo_trigger_levels(USBUART, UART_FIFO_RX_TRIG_7_8, UART_FIFO_TX_TRIG_7_8);
 
 	uart_clear_interrupt_flag(USBUART, UART_INT_RX | UART_INT_RT);
 
 	/* Enable interrupts */
-	uart_enable_interrupts(UART0, UART_INT_RX| UART_INT_RT);
+	uart_enable_interrupts(USBUART, UART_INT_RX | UART_INT_RT);
 
 	/* Finally enable the USART. */
 	uart_enable(USBUART);
 
 	//nvic_set_priority(USBUSART_IRQ, IRQ_PRI_USBUSART);
 	nvic_enable_irq(USBUART_IRQ);
+
+	/* The ring drains from task context so the USB writes stay out of
+	 * the interrupt handlers */
+	task_add(usbuart_task);
 }
 
 void usbuart_set_line_coding(struct usb_cdc_line_coding *coding)
@@ -119,13 +136,57 @@ void usbuart_usb_in_cb(usbd_device *dev, uint8_t ep)
 }
 
 /*
- * Read a character from the UART RX and stuff it in a software FIFO.
+ * Drain the ring towards the host.  Runs in task context, so the USB
+ * stack isn't entered from the UART interrupt.  Full packets go as soon
+ * as they accumulate; partial packets wait for the receive-timeout
+ * interrupt, which is the hardware's own line-idle detection.
+ */
+static void usbuart_task(void)
+{
+	uint16_t buf_in = buf_rx_in;
+
+	/* forcibly empty fifo if no USB endpoint */
+	if (cdcacm_get_config() != 1)
+	{
+		buf_rx_out = buf_in;
+		uart_idle_flush = false;
+		return;
+	}
+
+	/* if fifo empty, nothing further to do */
+	if (buf_in == buf_rx_out)
+		return;
+
+	uint16_t avail = (uint16_t)(buf_in - buf_rx_out) % FIFO_SIZE;
+	if ((avail < CDCACM_PACKET_SIZE) && !uart_idle_flush)
+		return;
+	uart_idle_flush = false;
+
+	uint8_t packet_buf[CDCACM_PACKET_SIZE];
+	unsigned buf_out = buf_rx_out;
+
+	/* copy from uart FIFO into local usb packet buffer */
+	unsigned packet_size = usb_fifo_take(buf_rx, FIFO_SIZE, buf_in,
+					     &buf_out, packet_buf,
+					     CDCACM_PACKET_SIZE);
+
+	/* advance fifo out pointer by amount written */
+	asm volatile ("cpsid i; isb");
+	buf_rx_out += usbd_ep_write_packet(usbdev,
+			CDCACM_UART_ENDPOINT, packet_buf, packet_size);
+	buf_rx_out %= FIFO_SIZE;
+	asm volatile ("cpsie i; isb");
+}
+
+/*
+ * Move whatever the hardware FIFO holds into the software ring.
  * Allowed to read from FIFO out pointer, but not write to it.
  * Allowed to write to FIFO in pointer.
  */
 void USBUART_ISR(void)
 {
-	int flush = uart_is_interrupt_source(USBUART, UART_INT_RT);
+	if (uart_is_interrupt_source(USBUART, UART_INT_RT))
+		uart_idle_flush = true;
 
 	while (!uart_is_rx_fifo_empty(USBUART)) {
 		char c = uart_recv(USBUART);
@@ -138,45 +199,15 @@ void USBUART_ISR(void)
 			/* insert into FIFO */
 			buf_rx[buf_rx_in++] = c;
 
-			/* wrap out pointer */
+			/* wrap in pointer */
 			if (buf_rx_in >= FIFO_SIZE)
 			{
 				buf_rx_in = 0;
 			}
 		} else {
-			flush = 1;
+			/* ring full: drop the character, have the task make
+			 * room as soon as it runs */
+			uart_idle_flush = true;
 		}
 	}
-
-	if (flush) {
-		/* forcibly empty fifo if no USB endpoint */
-		if (cdcacm_get_config() != 1)
-		{
-			buf_rx_out = buf_rx_in;
-			return;
-		}
-
-		uint8_t packet_buf[CDCACM_PACKET_SIZE];
-		uint8_t packet_size = 0;
-		uint8_t buf_out = buf_rx_out;
-
-		/* copy from uart FIFO into local usb packet buffer */
-		while (buf_rx_in != buf_out && packet_size < CDCACM_PACKET_SIZE)
-		{
-			packet_buf[packet_size++] = buf_rx[buf_out++];
-
-			/* wrap out pointer */
-			if (buf_out >= FIFO_SIZE)
-			{
-				buf_out = 0;
-			}
-
-		}
-
-		/* advance fifo out pointer by amount written */
-		buf_rx_out += usbd_ep_write_packet(usbdev,
-				CDCACM_UART_ENDPOINT, packet_buf, packet_size);
-		buf_rx_out %= FIFO_SIZE;
-	}
 }
-
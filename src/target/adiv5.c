@@ -0,0 +1,962 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements the transport generic functions of the
+ * ARM Debug Interface v5 Architecure Specification, ARM doc IHI0031A.
+ */
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+#include "adiv5.h"
+#include "cortexm.h"
+#include "exception.h"
+#include "stats.h"
+#include "tasks.h"
+
+#ifndef DO_RESET_SEQ
+#define DO_RESET_SEQ 0
+#endif
+
+/* All this should probably be defined in a dedicated ADIV5 header, so that they
+ * are consistently named and accessible when needed in the codebase.
+ */
+
+/* ROM table CIDR values */
+#define CIDR0_OFFSET    0xFF0 /* DBGCID0 */
+#define CIDR1_OFFSET    0xFF4 /* DBGCID1 */
+#define CIDR2_OFFSET    0xFF8 /* DBGCID2 */
+#define CIDR3_OFFSET    0xFFC /* DBGCID3 */
+
+/* Component class ID register can be broken down into the following logical
+ * interpretation of the 32bit value consisting of the least significant bytes
+ * of the 4 CID registers:
+ * |7   ID3 reg   0|7   ID2 reg   0|7   ID1 reg   0|7   ID0 reg   0|
+ * |1|0|1|1|0|0|0|1|0|0|0|0|0|1|0|1| | | | |0|0|0|0|0|0|0|0|1|1|0|1|
+ * |31           24|23           16|15   12|11     |              0|
+ * \_______________ ______________/\___ __/\___________ ___________/
+ *                 V                   V               V
+ *             Preamble            Component       Preamble
+ *                                   Class
+ * \_______________________________ _______________________________/
+ *                                 V
+ *                           Component ID
+ */
+#define CID_PREAMBLE    0xB105000D
+#define CID_CLASS_MASK  0x0000F000
+#define CID_CLASS_SHIFT 12
+/* The following enum is based on the Component Class value table 13-3 of the
+ * ADIv5 standard.
+ */
+enum cid_class {
+	cidc_gvc = 0x0,    /* Generic verification component*/
+	cidc_romtab = 0x1, /* ROM Table, std. layout (ADIv5 Chapter 14) */
+	/* 0x2 - 0x8 */    /* Reserved */
+	cidc_dc = 0x9,     /* Debug component, std. layout (CoreSight Arch. Spec.) */
+	/* 0xA */          /* Reserved */
+	cidc_ptb = 0xB,    /* Peripheral Test Block (PTB) */
+	/* 0xC */          /* Reserved */
+	cidc_dess = 0xD,   /* OptimoDE Data Engine SubSystem (DESS) component */
+	cidc_gipc = 0xE,   /* Generic IP Component */
+	cidc_pcp = 0xF,    /* PrimeCell peripheral */
+	cidc_unknown = 0x10
+};
+
+#ifdef PLATFORM_HAS_DEBUG
+/* The reserved ones only have an R in them, to save a bit of space. */
+static const char * const cidc_debug_strings[] =
+{
+	[cidc_gvc] =     "Generic verification component",           /* 0x0 */
+	[cidc_romtab] =  "ROM Table",                                /* 0x1 */
+	[0x2 ... 0x8] =  "R",                                        /* 0x2 - 0x8 */
+	[cidc_dc] =      "Debug component",                          /* 0x9 */
+	[0xA] =          "R",                                        /* 0xA */
+	[cidc_ptb] =     "Peripheral Test Block",                    /* 0xB */
+	[0xC] =          "R",                                        /* 0xC */
+	[cidc_dess] =    "OptimoDE Data Engine SubSystem component", /* 0xD */
+	[cidc_gipc] =    "Generic IP component",                     /* 0xE */
+	[cidc_pcp] =     "PrimeCell peripheral",                     /* 0xF */
+	[cidc_unknown] = "Unknown component class"                   /* 0x10 */
+};
+#endif
+
+#define PIDR0_OFFSET  0xFE0 /* DBGPID0 */
+#define PIDR1_OFFSET  0xFE4 /* DBGPID1 */
+#define PIDR2_OFFSET  0xFE8 /* DBGPID2 */
+#define PIDR3_OFFSET  0xFEC /* DBGPID3 */
+#define PIDR4_OFFSET  0xFD0 /* DBGPID4 */
+#define PIDR5_OFFSET  0xFD4 /* DBGPID5 (Reserved) */
+#define PIDR6_OFFSET  0xFD8 /* DBGPID6 (Reserved) */
+#define PIDR7_OFFSET  0xFDC /* DBGPID7 (Reserved) */
+#define PIDR_REV_MASK 0x0FFF00000ULL /* Revision bits. */
+#define PIDR_PN_MASK  0x000000FFFULL /* Part number bits. */
+#define PIDR_ARM_BITS 0x4000BB000ULL /* These make up the ARM JEP-106 code. */
+
+enum arm_arch {
+	aa_nosupport,
+	aa_cortexm,
+	aa_cortexa,
+	aa_end
+};
+
+#ifdef PLATFORM_HAS_DEBUG
+#define PIDR_PN_BIT_STRINGS(...) __VA_ARGS__
+#else
+#define PIDR_PN_BIT_STRINGS(...)
+#endif
+
+/* The part number list was adopted from OpenOCD:
+ * https://sourceforge.net/p/openocd/code/ci/406f4/tree/src/target/arm_adi_v5.c#l932
+ *
+ * The product ID register consists of several parts. For a full description
+ * refer to ARM Debug Interface v5 Architecture Specification. Based on the
+ * document the pidr is 64 bit long and has the following interpratiation:
+ * |7   ID7 reg   0|7   ID6 reg   0|7   ID5 reg   0|7   ID4 reg   0|
+ * |0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0|0| | | | |1|0|0|0|
+ * |63           56|55           48|47           40|39   36|35   32|
+ * \_______________________ ______________________/\___ __/\___ ___/
+ *                         V                           V       V
+ *                    Reserved, RAZ                   4KB      |
+ *                                                   count     |
+ *                                                          JEP-106
+ *                                                     Continuation Code
+ *
+ * |7   ID3 reg   0|7   ID2 reg   0|7   ID1 reg   0|7   ID0 reg   0|
+ * | | | | | | | | | | | | |1|0|1|1|1|0|1|1| | | | | | | | | | | | |
+ * |31   28|27   24|23   20|||18   |     12|11     |              0|
+ * \___ __/\__ ___/\___ __/ |\______ _____/\___________ ___________/
+ *     V      V        V    |       V                  V
+ *  RevAnd    |    Revision |    JEP-106          Part number
+ *            |             |    ID code
+ *        Customer          19
+ *        modified          `- JEP-106 code is used
+ *
+ * JEP-106 is a JEDEC standard assigning manufacturer IDs to different
+ * manufacturers in case of ARM the full code consisting of the JEP-106
+ * Continuation code followed by the code used bit and the JEP-106 code itself
+ * results in the code 0x4BB. These are the bits filled in the above bit table.
+ *
+ * We left out some of the Part numbers included in OpenOCD, we only include
+ * the ones that have ARM as the designer.
+ */
+static const struct {
+	uint16_t part_number;
+	enum arm_arch arch;
+	enum cid_class cidc;
+#ifdef PLATFORM_HAS_DEBUG
+	const char *type;
+	const char *full;
+#endif
+} pidr_pn_bits[] = {
+	{0x000, aa_cortexm,   cidc_gipc,    PIDR_PN_BIT_STRINGS("Cortex-M3 SCS",  "(System Control Space)")},
+	{0x001, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M3 ITM",  "(Instrumentation Trace Module)")},
+	{0x002, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M3 DWT",  "(Data Watchpoint and Trace)")},
+	{0x003, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M3 FBP",  "(Flash Patch and Breakpoint)")},
+	{0x008, aa_cortexm,   cidc_gipc,    PIDR_PN_BIT_STRINGS("Cortex-M0 SCS",  "(System Control Space)")},
+	{0x00a, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M0 DWT",  "(Data Watchpoint and Trace)")},
+	{0x00b, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M0 BPU",  "(Breakpoint Unit)")},
+	{0x00c, aa_cortexm,   cidc_gipc,    PIDR_PN_BIT_STRINGS("Cortex-M4 SCS",  "(System Control Space)")},
+	{0x00d, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight ETM11", "(Embedded Trace)")},
+	{0x490, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A15 GIC", "(Generic Interrupt Controller)")},
+	{0x4c7, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M7 PPB",  "(Private Peripheral Bus ROM Table)")},
+	{0x906, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight CTI",  "(Cross Trigger)")},
+	{0x907, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight ETB",  "(Trace Buffer)")},
+	{0x908, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight CSTF", "(Trace Funnel)")},
+	{0x910, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight ETM9", "(Embedded Trace)")},
+	{0x912, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight TPIU", "(Trace Port Interface Unit)")},
+	{0x913, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight ITM",  "(Instrumentation Trace Macrocell)")},
+	{0x914, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight SWO",  "(Single Wire Output)")},
+	{0x917, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight HTM",  "(AHB Trace Macrocell)")},
+	{0x920, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight ETM11", "(Embedded Trace)")},
+	{0x921, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A8 ETM",  "(Embedded Trace)")},
+	{0x922, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A8 CTI",  "(Cross Trigger)")},
+	{0x923, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M3 TPIU", "(Trace Port Interface Unit)")},
+	{0x924, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M3 ETM",  "(Embedded Trace)")},
+	{0x925, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M4 ETM",  "(Embedded Trace)")},
+	{0x930, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-R4 ETM",  "(Embedded Trace)")},
+	{0x941, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight TPIU-Lite", "(Trace Port Interface Unit)")},
+	{0x950, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight Component", "(unidentified Cortex-A9 component)")},
+	{0x955, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight Component", "(unidentified Cortex-A5 component)")},
+	{0x95f, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A15 PTM", "(Program Trace Macrocell)")},
+	{0x961, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight TMC",  "(Trace Memory Controller)")},
+	{0x962, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight STM",  "(System Trace Macrocell)")},
+	{0x9a0, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("CoreSight PMU",  "(Performance Monitoring Unit)")},
+	{0x9a1, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-M4 TPIU", "(Trace Port Interface Unit)")},
+	{0x9a5, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A5 ETM",  "(Embedded Trace)")},
+	{0x9a7, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A7 PMU",  "(Performance Monitor Unit)")},
+	{0x9af, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A15 PMU", "(Performance Monitor Unit)")},
+	{0xc05, aa_cortexa,   cidc_dc,      PIDR_PN_BIT_STRINGS("Cortex-A5 Debug", "(Debug Unit)")},
+	{0xc07, aa_cortexa,   cidc_dc,      PIDR_PN_BIT_STRINGS("Cortex-A7 Debug", "(Debug Unit)")},
+	{0xc08, aa_cortexa,   cidc_dc,      PIDR_PN_BIT_STRINGS("Cortex-A8 Debug", "(Debug Unit)")},
+	{0xc09, aa_cortexa,   cidc_dc,      PIDR_PN_BIT_STRINGS("Cortex-A9 Debug", "(Debug Unit)")},
+	{0xc0f, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-A15 Debug", "(Debug Unit)")}, /* support? */
+	{0xc14, aa_nosupport, cidc_unknown, PIDR_PN_BIT_STRINGS("Cortex-R4 Debug", "(Debug Unit)")}, /* support? */
+	{0xfff, aa_end,       cidc_unknown, PIDR_PN_BIT_STRINGS("end", "end")}
+};
+
+extern bool cortexa_probe(ADIv5_AP_t *apb, uint32_t debug_base);
+
+void adiv5_dp_ref(ADIv5_DP_t *dp)
+{
+	dp->refcnt++;
+}
+
+void adiv5_ap_ref(ADIv5_AP_t *ap)
+{
+	ap->refcnt++;
+}
+
+void adiv5_dp_unref(ADIv5_DP_t *dp)
+{
+	if (--(dp->refcnt) == 0)
+		free(dp);
+}
+
+void adiv5_ap_unref(ADIv5_AP_t *ap)
+{
+	if (--(ap->refcnt) == 0) {
+		adiv5_dp_unref(ap->dp);
+		free(ap);
+	}
+}
+
+void adiv5_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
+{
+	dp->low_access(dp, ADIV5_LOW_WRITE, addr, value);
+}
+
+static uint32_t adiv5_mem_read32(ADIv5_AP_t *ap, uint32_t addr)
+{
+	uint32_t ret;
+	adiv5_mem_read(ap, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+/* Cache of the last successful ROM table walk.  Production setups
+ * attach to the same silicon thousands of times, and the recursive
+ * CIDR/PIDR walk costs a dozen reads per component, yet its only
+ * side effect is the core probe calls made at the leaves.  Remember
+ * those keyed by DP IDCODE, AP and root address, verify with a single
+ * PIDR0 read on the next attach and replay; any mismatch falls back
+ * to the full walk and refills the cache. */
+#define ROMTABLE_CACHE_CORES 4
+
+static struct {
+	uint32_t idcode;
+	uint32_t targetsel;
+	uint32_t base;
+	uint32_t pidr0;
+	uint8_t apsel;
+	uint8_t ncores;
+	bool valid;
+	struct {
+		uint32_t addr;
+		enum arm_arch arch;
+	} core[ROMTABLE_CACHE_CORES];
+} romtable_cache;
+
+/* Set while a walk is (re)filling the cache */
+static bool romtable_cache_record;
+
+static void romtable_cache_add(uint32_t addr, enum arm_arch arch)
+{
+	if (!romtable_cache_record)
+		return;
+	if (romtable_cache.ncores == ROMTABLE_CACHE_CORES) {
+		/* More cores than we track: give up on caching this part */
+		romtable_cache_record = false;
+		return;
+	}
+	romtable_cache.core[romtable_cache.ncores].addr = addr;
+	romtable_cache.core[romtable_cache.ncores++].arch = arch;
+}
+
+static void adiv5_component_probe(ADIv5_AP_t *ap, uint32_t addr)
+{
+	addr &= ~3;
+	uint64_t pidr = 0;
+	uint32_t cidr = 0;
+
+	/* Assemble logical Product ID register value. */
+	for (int i = 0; i < 4; i++) {
+		uint32_t x = adiv5_mem_read32(ap, addr + PIDR0_OFFSET + 4*i);
+		pidr |= (x & 0xff) << (i * 8);
+	}
+	{
+		uint32_t x = adiv5_mem_read32(ap, addr + PIDR4_OFFSET);
+		pidr |= (uint64_t)x << 32;
+	}
+
+	/* Assemble logical Component ID register value. */
+	for (int i = 0; i < 4; i++) {
+		uint32_t x = adiv5_mem_read32(ap, addr + CIDR0_OFFSET + 4*i);
+		cidr |= ((uint64_t)(x & 0xff)) << (i * 8);
+	}
+
+	if (adiv5_dp_error(ap->dp)) {
+		DEBUG("Fault reading ID registers\n");
+		return;
+	}
+
+	/* CIDR preamble sanity check */
+	if ((cidr & ~CID_CLASS_MASK) != CID_PREAMBLE) {
+		DEBUG("0x%"PRIx32": 0x%"PRIx32" <- does not match preamble (0x%X)\n",
+                      addr, cidr, CID_PREAMBLE);
+		return;
+	}
+
+	/* Extract Component ID class nibble */
+	uint32_t cid_class = (cidr & CID_CLASS_MASK) >> CID_CLASS_SHIFT;
+
+	if (cid_class == cidc_romtab) { /* ROM table, probe recursively */
+		for (int i = 0; i < 256; i++) {
+			uint32_t entry = adiv5_mem_read32(ap, addr + i*4);
+			if (adiv5_dp_error(ap->dp)) {
+				DEBUG("Fault reading ROM table entry\n");
+			}
+
+			if (entry == 0)
+				break;
+
+			if ((entry & 1) == 0)
+				continue;
+
+			adiv5_component_probe(ap, addr + (entry & ~0xfff));
+		}
+	} else {
+		/* Check if the component was designed by ARM, we currently do not support,
+		 * any components by other designers.
+		 */
+		if ((pidr & ~(PIDR_REV_MASK | PIDR_PN_MASK)) != PIDR_ARM_BITS) {
+			DEBUG("0x%"PRIx32": 0x%"PRIx64" <- does not match ARM JEP-106\n",
+                              addr, pidr);
+			return;
+		}
+
+		/* Extract part number from the part id register. */
+		uint16_t part_number = pidr & PIDR_PN_MASK;
+		/* Find the part number in our part list and run the appropriate probe
+		 * routine if applicable.
+		 */
+		int i;
+		for (i = 0; pidr_pn_bits[i].arch != aa_end; i++) {
+			if (pidr_pn_bits[i].part_number == part_number) {
+				DEBUG("0x%"PRIx32": %s - %s %s\n", addr,
+				      cidc_debug_strings[cid_class],
+				      pidr_pn_bits[i].type,
+				      pidr_pn_bits[i].full);
+				/* Perform sanity check, if we know what to expect as component ID
+				 * class.
+				 */
+				if ((pidr_pn_bits[i].cidc != cidc_unknown) &&
+				    (cid_class != pidr_pn_bits[i].cidc)) {
+					DEBUG("WARNING: \"%s\" !match expected \"%s\"\n",
+					      cidc_debug_strings[cid_class],
+					      cidc_debug_strings[pidr_pn_bits[i].cidc]);
+				}
+				switch (pidr_pn_bits[i].arch) {
+				case aa_cortexm:
+					DEBUG("-> cortexm_probe\n");
+					romtable_cache_add(addr, aa_cortexm);
+					cortexm_probe(ap);
+					break;
+				case aa_cortexa:
+#ifdef TARGET_CORTEXA
+					DEBUG("-> cortexa_probe\n");
+					romtable_cache_add(addr, aa_cortexa);
+					cortexa_probe(ap, addr);
+#endif
+					break;
+				default:
+					break;
+				}
+				break;
+			}
+		}
+		if (pidr_pn_bits[i].arch == aa_end) {
+			DEBUG("0x%"PRIx32": %s - Unknown (PIDR = 0x%"PRIx64")\n", addr,
+			      cidc_debug_strings[cid_class], pidr);
+		}
+	}
+}
+
+static void adiv5_rom_probe(ADIv5_AP_t *ap, uint32_t addr)
+{
+	if (romtable_cache.valid &&
+	    (romtable_cache.idcode == ap->dp->idcode) &&
+	    (romtable_cache.targetsel == ap->dp->targetsel) &&
+	    (romtable_cache.apsel == ap->apsel) &&
+	    (romtable_cache.base == addr)) {
+		uint32_t pidr0 = adiv5_mem_read32(ap, (addr & ~3) +
+		                                  PIDR0_OFFSET) & 0xff;
+		if (!adiv5_dp_error(ap->dp) &&
+		    (pidr0 == romtable_cache.pidr0)) {
+			DEBUG("ROM table cache hit, replaying %d cores\n",
+			      romtable_cache.ncores);
+			for (int i = 0; i < romtable_cache.ncores; i++) {
+				switch (romtable_cache.core[i].arch) {
+				case aa_cortexm:
+					cortexm_probe(ap);
+					break;
+#ifdef TARGET_CORTEXA
+				case aa_cortexa:
+					cortexa_probe(ap,
+					              romtable_cache.core[i].addr);
+					break;
+#endif
+				default:
+					break;
+				}
+			}
+			return;
+		}
+	}
+
+	romtable_cache.valid = false;
+	romtable_cache.idcode = ap->dp->idcode;
+	romtable_cache.targetsel = ap->dp->targetsel;
+	romtable_cache.apsel = ap->apsel;
+	romtable_cache.base = addr;
+	romtable_cache.pidr0 = adiv5_mem_read32(ap, (addr & ~3) +
+	                                        PIDR0_OFFSET) & 0xff;
+	romtable_cache.ncores = 0;
+	romtable_cache_record = !adiv5_dp_error(ap->dp);
+	adiv5_component_probe(ap, addr);
+	/* Only a complete walk that actually found cores is worth
+	 * trusting next time round */
+	if (romtable_cache_record && romtable_cache.ncores)
+		romtable_cache.valid = true;
+	romtable_cache_record = false;
+}
+
+/* APs found on the last scan, keyed by DP IDCODE.  AP indices are
+ * allocated densely from zero, so the 256-slot address space is almost
+ * entirely empty: a fresh scan stops after AP_SCAN_GAP consecutive
+ * unpopulated slots, and a re-scan of a part seen before verifies each
+ * remembered slot with one IDR read and probes only those.  A
+ * single-AP part then costs two IDR reads per attach instead of a
+ * 256-slot sweep. */
+#define AP_CACHE_APS 8
+#define AP_SCAN_GAP  8
+
+static struct {
+	uint32_t idcode;
+	uint32_t targetsel;
+	uint8_t naps;
+	bool valid;
+	uint8_t apsel[AP_CACHE_APS];
+} ap_cache;
+
+ADIv5_AP_t *adiv5_new_ap(ADIv5_DP_t *dp, uint8_t apsel)
+{
+	ADIv5_AP_t *ap, tmpap;
+
+	/* Assume valid and try to read IDR */
+	memset(&tmpap, 0, sizeof(tmpap));
+	tmpap.dp = dp;
+	tmpap.apsel = apsel;
+	tmpap.idr = adiv5_ap_read(&tmpap, ADIV5_AP_IDR);
+
+	if(!tmpap.idr) /* IDR Invalid - Should we not continue here? */
+		return NULL;
+
+	/* It's valid to so create a heap copy */
+	ap = malloc(sizeof(*ap));
+	memcpy(ap, &tmpap, sizeof(*ap));
+	adiv5_dp_ref(dp);
+
+	ap->cfg = adiv5_ap_read(ap, ADIV5_AP_CFG);
+	ap->base = adiv5_ap_read(ap, ADIV5_AP_BASE);
+	ap->csw = adiv5_ap_read(ap, ADIV5_AP_CSW) &
+		~(ADIV5_AP_CSW_SIZE_MASK | ADIV5_AP_CSW_ADDRINC_MASK);
+
+	if (ap->csw & ADIV5_AP_CSW_TRINPROG) {
+		DEBUG("AP transaction in progress.  Target may not be usable.\n");
+		ap->csw &= ~ADIV5_AP_CSW_TRINPROG;
+	}
+
+	DEBUG(" AP %3d: IDR=%08"PRIx32" CFG=%08"PRIx32" BASE=%08"PRIx32" CSW=%08"PRIx32"\n",
+	      apsel, ap->idr, ap->cfg, ap->base, ap->csw);
+
+	return ap;
+}
+
+/* Probe a single AP slot; returns true if an AP responded there */
+static bool adiv5_dp_probe_ap(ADIv5_DP_t *dp, uint8_t apsel)
+{
+	ADIv5_AP_t *ap = adiv5_new_ap(dp, apsel);
+	if (ap == NULL)
+		return false;
+
+#ifdef TARGET_KINETIS
+	extern void kinetis_mdm_probe(ADIv5_AP_t *);
+	kinetis_mdm_probe(ap);
+#endif
+
+	if (ap->base == 0xffffffff) {
+		/* No debug entries... useless AP */
+		adiv5_ap_unref(ap);
+		return true;
+	}
+
+	/* Should probe further here to make sure it's a valid target.
+	 * AP should be unref'd if not valid.
+	 */
+
+	/* The rest sould only be added after checking ROM table */
+	adiv5_rom_probe(ap, ap->base);
+	return true;
+}
+
+void adiv5_dp_init(ADIv5_DP_t *dp)
+{
+	volatile uint32_t ctrlstat = 0;
+
+	adiv5_dp_ref(dp);
+
+	volatile struct exception e;
+	TRY_CATCH (e, EXCEPTION_TIMEOUT) {
+		ctrlstat = adiv5_dp_read(dp, ADIV5_DP_CTRLSTAT);
+	}
+	if (e.type) {
+		DEBUG("DP not responding!  Trying abort sequence...\n");
+		adiv5_dp_abort(dp, ADIV5_DP_ABORT_DAPABORT);
+		ctrlstat = adiv5_dp_read(dp, ADIV5_DP_CTRLSTAT);
+	}
+
+	/* Write request for system and debug power up */
+	adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT,
+			ctrlstat |= ADIV5_DP_CTRLSTAT_CSYSPWRUPREQ |
+				ADIV5_DP_CTRLSTAT_CDBGPWRUPREQ);
+	/* Wait for acknowledge */
+	while(((ctrlstat = adiv5_dp_read(dp, ADIV5_DP_CTRLSTAT)) &
+		(ADIV5_DP_CTRLSTAT_CSYSPWRUPACK | ADIV5_DP_CTRLSTAT_CDBGPWRUPACK)) !=
+		(ADIV5_DP_CTRLSTAT_CSYSPWRUPACK | ADIV5_DP_CTRLSTAT_CDBGPWRUPACK));
+
+	if(DO_RESET_SEQ) {
+		/* This AP reset logic is described in ADIv5, but fails to work
+		 * correctly on STM32.  CDBGRSTACK is never asserted, and we
+		 * just wait forever.
+		 */
+
+		/* Write request for debug reset */
+		adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT,
+				ctrlstat |= ADIV5_DP_CTRLSTAT_CDBGRSTREQ);
+		/* Wait for acknowledge */
+		while(!((ctrlstat = adiv5_dp_read(dp, ADIV5_DP_CTRLSTAT)) &
+				ADIV5_DP_CTRLSTAT_CDBGRSTACK));
+
+		/* Write request for debug reset release */
+		adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT,
+				ctrlstat &= ~ADIV5_DP_CTRLSTAT_CDBGRSTREQ);
+		/* Wait for acknowledge */
+		while(adiv5_dp_read(dp, ADIV5_DP_CTRLSTAT) &
+				ADIV5_DP_CTRLSTAT_CDBGRSTACK);
+	}
+
+	/* Probe for APs on this DP.  If the part was scanned before,
+	 * check the remembered slots still answer and take only those;
+	 * verification comes first so a changed part falls back to the
+	 * full scan without having probed (and listed) anything yet. */
+	bool cached = ap_cache.valid && (ap_cache.idcode == dp->idcode) &&
+	              (ap_cache.targetsel == dp->targetsel);
+	for (int i = 0; cached && (i < ap_cache.naps); i++) {
+		ADIv5_AP_t tmpap;
+		memset(&tmpap, 0, sizeof(tmpap));
+		tmpap.dp = dp;
+		tmpap.apsel = ap_cache.apsel[i];
+		if (!adiv5_ap_read(&tmpap, ADIV5_AP_IDR))
+			cached = false;
+	}
+
+	if (cached) {
+		for (int i = 0; i < ap_cache.naps; i++)
+			adiv5_dp_probe_ap(dp, ap_cache.apsel[i]);
+	} else {
+		ap_cache.valid = false;
+		ap_cache.idcode = dp->idcode;
+		ap_cache.targetsel = dp->targetsel;
+		ap_cache.naps = 0;
+		bool record = true;
+		int gap = 0;
+		for (int i = 0; (i < 256) && (gap < AP_SCAN_GAP); i++) {
+			if (!adiv5_dp_probe_ap(dp, i)) {
+				gap++;
+				continue;
+			}
+			gap = 0;
+			if (ap_cache.naps == AP_CACHE_APS)
+				/* More APs than we track: don't cache */
+				record = false;
+			else
+				ap_cache.apsel[ap_cache.naps++] = i;
+		}
+		if (record && ap_cache.naps)
+			ap_cache.valid = true;
+	}
+	adiv5_dp_unref(dp);
+}
+
+/* Point SELECT at the AP and bank holding addr, skipping the write
+ * when the cached value already matches.  Consecutive accesses within
+ * one register bank are the common case (TAR/DRW cycling during memory
+ * transfers, DHCSR polling), so most AP accesses save a whole DP
+ * transaction here. */
+static void adiv5_ap_select(ADIv5_AP_t *ap, uint16_t addr)
+{
+	ADIv5_DP_t *dp = ap->dp;
+	uint32_t select = ((uint32_t)ap->apsel << 24) | (addr & 0xF0);
+
+	if (dp->select_valid && (dp->select == select))
+		return;
+	adiv5_dp_write(dp, ADIV5_DP_SELECT, select);
+	dp->select = select;
+	dp->select_valid = true;
+}
+
+enum align {
+	ALIGN_BYTE =  0,
+	ALIGN_HALFWORD = 1,
+	ALIGN_WORD = 2
+};
+#define ALIGNOF(x) (((x) & 3) == 0 ? ALIGN_WORD : \
+                    (((x) & 1) == 0 ? ALIGN_HALFWORD : ALIGN_BYTE))
+
+/* Program the CSW and TAR for sequencial access at a given width.
+ * Returns the CSW value in effect so the caller can re-arm the
+ * continuation cache once the transfer completes. */
+static uint32_t ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align)
+{
+	uint32_t csw = ap->csw | ADIV5_AP_CSW_ADDRINC_SINGLE;
+	bool cached;
+
+	switch (align) {
+	case ALIGN_BYTE:
+		csw |= ADIV5_AP_CSW_SIZE_BYTE;
+		break;
+	case ALIGN_HALFWORD:
+		csw |= ADIV5_AP_CSW_SIZE_HALFWORD;
+		break;
+	case ALIGN_WORD:
+		csw |= ADIV5_AP_CSW_SIZE_WORD;
+		break;
+	}
+	/* An access continuing where the previous one ended, at the same
+	 * width, finds this AP's CSW and TAR still programmed: those
+	 * registers are banked per AP, so the continuation survives even
+	 * when transfers to two APs interleave, as when one core is
+	 * polled or halted while another's RAM streams out.  Only SELECT
+	 * is shared and may point at the other AP meanwhile; re-point it
+	 * through the bank cache, which elides the write again whenever
+	 * we were the last AP addressed. */
+	cached = (csw == ap->last_csw) && (addr == ap->next_tar);
+	/* Disarm while a transfer is in flight in case it faults out */
+	ap->last_csw = 0;
+	/* This access moves TAR off wherever the step poll parked it */
+	ap->tar_parked = false;
+	if (cached) {
+		adiv5_ap_select(ap, ADIV5_AP_TAR);
+		return csw;
+	}
+
+	adiv5_ap_write(ap, ADIV5_AP_CSW, csw);
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, addr);
+	return csw;
+}
+
+/* Extract read data from data lane based on align and src address */
+static void * extract(void *dest, uint32_t src, uint32_t val, enum align align)
+{
+	switch (align) {
+	case ALIGN_BYTE:
+		*(uint8_t *)dest = (val >> ((src & 0x3) << 3) & 0xFF);
+		break;
+	case ALIGN_HALFWORD:
+		*(uint16_t *)dest = (val >> ((src & 0x2) << 3) & 0xFFFF);
+		break;
+	case ALIGN_WORD:
+		*(uint32_t *)dest = val;
+		break;
+	}
+	return (uint8_t *)dest + (1 << align);
+}
+
+/* Read len bytes at a fixed access width.  src and len must both be
+ * aligned to the width given. */
+static void
+ap_mem_read_aligned(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len,
+                    enum align align)
+{
+	uint32_t tmp;
+	uint32_t osrc = src;
+
+	len >>= align;
+	uint32_t csw = ap_mem_access_setup(ap, src, align);
+	uint32_t end = src + (len << align);
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
+	while (--len) {
+		tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
+		dest = extract(dest, src, tmp, align);
+
+		src += (1 << align);
+		/* Check for 10 bit address overflow */
+		if ((src ^ osrc) & 0xfffffc00) {
+			osrc = src;
+			adiv5_dp_low_access(ap->dp,
+					ADIV5_LOW_WRITE, ADIV5_AP_TAR, src);
+			adiv5_dp_low_access(ap->dp,
+					ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
+		}
+		/* Let the housekeeping tasks run during long transfers */
+		if (!(len & 63))
+			task_yield();
+	}
+	tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0);
+	extract(dest, src, tmp, align);
+
+	/* Re-arm the continuation cache now the transfer succeeded.
+	 * Except when the transfer ended exactly on a 1KB boundary: TAR
+	 * auto-increment is only architected over bits [9:0], whether it
+	 * carries into bit 10 is implementation defined, so TAR's value
+	 * there is unknown. */
+	if (end & 0x3ff) {
+		ap->last_csw = csw;
+		ap->next_tar = end;
+	}
+}
+
+void
+adiv5_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
+{
+	STATS_ADD(mem_read_bytes, len);
+	/* Plan the transfer as a narrow head, a word-wide interior and a
+	 * narrow tail instead of dropping the whole run to the width of
+	 * the worst-aligned end, so an oddly-sized block still moves
+	 * mostly as word accesses. */
+	if ((src & 1) && len) {
+		ap_mem_read_aligned(ap, dest, src, 1, ALIGN_BYTE);
+		dest = (uint8_t *)dest + 1;
+		src++;
+		len--;
+	}
+	if ((src & 2) && (len >= 2)) {
+		ap_mem_read_aligned(ap, dest, src, 2, ALIGN_HALFWORD);
+		dest = (uint8_t *)dest + 2;
+		src += 2;
+		len -= 2;
+	}
+	if (len >= 4) {
+		size_t run = len & ~3;
+		ap_mem_read_aligned(ap, dest, src, run, ALIGN_WORD);
+		dest = (uint8_t *)dest + run;
+		src += run;
+		len -= run;
+	}
+	if (len >= 2) {
+		ap_mem_read_aligned(ap, dest, src, 2, ALIGN_HALFWORD);
+		dest = (uint8_t *)dest + 2;
+		src += 2;
+		len -= 2;
+	}
+	if (len)
+		ap_mem_read_aligned(ap, dest, src, 1, ALIGN_BYTE);
+}
+
+/* Read a block in a single pass, skipping over address ranges that bus
+ * fault instead of abandoning the whole transfer.  The MEM-AP TAR
+ * auto-increment wraps at 1KB so that is the natural segment size: a
+ * faulting segment is zero-filled in dest, the sticky error flags are
+ * cleared, and the read carries on with the next segment.  Returns the
+ * number of leading bytes read without fault, which is what the GDB
+ * remote protocol allows as a partial 'm' reply. */
+size_t
+adiv5_mem_read_partial(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
+{
+	size_t good = 0;
+	bool faulted = false;
+
+	while (len) {
+		size_t seg = 0x400 - (src & 0x3ff);
+		if (seg > len)
+			seg = len;
+
+		adiv5_mem_read(ap, dest, src, seg);
+		/* Check the error flags unconditionally: with dp->fault
+		 * set every AP access no-ops, so leaving it uncleared
+		 * would zero-fill all remaining segments here and wedge
+		 * every later AP access in the session. */
+		bool fault = ap->dp->fault;
+		if (adiv5_dp_error(ap->dp))
+			fault = true;
+		if (fault) {
+			memset(dest, 0, seg);
+			faulted = true;
+			/* TAR was left mid-segment; don't let the next
+			 * segment skip its CSW/TAR setup */
+			ap->last_csw = 0;
+		} else if (!faulted) {
+			good += seg;
+		}
+
+		dest = (uint8_t *)dest + seg;
+		src += seg;
+		len -= seg;
+	}
+	return good;
+}
+
+void
+adiv5_mem_write(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len)
+{
+	STATS_ADD(mem_write_bytes, len);
+	const void *src0 = src;
+	uint32_t dest0 = dest;
+	size_t len0 = len;
+	uint32_t odest = dest;
+	enum align align = MIN(ALIGNOF(dest), ALIGNOF(len));
+
+	len >>= align;
+	uint32_t csw = ap_mem_access_setup(ap, dest, align);
+	uint32_t end = dest + (len << align);
+	while (len--) {
+		uint32_t tmp = 0;
+		/* Pack data into correct data lane */
+		switch (align) {
+		case ALIGN_BYTE:
+			tmp = ((uint32_t)*(uint8_t *)src) << ((dest & 3) << 3);
+			break;
+		case ALIGN_HALFWORD:
+			tmp = ((uint32_t)*(uint16_t *)src) << ((dest & 2) << 3);
+			break;
+		case ALIGN_WORD:
+			tmp = *(uint32_t *)src;
+			break;
+		}
+		src = (uint8_t *)src + (1 << align);
+		dest += (1 << align);
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DRW, tmp);
+
+		/* Check for 10 bit address overflow */
+		if ((dest ^ odest) & 0xfffffc00) {
+			odest = dest;
+			adiv5_dp_low_access(ap->dp,
+					ADIV5_LOW_WRITE, ADIV5_AP_TAR, dest);
+		}
+		/* Let the housekeeping tasks run during long transfers */
+		if (!(len & 63))
+			task_yield();
+	}
+
+	/* Re-arm the continuation cache now the transfer succeeded
+	 * (same 1KB auto-increment boundary caveat as the read path) */
+	if (end & 0x3ff) {
+		ap->last_csw = csw;
+		ap->next_tar = end;
+	}
+
+	/* The write loop above is fire-and-forget: DRW writes stream
+	 * without per-word status inspection and faults accumulate in
+	 * the sticky flags, which target_mem_write() checks once per
+	 * block.  The opt-in verify pass is for writes where that is
+	 * not enough assurance, at the cost of reading the block back. */
+	if (target_mem_verify_enabled) {
+		uint8_t tmp[64];
+		const uint8_t *s = src0;
+		while (len0) {
+			size_t seg = MIN(len0, sizeof(tmp));
+			adiv5_mem_read(ap, tmp, dest0, seg);
+			if (memcmp(tmp, s, seg)) {
+				DEBUG("Verify mismatch at 0x%08"PRIx32"\n",
+				      dest0);
+				raise_exception(EXCEPTION_ERROR,
+				                "Verify mismatch after write");
+			}
+			dest0 += seg;
+			s += seg;
+			len0 -= seg;
+		}
+	}
+}
+
+/* Fill a range with one repeating byte without per-word host traffic:
+ * CSW and TAR are programmed once and the same packed word streams to
+ * DRW for the whole run.  Since every data lane carries the same byte
+ * the packed word is lane-invariant, so narrow accesses at unaligned
+ * ends need no repacking either. */
+void
+adiv5_mem_fill(ADIv5_AP_t *ap, uint32_t dest, uint8_t val, size_t len)
+{
+	STATS_ADD(mem_write_bytes, len);
+	uint32_t odest = dest;
+	enum align align = MIN(ALIGNOF(dest), ALIGNOF(len));
+	uint32_t word = val * 0x01010101U;
+
+	len >>= align;
+	uint32_t csw = ap_mem_access_setup(ap, dest, align);
+	uint32_t end = dest + (len << align);
+	while (len--) {
+		dest += (1 << align);
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DRW,
+		                    word);
+
+		/* Check for 10 bit address overflow */
+		if ((dest ^ odest) & 0xfffffc00) {
+			odest = dest;
+			adiv5_dp_low_access(ap->dp,
+					ADIV5_LOW_WRITE, ADIV5_AP_TAR, dest);
+		}
+		/* Let the housekeeping tasks run during long transfers */
+		if (!(len & 63))
+			task_yield();
+	}
+
+	/* Re-arm the continuation cache now the transfer succeeded
+	 * (same 1KB auto-increment boundary caveat as the read path) */
+	if (end & 0x3ff) {
+		ap->last_csw = csw;
+		ap->next_tar = end;
+	}
+}
+
+void adiv5_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
+{
+	/* Direct AP register access may move CSW or TAR under us */
+	ap->last_csw = 0;
+	ap->tar_parked = false;
+	adiv5_ap_select(ap, addr);
+	adiv5_dp_write(ap->dp, addr, value);
+}
+
+uint32_t adiv5_ap_read(ADIv5_AP_t *ap, uint16_t addr)
+{
+	ap->last_csw = 0;
+	adiv5_ap_select(ap, addr);
+	return adiv5_dp_read(ap->dp, addr);
+}
+
+/* Complete a batch of posted AP writes.  AP writes are posted by both
+ * DP transports, so adiv5_ap_write() never waits on the wire and
+ * faults accumulate in the sticky flags; this checks and clears them
+ * once for the whole batch, returning the error bits found, zero if
+ * every write landed. */
+uint32_t adiv5_flush(ADIv5_DP_t *dp)
+{
+	dp->select_valid = false;
+	return adiv5_dp_error(dp);
+}
@@ -0,0 +1,360 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements the SW-DP specific functions of the
+ * ARM Debug Interface v5 Architecure Specification, ARM doc IHI0031A.
+ */
+
+#include "general.h"
+#include "exception.h"
+#include "stats.h"
+#include "profile.h"
+#include "wirelog.h"
+#include "adiv5.h"
+#include "swdptap.h"
+#include "target.h"
+#include "target_internal.h"
+
+#define SWDP_ACK_OK    0x01
+#define SWDP_ACK_WAIT  0x02
+#define SWDP_ACK_FAULT 0x04
+
+/* Clock rate below which scan-time negotiation gives up */
+#define SWDP_FREQ_FLOOR 100000
+
+static uint32_t adiv5_swdp_read(ADIv5_DP_t *dp, uint16_t addr);
+
+static uint32_t adiv5_swdp_error(ADIv5_DP_t *dp);
+
+static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
+				      uint16_t addr, uint32_t value);
+
+static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort);
+
+static bool adiv5_swdp_select(ADIv5_DP_t *dp);
+
+/* TARGETSEL value currently owning a multi-drop wire, 0 when unknown */
+static uint32_t swdp_selected;
+
+static void adiv5_swdp_line_reset(void)
+{
+	for (int i = 0; i < 50; i++)
+		swdptap_bit_out(1);
+	swdptap_seq_out(0, 8);
+}
+
+/* Select the DP addressed by dp->targetsel (DPv2 multi-drop).  The
+ * TARGETSEL write goes out straight after a line reset, while no DP
+ * drives the wire, so the ACK bits are clocked but ignored; the
+ * mandatory DPIDR read that follows completes the selection.  Returns
+ * false if nothing answered at this address. */
+static bool adiv5_swdp_select(ADIv5_DP_t *dp)
+{
+	if (!dp->targetsel || (swdp_selected == dp->targetsel))
+		return true;
+
+	swdp_selected = 0;
+	adiv5_swdp_line_reset();
+	swdptap_seq_out(0x99, 8);	/* Write TARGETSEL (DP reg 0xC) */
+	swdptap_seq_in(3);		/* ACK phase is not driven */
+	swdptap_seq_out_parity(dp->targetsel, 32);
+	swdptap_seq_out(0, 8);
+
+	swdptap_seq_out(0xA5, 8);	/* Read DPIDR (DP reg 0x0) */
+	if ((swdptap_seq_in(3) != SWDP_ACK_OK) ||
+	    swdptap_seq_in_parity(&dp->idcode, 32))
+		return false;
+
+	/* The line reset cleared DPBANKSEL on every DP on the wire */
+	dp->select_valid = false;
+	swdp_selected = dp->targetsel;
+	return true;
+}
+
+/* Bring up and scan one DP instance on a multi-drop wire.  Returns 1
+ * if a DP answered to targetsel, 0 if the instance is unpopulated. */
+static int adiv5_swdp_multidrop_scan(uint32_t targetsel)
+{
+	ADIv5_DP_t *dp = (void*)calloc(1, sizeof(*dp));
+
+	dp->targetsel = targetsel;
+	dp->dp_read = adiv5_swdp_read;
+	dp->error = adiv5_swdp_error;
+	dp->low_access = adiv5_swdp_low_access;
+	dp->abort = adiv5_swdp_abort;
+
+	if (!adiv5_swdp_select(dp)) {
+		free(dp);
+		return 0;
+	}
+	DEBUG("Multi-drop DP: TARGETSEL=%08"PRIx32" IDCODE=%08"PRIx32"\n",
+	      targetsel, dp->idcode);
+
+	adiv5_swdp_error(dp);
+	adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT, ADIV5_DP_CTRLSTAT_ORUNDETECT);
+	dp->orundetect = true;
+	adiv5_dp_init(dp);
+	return 1;
+}
+
+int adiv5_swdp_scan(void)
+{
+	uint8_t ack;
+
+	target_list_free();
+	ADIv5_DP_t *dp = (void*)calloc(1, sizeof(*dp));
+
+	swdptap_init();
+	swdp_selected = 0;
+
+	/* Negotiate the clock rate: start at the configured ceiling (the
+	 * tap's fastest, unless the user pinned it with the swd_freq
+	 * command) and halve on failure until the DP answers the IDCODE
+	 * read cleanly.  A previous failed scan -- target unpowered, say
+	 * -- may have walked the rate down to the floor, so restore the
+	 * ceiling first rather than resuming from wherever it left
+	 * SWCLK.  Taps without clock control report 0 and get a single
+	 * attempt as before. */
+	uint32_t freq = swdptap_max_frequency();
+	if (freq)
+		swdptap_set_frequency(freq);
+	freq = swdptap_get_frequency();
+	for (;;) {
+		/* Switch from JTAG to SWD mode */
+		swdptap_seq_out(0xFFFF, 16);
+		for(int i = 0; i < 50; i++)
+			swdptap_bit_out(1);
+		swdptap_seq_out(0xE79E, 16); /* 0b0111100111100111 */
+		for(int i = 0; i < 50; i++)
+			swdptap_bit_out(1);
+		swdptap_seq_out(0, 16);
+
+		/* Read the SW-DP IDCODE register to syncronise */
+		/* This could be done with adiv_swdp_low_access(), but this doesn't
+		 * allow the ack to be checked here. */
+		swdptap_seq_out(0xA5, 8);
+		ack = swdptap_seq_in(3);
+		if((ack == SWDP_ACK_OK) && !swdptap_seq_in_parity(&dp->idcode, 32))
+			break;
+
+		if ((freq / 2) < SWDP_FREQ_FLOOR) {
+			DEBUG("\n");
+			free(dp);
+			return -1;
+		}
+		freq /= 2;
+		DEBUG("SW-DP not responding, retrying at %"PRIu32"Hz\n", freq);
+		swdptap_set_frequency(freq);
+		freq = swdptap_get_frequency();
+	}
+
+	dp->dp_read = adiv5_swdp_read;
+	dp->error = adiv5_swdp_error;
+	dp->low_access = adiv5_swdp_low_access;
+	dp->abort = adiv5_swdp_abort;
+
+	adiv5_swdp_error(dp);
+
+	/* DPv2 parts carry a TARGETID and may share the wire with other
+	 * DPs (SWD multi-drop).  On a shared wire the IDCODE read above
+	 * is answered by every DP at once, which works because dies of
+	 * one part drive identical DPIDR values.  Read the TARGETID and
+	 * probe each instance address: every die that answers gets its
+	 * own DP, re-selected on demand by the low access routine, so
+	 * all of them sit in the target list at once and switching cores
+	 * needs no rescan. */
+	int ndp = 0;
+	if (ADIV5_DP_VERSION(dp->idcode) >= 2) {
+		adiv5_dp_write(dp, ADIV5_DP_SELECT, 2); /* DPBANKSEL = 2 */
+		uint32_t targetid = adiv5_swdp_low_access(dp, ADIV5_LOW_READ,
+		                                ADIV5_DP_TARGETID, 0);
+		adiv5_dp_write(dp, ADIV5_DP_SELECT, 0);
+		if (!adiv5_swdp_error(dp) && (targetid & 1) &&
+		    (targetid != 0xffffffff)) {
+			for (uint32_t i = 0; i < 16; i++)
+				ndp += adiv5_swdp_multidrop_scan((i << 28) |
+						(targetid & 0x0fffffff));
+		}
+	}
+
+	if (ndp) {
+		/* The per-instance DPs took over; the anonymous one that
+		 * answered the shared IDCODE read is no longer addressable
+		 * on its own. */
+		free(dp);
+		return target_list?1:0;
+	}
+
+	/* Enable overrun detection: with ORUNDETECT set the DP accepts
+	 * transactions arriving while it is still busy instead of
+	 * stalling a whole burst on WAIT, recording the overrun in
+	 * STICKYORUN where the next sticky-flag check picks it up. */
+	adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT, ADIV5_DP_CTRLSTAT_ORUNDETECT);
+	dp->orundetect = true;
+
+	adiv5_dp_init(dp);
+
+	return target_list?1:0;
+}
+
+static uint32_t adiv5_swdp_read(ADIv5_DP_t *dp, uint16_t addr)
+{
+	if (addr & ADIV5_APnDP) {
+		adiv5_dp_low_access(dp, ADIV5_LOW_READ, addr, 0);
+		return adiv5_dp_low_access(dp, ADIV5_LOW_READ,
+		                           ADIV5_DP_RDBUFF, 0);
+	} else {
+		return adiv5_swdp_low_access(dp, ADIV5_LOW_READ, addr, 0);
+	}
+}
+
+static uint32_t adiv5_swdp_error(ADIv5_DP_t *dp)
+{
+	uint32_t err, clr = 0;
+
+	err = adiv5_swdp_read(dp, ADIV5_DP_CTRLSTAT) &
+		(ADIV5_DP_CTRLSTAT_STICKYORUN | ADIV5_DP_CTRLSTAT_STICKYCMP |
+		ADIV5_DP_CTRLSTAT_STICKYERR | ADIV5_DP_CTRLSTAT_WDATAERR);
+
+	if(err & ADIV5_DP_CTRLSTAT_STICKYORUN)
+		clr |= ADIV5_DP_ABORT_ORUNERRCLR;
+	if(err & ADIV5_DP_CTRLSTAT_STICKYCMP)
+		clr |= ADIV5_DP_ABORT_STKCMPCLR;
+	if(err & ADIV5_DP_CTRLSTAT_STICKYERR)
+		clr |= ADIV5_DP_ABORT_STKERRCLR;
+	if(err & ADIV5_DP_CTRLSTAT_WDATAERR)
+		clr |= ADIV5_DP_ABORT_WDERRCLR;
+
+	adiv5_dp_write(dp, ADIV5_DP_ABORT, clr);
+	dp->fault = 0;
+
+	return err;
+}
+
+/* With overrun detection enabled the DP expects the 33-bit data phase
+ * to be clocked after every ACK, WAIT and FAULT included; skipping it
+ * desynchronizes the wire.  Reads clock the phase in and discard it,
+ * writes drive it as zeros. */
+static void swdp_dummy_data_phase(uint8_t RnW)
+{
+	uint32_t dummy;
+
+	if (RnW)
+		swdptap_seq_in_parity(&dummy, 32);
+	else
+		swdptap_seq_out_parity(0, 32);
+}
+
+static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
+				      uint16_t addr, uint32_t value)
+{
+	bool APnDP = addr & ADIV5_APnDP;
+	addr &= 0xff;
+	uint8_t request = 0x81;
+	uint32_t response = 0;
+	uint8_t ack;
+	platform_timeout timeout;
+
+	if(APnDP && dp->fault) return 0;
+
+	/* On a multi-drop wire, make sure this DP is the selected one */
+	if (dp->targetsel && (swdp_selected != dp->targetsel) &&
+	    !adiv5_swdp_select(dp))
+		raise_exception(EXCEPTION_ERROR, "SWDP multi-drop select");
+
+	if(APnDP) request ^= 0x22;
+	if(RnW)   request ^= 0x24;
+
+	addr &= 0xC;
+	request |= (addr << 1) & 0x18;
+	if((addr == 4) || (addr == 8))
+		request ^= 0x20;
+
+	/* Retry WAIT responses in-line.  The first few retries go straight
+	 * back out, since a busy DP usually frees up within a transaction
+	 * or two; after that back off with a progressively longer delay
+	 * (microseconds, doubling up to 64ms) so a sleeping target isn't
+	 * hammered, and only escalate to the timeout exception once the
+	 * 2 second budget is spent. */
+	platform_timeout_set(&timeout, 2000);
+	uint32_t wait_delay = 0;
+	unsigned tries = 0;
+	STATS_INC(swd_access);
+	PROFILE_BEGIN(PROFILE_SWD_XFER);
+	do {
+		swdptap_seq_out(request, 8);
+		ack = swdptap_seq_in(3);
+		if (ack != SWDP_ACK_WAIT)
+			break;
+		STATS_INC(swd_wait);
+		WIRELOG(WIRELOG_SWD_WAIT, request, tries, wait_delay);
+		if (dp->orundetect)
+			swdp_dummy_data_phase(RnW);
+		if (++tries > 4) {
+			if (wait_delay < 64000)
+				wait_delay = wait_delay ? wait_delay << 1 : 125;
+			platform_delay_us(wait_delay);
+		}
+	} while (!platform_timeout_is_expired(&timeout));
+	PROFILE_END(PROFILE_SWD_XFER);
+
+	if (ack == SWDP_ACK_WAIT) {
+		WIRELOG(WIRELOG_SWD_TIMEOUT, request, 0, 0);
+		raise_exception(EXCEPTION_TIMEOUT, "SWDP ACK timeout");
+	}
+
+	if(ack == SWDP_ACK_FAULT) {
+		STATS_INC(swd_fault);
+		WIRELOG(WIRELOG_SWD_FAULT, request, 0, 0);
+		if (dp->orundetect)
+			swdp_dummy_data_phase(RnW);
+		dp->fault = 1;
+		return 0;
+	}
+
+	if(ack != SWDP_ACK_OK)
+		raise_exception(EXCEPTION_ERROR, "SWDP invalid ACK");
+
+	if(RnW) {
+		if(swdptap_seq_in_parity(&response, 32)) {
+			/* Give up on parity error */
+			STATS_INC(swd_parity);
+			WIRELOG(WIRELOG_SWD_PARITY, request, 0, response);
+			raise_exception(EXCEPTION_ERROR, "SWDP Parity error");
+		}
+	} else {
+		swdptap_seq_out_parity(value, 32);
+		/* A write is only guaranteed to complete if the target
+		 * sees idle cycles afterwards, in case we stop clocking.
+		 * Reads return their data in-band, and back-to-back
+		 * posted AP reads are clocked by the next transaction's
+		 * header, so they need no padding. */
+		swdptap_seq_out(0, 8);
+	}
+
+	WIRELOG(WIRELOG_SWD_XFER, request, RnW, RnW ? response : value);
+	return response;
+}
+
+static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort)
+{
+	adiv5_dp_write(dp, ADIV5_DP_ABORT, abort);
+}
+
@@ -0,0 +1,1610 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2012  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements debugging functionality specific to ARM
+ * the Cortex-M3 core.  This should be generic to ARMv7-M as it is
+ * implemented according to the "ARMv7-M Architectue Reference Manual",
+ * ARM doc DDI0403C.
+ *
+ * Also supports Cortex-M0 / ARMv6-M
+ */
+#include "general.h"
+#include "exception.h"
+#include "adiv5.h"
+#include "target.h"
+#include "target_internal.h"
+#include "cortexm.h"
+
+#ifdef PLATFORM_HAS_TRACESWO
+#include "traceswo.h"
+#endif
+
+#include <unistd.h>
+
+static const char cortexm_driver_str[] = "ARM Cortex-M";
+
+static bool cortexm_vector_catch(target *t, int argc, char *argv[]);
+static bool cortexm_hostlog(target *t, int argc, char *argv[]);
+#ifdef PLATFORM_HAS_TRACESWO
+static bool cortexm_profile(target *t, int argc, char *argv[]);
+static bool cortexm_watch(target *t, int argc, char *argv[]);
+#endif
+
+const struct command_s cortexm_cmd_list[] = {
+	{"vector_catch", (cmd_handler)cortexm_vector_catch, "Catch exception vectors"},
+	{"hostlog", (cmd_handler)cortexm_hostlog, "Drain a target log buffer while running: (<addr>|disable)"},
+#ifdef PLATFORM_HAS_TRACESWO
+	{"profile", (cmd_handler)cortexm_profile, "Stream DWT PC samples on the trace interface: (start|stop)"},
+	{"watch", (cmd_handler)cortexm_watch, "Stream memory samples while running: (add <addr> <len>|show|clear)"},
+#endif
+	{NULL, NULL, NULL}
+};
+
+/* target options recognised by the Cortex-M target */
+#define	TOPT_FLAVOUR_V6M	(1<<0)	/* if not set, target is assumed to be v7m */
+#define	TOPT_FLAVOUR_V7MF	(1<<1)	/* if set, floating-point enabled. */
+
+static void cortexm_regs_read(target *t, void *data);
+static void cortexm_regs_write(target *t, const void *data);
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max);
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data, size_t size);
+static uint32_t cortexm_pc_read(target *t);
+
+static void cortexm_reset(target *t);
+static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch);
+static void cortexm_halt_request(target *t);
+static int cortexm_fault_unwind(target *t);
+
+static int cortexm_breakwatch_set(target *t, struct breakwatch *);
+static int cortexm_breakwatch_clear(target *t, struct breakwatch *);
+static target_addr cortexm_check_watch(target *t);
+
+#define CORTEXM_MAX_WATCHPOINTS	4	/* architecture says up to 15, no implementation has > 4 */
+/* Live watch list slots (monitor watch) */
+#define CORTEXM_WATCH_SLOTS	4
+#define CORTEXM_MAX_BREAKPOINTS	6	/* architecture says up to 127, no implementation has > 6 */
+#define CORTEXM_MAX_SW_BREAKPOINTS 16	/* Z0 slots handled on the probe */
+
+#define CORTEXM_BKPT_INSTR	0xBE00	/* BKPT #0 */
+
+static int cortexm_hostio_request(target *t);
+
+struct cortexm_priv {
+	ADIv5_AP_t *ap;
+	bool stepping;
+	bool on_bkpt;
+	/* Watchpoint unit status */
+	bool hw_watchpoint[CORTEXM_MAX_WATCHPOINTS];
+	unsigned flash_patch_revision;
+	unsigned hw_watchpoint_max;
+	/* Breakpoint unit status */
+	bool hw_breakpoint[CORTEXM_MAX_BREAKPOINTS];
+	unsigned hw_breakpoint_max;
+	/* Cached comparator contents.  GDB removes and re-inserts every
+	 * breakpoint around each continue, so clears are deferred until
+	 * resume and writes that match the cache are skipped. */
+	uint32_t hw_breakpoint_comp[CORTEXM_MAX_BREAKPOINTS];
+	uint32_t hw_watchpoint_comp[CORTEXM_MAX_WATCHPOINTS];
+	uint32_t hw_watchpoint_mask[CORTEXM_MAX_WATCHPOINTS];
+	uint32_t hw_watchpoint_func[CORTEXM_MAX_WATCHPOINTS];
+	/* Software breakpoint (Z0) slots.  The original instruction is
+	 * cached across removal, so re-inserting an unchanged breakpoint
+	 * never reads target memory; arming is deferred to resume, which
+	 * both batches the BKPT writes and keeps the opcode out of any
+	 * memory GDB reads while halted.  Restores happen at clear time,
+	 * while the core is halted and cannot hit the slot. */
+	struct {
+		uint32_t addr;
+		uint16_t orig;
+		bool cached;	/* orig holds the real instruction */
+		bool armed;	/* BKPT opcode currently in memory */
+		bool wanted;	/* set by Z0, cleared by z0 */
+	} sw_bp[CORTEXM_MAX_SW_BREAKPOINTS];
+	/* Copy of DEMCR for vector-catch */
+	uint32_t demcr;
+	/* Control block address of the polled log channel, 0 when off */
+	target_addr hostlog_cb;
+#ifdef PLATFORM_HAS_TRACESWO
+	/* PC sampling profiler state (see cortexm_profile_poll) */
+	bool profile_on;
+	uint32_t profile_last_pc;
+	uint32_t profile_rep;
+	/* Live watch list sampled from the halt poll, len 0 = free slot
+	 * (see cortexm_watch_poll) */
+	struct {
+		target_addr addr;
+		uint8_t len;
+	} watch_list[CORTEXM_WATCH_SLOTS];
+	uint8_t watch_count;
+#endif
+};
+
+/* Polled log channel: the target logs into a RAM ring buffer and the
+ * probe drains it from the halt-poll cycle while the core keeps
+ * running, so logging never takes the milliseconds a semihosting trap
+ * does.  The control block, registered with the hostlog monitor
+ * command, is laid out as five words:
+ *
+ *   0x00  magic, "BMLG"
+ *   0x04  ring buffer address
+ *   0x08  ring buffer size in bytes
+ *   0x0c  head: offset of the next byte the target will write
+ *   0x10  tail: offset of the next byte the probe will read
+ *
+ * The target owns head, the probe owns tail; the target should drop
+ * (or spin, its choice) when the buffer is full.  Output goes to the
+ * GDB console, which streams while the target executes. */
+#define CORTEXM_HOSTLOG_MAGIC	0x474C4D42	/* "BMLG" */
+
+/* Register number tables */
+static const uint32_t regnum_cortex_m[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,	/* standard r0-r15 */
+	0x10,	/* xpsr */
+	0x11,	/* msp */
+	0x12,	/* psp */
+	0x14	/* special */
+};
+
+static const uint32_t regnum_cortex_mf[] = {
+	0x21,	/* fpscr */
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,	/* s0-s7 */
+	0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,	/* s8-s15 */
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,	/* s16-s23 */
+	0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,	/* s24-s31 */
+};
+
+static const char tdesc_cortex_m[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target>"
+	"  <architecture>arm</architecture>"
+	"  <feature name=\"org.gnu.gdb.arm.m-profile\">"
+	"    <reg name=\"r0\" bitsize=\"32\"/>"
+	"    <reg name=\"r1\" bitsize=\"32\"/>"
+	"    <reg name=\"r2\" bitsize=\"32\"/>"
+	"    <reg name=\"r3\" bitsize=\"32\"/>"
+	"    <reg name=\"r4\" bitsize=\"32\"/>"
+	"    <reg name=\"r5\" bitsize=\"32\"/>"
+	"    <reg name=\"r6\" bitsize=\"32\"/>"
+	"    <reg name=\"r7\" bitsize=\"32\"/>"
+	"    <reg name=\"r8\" bitsize=\"32\"/>"
+	"    <reg name=\"r9\" bitsize=\"32\"/>"
+	"    <reg name=\"r10\" bitsize=\"32\"/>"
+	"    <reg name=\"r11\" bitsize=\"32\"/>"
+	"    <reg name=\"r12\" bitsize=\"32\"/>"
+	"    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+	"    <reg name=\"lr\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"xpsr\" bitsize=\"32\"/>"
+	"    <reg name=\"msp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"psp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"special\" bitsize=\"32\" save-restore=\"no\"/>"
+	"  </feature>"
+	"</target>";
+
+static const char tdesc_cortex_m_vfp[] =
+	"  <feature name=\"org.gnu.gdb.arm.vfp\">"
+	"    <reg name=\"fpscr\" bitsize=\"32\"/>"
+	"    <reg name=\"d0\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d1\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d2\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d3\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d4\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d5\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d6\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d7\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d8\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d9\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d10\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d11\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d12\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d13\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d14\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d15\" bitsize=\"64\" type=\"float\"/>"
+	"  </feature>";
+
+ADIv5_AP_t *cortexm_ap(target *t)
+{
+	return ((struct cortexm_priv *)t->priv)->ap;
+}
+
+static void cortexm_mem_read(target *t, void *dest, target_addr src, size_t len)
+{
+	adiv5_mem_read(cortexm_ap(t), dest, src, len);
+}
+
+static size_t cortexm_mem_read_partial(target *t, void *dest, target_addr src,
+                                       size_t len)
+{
+	return adiv5_mem_read_partial(cortexm_ap(t), dest, src, len);
+}
+
+static void cortexm_mem_write(target *t, target_addr dest, const void *src, size_t len)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	/* A write over a software breakpoint slot makes the saved
+	 * original instruction stale; if the slot was armed, the new
+	 * data also replaced the BKPT opcode itself. */
+	for (unsigned i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+		if (priv->sw_bp[i].cached &&
+		    (priv->sw_bp[i].addr + 2 > dest) &&
+		    (priv->sw_bp[i].addr < dest + len)) {
+			priv->sw_bp[i].cached = false;
+			priv->sw_bp[i].armed = false;
+		}
+
+	adiv5_mem_write(cortexm_ap(t), dest, src, len);
+}
+
+static void cortexm_mem_fill(target *t, target_addr dest, uint8_t val,
+                             size_t len)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	/* Same staleness rule as cortexm_mem_write() */
+	for (unsigned i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+		if (priv->sw_bp[i].cached &&
+		    (priv->sw_bp[i].addr + 2 > dest) &&
+		    (priv->sw_bp[i].addr < dest + len)) {
+			priv->sw_bp[i].cached = false;
+			priv->sw_bp[i].armed = false;
+		}
+
+	adiv5_mem_fill(cortexm_ap(t), dest, val, len);
+}
+
+/* Software breakpoint maintenance writes go underneath
+ * cortexm_mem_write() so they don't invalidate their own slot */
+static void cortexm_sw_bp_write16(target *t, uint32_t addr, uint16_t val)
+{
+	adiv5_mem_write(cortexm_ap(t), addr, &val, sizeof(val));
+}
+
+static bool cortexm_check_error(target *t)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	return adiv5_dp_error(ap->dp) != 0;
+}
+
+static void cortexm_priv_free(void *priv)
+{
+	adiv5_ap_unref(((struct cortexm_priv *)priv)->ap);
+	free(priv);
+}
+
+bool cortexm_probe(ADIv5_AP_t *ap)
+{
+	target *t;
+
+	t = target_new();
+	adiv5_ap_ref(ap);
+	struct cortexm_priv *priv = calloc(1, sizeof(*priv));
+	t->priv = priv;
+	t->priv_free = cortexm_priv_free;
+	priv->ap = ap;
+
+	t->check_error = cortexm_check_error;
+	t->mem_read = cortexm_mem_read;
+	t->mem_read_partial = cortexm_mem_read_partial;
+	t->mem_write = cortexm_mem_write;
+	t->mem_fill = cortexm_mem_fill;
+
+	t->driver = cortexm_driver_str;
+
+	t->attach = cortexm_attach;
+	t->detach = cortexm_detach;
+
+	/* Should probe here to make sure it's Cortex-M3 */
+	t->tdesc = tdesc_cortex_m;
+	t->regs_read = cortexm_regs_read;
+	t->regs_write = cortexm_regs_write;
+	t->reg_read = cortexm_reg_read;
+	t->reg_write = cortexm_reg_write;
+
+	t->reset = cortexm_reset;
+	t->halt_request = cortexm_halt_request;
+	t->halt_poll = cortexm_halt_poll;
+	t->halt_resume = cortexm_halt_resume;
+	t->regs_size = sizeof(regnum_cortex_m);
+
+	t->breakwatch_set = cortexm_breakwatch_set;
+	t->breakwatch_clear = cortexm_breakwatch_clear;
+
+	target_add_commands(t, cortexm_cmd_list, cortexm_driver_str);
+
+	/* Probe for FP extension */
+	uint32_t cpacr = target_mem_read32(t, CORTEXM_CPACR);
+	cpacr |= 0x00F00000; /* CP10 = 0b11, CP11 = 0b11 */
+	target_mem_write32(t, CORTEXM_CPACR, cpacr);
+	if (target_mem_read32(t, CORTEXM_CPACR) == cpacr) {
+		t->target_options |= TOPT_FLAVOUR_V7MF;
+		t->regs_size += sizeof(regnum_cortex_mf);
+		t->tdesc_extra = tdesc_cortex_m_vfp;
+	}
+
+	/* Default vectors to catch */
+	priv->demcr = CORTEXM_DEMCR_TRCENA | CORTEXM_DEMCR_VC_HARDERR |
+			CORTEXM_DEMCR_VC_CORERESET;
+
+#define PROBE(x) \
+	do { if ((x)(t)) return true; else target_check_error(t); } while (0)
+
+	/* Only the families selected by TARGETS in src/Makefile are
+	 * carried and probed, ordered so the parts most common in the
+	 * field are identified first */
+#ifdef TARGET_STM32
+	PROBE(stm32f1_probe);
+	PROBE(stm32f4_probe);
+	PROBE(stm32l0_probe);   /* STM32L0xx & STM32L1xx */
+	PROBE(stm32l4_probe);
+#endif
+#ifdef TARGET_LPC
+	PROBE(lpc11xx_probe);
+	PROBE(lpc15xx_probe);
+	PROBE(lpc43xx_probe);
+#endif
+#ifdef TARGET_SAM
+	PROBE(sam3x_probe);
+	PROBE(sam4l_probe);
+	PROBE(samd_probe);
+#endif
+#ifdef TARGET_NRF
+	PROBE(nrf51_probe);
+#endif
+#ifdef TARGET_LMI
+	PROBE(lmi_probe);
+#endif
+#ifdef TARGET_KINETIS
+	PROBE(kinetis_probe);
+#endif
+#ifdef TARGET_EFM32
+	PROBE(efm32_probe);
+#endif
+#undef PROBE
+
+	return true;
+}
+
+bool cortexm_attach(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+	uint32_t r;
+	int tries;
+
+	/* Scan results go stale across GDB reconnects: the board may have
+	 * been power-cycled or swapped since discovery.  Re-read the AP IDR
+	 * and compare it with the value the ROM walk recorded before
+	 * trusting anything else cached about this target; a fresh scan is
+	 * needed when this fails. */
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	volatile struct exception e;
+	uint32_t idr = 0;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		idr = adiv5_ap_read(ap, ADIV5_AP_IDR);
+	}
+	if (e.type || (idr != ap->idr)) {
+		DEBUG("AP IDR mismatch on attach: stale scan results?\n");
+		return false;
+	}
+
+	/* Clear any pending fault condition */
+	target_check_error(t);
+
+	target_halt_request(t);
+	tries = 10;
+	while(!platform_srst_get_val() && !target_halt_poll(t, NULL) && --tries)
+		platform_delay(target_halt_poll_ms);
+	if(!tries)
+		return false;
+
+	/* Request halt on reset */
+	target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
+
+	/* Reset DFSR flags */
+	target_mem_write32(t, CORTEXM_DFSR, CORTEXM_DFSR_RESETALL);
+
+	/* size the break/watchpoint units */
+	priv->hw_breakpoint_max = CORTEXM_MAX_BREAKPOINTS;
+	r = target_mem_read32(t, CORTEXM_FPB_CTRL);
+	if (((r >> 4) & 0xf) < priv->hw_breakpoint_max)	/* only look at NUM_COMP1 */
+		priv->hw_breakpoint_max = (r >> 4) & 0xf;
+	priv->flash_patch_revision = (r >> 28);
+	priv->hw_watchpoint_max = CORTEXM_MAX_WATCHPOINTS;
+	r = target_mem_read32(t, CORTEXM_DWT_CTRL);
+	if ((r >> 28) > priv->hw_watchpoint_max)
+		priv->hw_watchpoint_max = r >> 28;
+
+	/* Clear any stale breakpoints */
+	for(i = 0; i < priv->hw_breakpoint_max; i++) {
+		target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+		priv->hw_breakpoint[i] = 0;
+		priv->hw_breakpoint_comp[i] = 0;
+	}
+
+	/* Clear any stale watchpoints, fully, so that the cached
+	 * comparator contents are known to match the hardware */
+	for(i = 0; i < priv->hw_watchpoint_max; i++) {
+		target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+		target_mem_write32(t, CORTEXM_DWT_COMP(i), 0);
+		target_mem_write32(t, CORTEXM_DWT_MASK(i), 0);
+		priv->hw_watchpoint[i] = 0;
+		priv->hw_watchpoint_comp[i] = 0;
+		priv->hw_watchpoint_mask[i] = 0;
+		priv->hw_watchpoint_func[i] = 0;
+	}
+
+	/* Flash Patch Control Register: set ENABLE */
+	target_mem_write32(t, CORTEXM_FPB_CTRL,
+			CORTEXM_FPB_CTRL_KEY | CORTEXM_FPB_CTRL_ENABLE);
+
+	platform_srst_set_val(false);
+
+	return true;
+}
+
+void cortexm_detach(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+
+	/* Take any armed software breakpoints back out */
+	for(i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+		if (priv->sw_bp[i].armed) {
+			cortexm_sw_bp_write16(t, priv->sw_bp[i].addr,
+			                      priv->sw_bp[i].orig);
+			priv->sw_bp[i].armed = false;
+			priv->sw_bp[i].wanted = false;
+		}
+
+	/* Clear any stale breakpoints */
+	for(i = 0; i < priv->hw_breakpoint_max; i++)
+		target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+
+	/* Clear any stale watchpoints */
+	for(i = 0; i < priv->hw_watchpoint_max; i++)
+		target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+
+	/* Disable debug */
+	target_mem_write32(t, CORTEXM_DHCSR, CORTEXM_DHCSR_DBGKEY);
+}
+
+enum { DB_DHCSR, DB_DCRSR, DB_DCRDR, DB_DEMCR };
+
+static void cortexm_regs_read(target *t, void *data)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	uint32_t *regs = data;
+	unsigned i;
+
+	/* Set up word-size accesses and point TAR at the debug registers,
+	 * mapping the banked data registers (0x10-0x1c) to DHCSR, DCRSR,
+	 * DCRDR and DEMCR respectively */
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+	adiv5_ap_write(ap, ADIV5_AP_TAR, CORTEXM_DHCSR);
+
+	/* Walk the regnum_cortex_m array, selecting each register in
+	 * DCRSR and reading DCRDR back as a posted AP read.  The data
+	 * phase of a posted read returns the previous read's result, so
+	 * each select/read pair overlaps the fetch of the register
+	 * before it and the whole bank goes out as one contiguous burst,
+	 * with a final RDBUFF access collecting the last value. */
+	adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]);
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DB(DB_DCRDR), 0);
+	for(i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
+		adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR),
+		                     regnum_cortex_m[i]);
+		*regs++ = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+		                              ADIV5_AP_DB(DB_DCRDR), 0);
+	}
+	if (t->target_options & TOPT_FLAVOUR_V7MF)
+		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
+			adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR),
+			                     regnum_cortex_mf[i]);
+			*regs++ = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+			                              ADIV5_AP_DB(DB_DCRDR), 0);
+		}
+	*regs = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+	                            ADIV5_DP_RDBUFF, 0);
+	if (adiv5_flush(ap->dp))
+		DEBUG("cortexm_regs_read: sticky error after burst\n");
+}
+
+static void cortexm_regs_write(target *t, const void *data)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	const uint32_t *regs = data;
+	unsigned i;
+
+	/* Set up word-size accesses and point TAR at the debug registers,
+	 * mapping the banked data registers (0x10-0x1c) to DHCSR, DCRSR,
+	 * DCRDR and DEMCR respectively */
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+	adiv5_ap_write(ap, ADIV5_AP_TAR, CORTEXM_DHCSR);
+
+	/* Walk the regnum_cortex_m array, queueing a DCRDR/DCRSR write
+	 * pair for each register it calls out.  The sticky flags are
+	 * checked once for the whole batch at the flush below. */
+	for(i = 0; i < sizeof(regnum_cortex_m) / 4; i++) {
+		adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++);
+		adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR),
+		                     0x10000 | regnum_cortex_m[i]);
+	}
+	if (t->target_options & TOPT_FLAVOUR_V7MF)
+		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
+			adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRDR),
+			                     *regs++);
+			adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR),
+			                     0x10000 | regnum_cortex_mf[i]);
+		}
+	if (adiv5_flush(ap->dp))
+		DEBUG("cortexm_regs_write: sticky error after batch\n");
+}
+
+/* Map a GDB register number to the DCRSR register selector, or -1 if
+ * the register doesn't exist on this target. */
+static int cortexm_dcrsr_regnum(target *t, int reg)
+{
+	const unsigned n = sizeof(regnum_cortex_m) / 4;
+
+	if ((reg >= 0) && ((unsigned)reg < n))
+		return regnum_cortex_m[reg];
+	if ((t->target_options & TOPT_FLAVOUR_V7MF) &&
+	    ((unsigned)reg < n + sizeof(regnum_cortex_mf) / 4))
+		return regnum_cortex_mf[reg - n];
+	return -1;
+}
+
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max)
+{
+	int regnum = cortexm_dcrsr_regnum(t, reg);
+
+	if ((regnum < 0) || (max < 4))
+		return -1;
+	target_mem_write32(t, CORTEXM_DCRSR, regnum);
+	*(uint32_t *)data = target_mem_read32(t, CORTEXM_DCRDR);
+	return 4;
+}
+
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	int regnum = cortexm_dcrsr_regnum(t, reg);
+
+	if ((regnum < 0) || (size < 4))
+		return -1;
+	target_mem_write32(t, CORTEXM_DCRDR, *(const uint32_t *)data);
+	target_mem_write32(t, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | regnum);
+	return 4;
+}
+
+static uint32_t cortexm_pc_read(target *t)
+{
+	target_mem_write32(t, CORTEXM_DCRSR, 0x0F);
+	return target_mem_read32(t, CORTEXM_DCRDR);
+}
+
+static void cortexm_pc_write(target *t, const uint32_t val)
+{
+	target_mem_write32(t, CORTEXM_DCRDR, val);
+	target_mem_write32(t, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | 0x0F);
+}
+
+/* The following three routines implement target halt/resume
+ * using the core debug registers in the NVIC. */
+static void cortexm_reset(target *t)
+{
+	if ((t->target_options & CORTEXM_TOPT_INHIBIT_SRST) == 0) {
+		platform_srst_set_val(true);
+		if (target_srst_pulse_us)
+			platform_delay_us(target_srst_pulse_us);
+		platform_srst_set_val(false);
+	}
+
+	/* Read DHCSR here to clear S_RESET_ST bit before reset */
+	target_mem_read32(t, CORTEXM_DHCSR);
+
+	/* Request system reset from NVIC: SRST doesn't work correctly */
+	/* This could be VECTRESET: 0x05FA0001 (reset only core)
+	 *          or SYSRESETREQ: 0x05FA0004 (system reset)
+	 */
+	target_mem_write32(t, CORTEXM_AIRCR,
+	                   CORTEXM_AIRCR_VECTKEY | CORTEXM_AIRCR_SYSRESETREQ);
+
+	/* If target needs to do something extra (see Atmel SAM4L for example) */
+	if (t->extended_reset != NULL) {
+		t->extended_reset(t);
+	}
+
+	/* Poll for release from reset */
+	while (target_mem_read32(t, CORTEXM_DHCSR) & CORTEXM_DHCSR_S_RESET_ST);
+
+	if (target_reset_settle_us)
+		platform_delay_us(target_reset_settle_us);
+
+	/* Reset DFSR flags */
+	target_mem_write32(t, CORTEXM_DFSR, CORTEXM_DFSR_RESETALL);
+
+	/* RAM contents may be reinitialised by the reset, so neither the
+	 * armed BKPT opcodes nor the cached original instructions can be
+	 * trusted any more.  GDB re-inserts its breakpoints after a
+	 * restart anyway. */
+	struct cortexm_priv *priv = t->priv;
+	memset(priv->sw_bp, 0, sizeof(priv->sw_bp));
+}
+
+static void cortexm_halt_request(target *t)
+{
+	volatile struct exception e;
+	TRY_CATCH (e, EXCEPTION_TIMEOUT) {
+		target_mem_write32(t, CORTEXM_DHCSR, CORTEXM_DHCSR_DBGKEY |
+		                                          CORTEXM_DHCSR_C_HALT |
+		                                          CORTEXM_DHCSR_C_DEBUGEN);
+	}
+	if (e.type) {
+		tc_printf(t, "Timeout sending interrupt, is target in WFI?\n");
+	}
+}
+
+static void cortexm_hostlog_poll(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	uint32_t cb[4];		/* buffer, size, head, tail */
+	char data[64 + 1];
+	struct exception e;
+	/* Cap the bytes moved per poll so a chatty target can't starve
+	 * the DHCSR poll it piggybacks on */
+	unsigned budget = 4;
+
+	exception_defer_begin(&e, EXCEPTION_ALL);
+	{
+		target_mem_read(t, cb, priv->hostlog_cb + 4, sizeof(cb));
+		uint32_t size = cb[1], head = cb[2], tail = cb[3];
+		if ((head < size) && (tail < size)) {
+			while ((tail != head) && budget--) {
+				uint32_t len = (head > tail) ? head - tail
+				                             : size - tail;
+				if (len > sizeof(data) - 1)
+					len = sizeof(data) - 1;
+				target_mem_read(t, data, cb[0] + tail, len);
+				data[len] = '\0';
+				tc_printf(t, "%s", data);
+				tail = (tail + len == size) ? 0 : tail + len;
+			}
+			if (tail != cb[3])
+				target_mem_write32(t, priv->hostlog_cb + 0x10,
+				                   tail);
+		}
+	}
+	/* On a failed access just leave the data for the next poll */
+	exception_defer_end(&e);
+}
+
+#ifdef PLATFORM_HAS_TRACESWO
+/* Statistical profiler: while the target runs, each halt poll also
+ * takes a burst of DWT PCSR reads and streams them up the trace
+ * endpoint, so the wire time between DHCSR polls does useful work.
+ * Records are 4 bytes little-endian: PCs are even, so bit 0 set marks
+ * a run-length record meaning "previous PC repeated (value >> 1) more
+ * times".  0xFFFFFFFF reads (core halted or PCSR unimplemented) are
+ * discarded. */
+static void cortexm_profile_emit(uint32_t val)
+{
+	uint8_t rec[4] = {val & 0xff, (val >> 8) & 0xff,
+	                  (val >> 16) & 0xff, (val >> 24) & 0xff};
+	trace_buf_push(rec, sizeof(rec));
+}
+
+static void cortexm_profile_poll(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	struct exception e;
+	/* Cap the samples per poll so profiling can't starve the DHCSR
+	 * poll it piggybacks on */
+	unsigned budget = 16;
+
+	exception_defer_begin(&e, EXCEPTION_ALL);
+	while (budget--) {
+		uint32_t pc = target_mem_read32(t, CORTEXM_DWT_PCSR);
+		if ((pc == 0xffffffff) || (pc & 1))
+			continue;
+		if (pc == priv->profile_last_pc) {
+			priv->profile_rep++;
+			continue;
+		}
+		if (priv->profile_rep) {
+			cortexm_profile_emit((priv->profile_rep << 1) | 1);
+			priv->profile_rep = 0;
+		}
+		cortexm_profile_emit(pc);
+		priv->profile_last_pc = pc;
+	}
+	/* On a failed access just resume sampling on the next poll */
+	exception_defer_end(&e);
+}
+#endif
+
+#ifdef PLATFORM_HAS_TRACESWO
+/* Live watch: sample the registered addresses once per halt poll and
+ * stream them up the trace endpoint, so slowly-changing state can be
+ * observed at the poll rate without ever halting the target.  Each
+ * record is:
+ *
+ *   0xA5, slot, len, time_ms (4 bytes LE), value (len bytes)
+ *
+ * The leading magic lets a host tool resynchronise in a lossy
+ * capture; the timestamp granularity is the platform tick. */
+static void cortexm_watch_poll(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	uint8_t rec[7 + 8];
+	struct exception e;
+
+	exception_defer_begin(&e, EXCEPTION_ALL);
+	for (unsigned i = 0; i < CORTEXM_WATCH_SLOTS; i++) {
+		uint8_t len = priv->watch_list[i].len;
+		if (!len)
+			continue;
+		uint32_t ms = platform_time_ms();
+		rec[0] = 0xA5;
+		rec[1] = i;
+		rec[2] = len;
+		rec[3] = ms & 0xff;
+		rec[4] = (ms >> 8) & 0xff;
+		rec[5] = (ms >> 16) & 0xff;
+		rec[6] = (ms >> 24) & 0xff;
+		target_mem_read(t, rec + 7, priv->watch_list[i].addr, len);
+		trace_buf_push(rec, 7 + len);
+	}
+	/* On a failed access just sample again on the next poll */
+	exception_defer_end(&e);
+}
+#endif
+
+static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	uint32_t dhcsr = 0;
+	struct exception e;
+	/* This runs on every poll iteration while the target executes,
+	 * so take the deferred path rather than paying for a setjmp
+	 * frame each time; a failed poll just yields a dhcsr of zero. */
+	exception_defer_begin(&e, EXCEPTION_ALL);
+	{
+		/* If this times out because the target is in WFI then
+		 * the target is still running. */
+		/* The fast path is only sound while TAR still points at
+		 * the debug register window from the resume write; any
+		 * interleaved memory access -- the hostlog/profile/watch
+		 * pollers below, or GDB 'm' reads serviced between polls
+		 * of a backgrounded step in non-stop mode -- moves it
+		 * and clears tar_parked, forcing the full memory access,
+		 * which reprograms CSW and TAR. */
+		ADIv5_AP_t *ap = cortexm_ap(t);
+		if (priv->stepping && ap->tar_parked) {
+			/* Step fast path: the resume write left TAR
+			 * pointing into the debug register block, so DHCSR
+			 * is visible in banked data register 0 and a posted
+			 * read pair polls it in two transactions, three
+			 * when SELECT needs pointing back at the bank.  A
+			 * full memory access would redo CSW and TAR each
+			 * poll, and step-heavy sessions poll a lot. */
+			ADIv5_DP_t *dp = ap->dp;
+			uint32_t select = ((uint32_t)ap->apsel << 24) |
+				(ADIV5_AP_DB(DB_DHCSR) & 0xF0);
+			if (!dp->select_valid || (dp->select != select)) {
+				adiv5_dp_write(dp, ADIV5_DP_SELECT, select);
+				dp->select = select;
+				dp->select_valid = true;
+				ap->last_csw = 0;
+			}
+			adiv5_dp_low_access(dp, ADIV5_LOW_READ,
+					    ADIV5_AP_DB(DB_DHCSR), 0);
+			dhcsr = adiv5_dp_low_access(dp, ADIV5_LOW_READ,
+						    ADIV5_DP_RDBUFF, 0);
+		} else {
+			dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
+		}
+	}
+	switch (exception_defer_end(&e)) {
+	case EXCEPTION_ERROR:
+		/* Oh crap, there's no recovery from this... */
+		target_list_free();
+		return TARGET_HALT_ERROR;
+	case EXCEPTION_TIMEOUT:
+		/* Timeout isn't a problem, target could be in WFI */
+		return TARGET_HALT_RUNNING;
+	}
+
+	if (!(dhcsr & CORTEXM_DHCSR_S_HALT)) {
+		if (priv->hostlog_cb)
+			cortexm_hostlog_poll(t);
+#ifdef PLATFORM_HAS_TRACESWO
+		if (priv->profile_on)
+			cortexm_profile_poll(t);
+		if (priv->watch_count)
+			cortexm_watch_poll(t);
+#endif
+		return TARGET_HALT_RUNNING;
+	}
+
+	/* We've halted.  Let's find out why. */
+	uint32_t dfsr = target_mem_read32(t, CORTEXM_DFSR);
+	target_mem_write32(t, CORTEXM_DFSR, dfsr); /* write back to reset */
+
+	if ((dfsr & CORTEXM_DFSR_VCATCH) && cortexm_fault_unwind(t))
+		return TARGET_HALT_FAULT;
+
+	/* Remember if we stopped on a breakpoint */
+	priv->on_bkpt = dfsr & (CORTEXM_DFSR_BKPT);
+	if (priv->on_bkpt) {
+		/* If we've hit a programmed breakpoint, check for semihosting
+		 * call. */
+		uint32_t pc = cortexm_pc_read(t);
+		uint16_t bkpt_instr;
+		bkpt_instr = target_mem_read16(t, pc);
+		if (bkpt_instr == 0xBEAB) {
+			if (cortexm_hostio_request(t)) {
+				return TARGET_HALT_REQUEST;
+			} else {
+				target_halt_resume(t, priv->stepping);
+				return 0;
+			}
+		}
+	}
+
+	if (dfsr & CORTEXM_DFSR_DWTTRAP) {
+		if (watch != NULL)
+			*watch = cortexm_check_watch(t);
+		return TARGET_HALT_WATCHPOINT;
+	}
+	if (dfsr & CORTEXM_DFSR_BKPT)
+		return TARGET_HALT_BREAKPOINT;
+
+	if (dfsr & CORTEXM_DFSR_HALTED)
+		return priv->stepping ? TARGET_HALT_STEPPING : TARGET_HALT_REQUEST;
+
+	return TARGET_HALT_BREAKPOINT;
+}
+
+void cortexm_halt_resume(target *t, bool step)
+{
+	struct cortexm_priv *priv = t->priv;
+	uint32_t dhcsr = CORTEXM_DHCSR_DBGKEY | CORTEXM_DHCSR_C_DEBUGEN;
+
+	if (step)
+		dhcsr |= CORTEXM_DHCSR_C_STEP | CORTEXM_DHCSR_C_MASKINTS;
+
+	/* Disable interrupts while single stepping... */
+	if(step != priv->stepping) {
+		target_mem_write32(t, CORTEXM_DHCSR, dhcsr | CORTEXM_DHCSR_C_HALT);
+		priv->stepping = step;
+	}
+
+	if (priv->on_bkpt) {
+		uint32_t pc = cortexm_pc_read(t);
+		if ((target_mem_read16(t, pc) & 0xFF00) == 0xBE00)
+			cortexm_pc_write(t, pc + 2);
+	}
+
+	/* Disarm comparators cleared since we halted but not re-claimed.
+	 * Clears are deferred to here so that GDB removing and re-inserting
+	 * an unchanged breakpoint costs no comparator writes at all. */
+	for (unsigned i = 0; i < priv->hw_breakpoint_max; i++)
+		if (!priv->hw_breakpoint[i] && (priv->hw_breakpoint_comp[i] & 1)) {
+			target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+			priv->hw_breakpoint_comp[i] = 0;
+		}
+	for (unsigned i = 0; i < priv->hw_watchpoint_max; i++)
+		if (!priv->hw_watchpoint[i] && priv->hw_watchpoint_func[i]) {
+			target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+			priv->hw_watchpoint_func[i] = 0;
+		}
+
+	/* Arm pending software breakpoints as one batch.  With the
+	 * original instruction cached, each one is a single write; the
+	 * separate read-modify insertion GDB would otherwise drive is
+	 * gone entirely. */
+	for (unsigned i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+		if (priv->sw_bp[i].wanted && !priv->sw_bp[i].armed) {
+			if (!priv->sw_bp[i].cached) {
+				/* A memory write invalidated the saved
+				 * instruction; re-read it */
+				priv->sw_bp[i].orig = target_mem_read16(t,
+						priv->sw_bp[i].addr);
+				priv->sw_bp[i].cached = true;
+			}
+			cortexm_sw_bp_write16(t, priv->sw_bp[i].addr,
+			                      CORTEXM_BKPT_INSTR);
+			priv->sw_bp[i].armed = true;
+		}
+
+	target_mem_write32(t, CORTEXM_DHCSR, dhcsr);
+	/* That write left TAR parked on the debug register window with
+	 * word-size accesses; the step poll's banked DHCSR fast path is
+	 * valid until something moves TAR again. */
+	cortexm_ap(t)->tar_parked = true;
+}
+
+static int cortexm_fault_unwind(target *t)
+{
+	uint32_t hfsr = target_mem_read32(t, CORTEXM_HFSR);
+	uint32_t cfsr = target_mem_read32(t, CORTEXM_CFSR);
+	target_mem_write32(t, CORTEXM_HFSR, hfsr);/* write back to reset */
+	target_mem_write32(t, CORTEXM_CFSR, cfsr);/* write back to reset */
+	/* We check for FORCED in the HardFault Status Register or
+	 * for a configurable fault to avoid catching core resets */
+	if((hfsr & CORTEXM_HFSR_FORCED) || cfsr) {
+		/* Unwind exception */
+		uint32_t regs[t->regs_size / 4];
+		uint32_t stack[8];
+		uint32_t retcode, framesize;
+		/* Read registers for post-exception stack pointer */
+		target_regs_read(t, regs);
+		/* save retcode currently in lr */
+		retcode = regs[REG_LR];
+		bool spsel = retcode & (1<<2);
+		bool fpca = !(retcode & (1<<4));
+		/* Read stack for pre-exception registers */
+		uint32_t sp = spsel ? regs[REG_PSP] : regs[REG_MSP];
+		target_mem_read(t, stack, sp, sizeof(stack));
+		if (target_check_error(t))
+			return 0;
+		regs[REG_LR] = stack[5];	/* restore LR to pre-exception state */
+		regs[REG_PC] = stack[6];	/* restore PC to pre-exception state */
+
+		/* adjust stack to pop exception state */
+		framesize = fpca ? 0x68 : 0x20;	/* check for basic vs. extended frame */
+		if (stack[7] & (1<<9))				/* check for stack alignment fixup */
+			framesize += 4;
+
+		if (spsel) {
+			regs[REG_SPECIAL] |= 0x4000000;
+			regs[REG_SP] = regs[REG_PSP] += framesize;
+		} else {
+			regs[REG_SP] = regs[REG_MSP] += framesize;
+		}
+
+		if (fpca)
+			regs[REG_SPECIAL] |= 0x2000000;
+
+		/* FIXME: stack[7] contains xPSR when this is supported */
+		/* although, if we caught the exception it will be unchanged */
+
+		/* Reset exception state to allow resuming from restored
+		 * state.
+		 */
+		target_mem_write32(t, CORTEXM_AIRCR,
+				CORTEXM_AIRCR_VECTKEY | CORTEXM_AIRCR_VECTCLRACTIVE);
+
+		/* Write pre-exception registers back to core */
+		target_regs_write(t, regs);
+
+		return 1;
+	}
+	return 0;
+}
+
+/* Start a stub running without waiting for it to finish.  While the
+ * stub executes the debug port stays available, so the caller can
+ * stream the next data block into target RAM before collecting the
+ * result with cortexm_run_stub_wait(). */
+int cortexm_run_stub_start(target *t, uint32_t loadaddr,
+                           uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
+{
+	uint32_t regs[t->regs_size / 4];
+
+	memset(regs, 0, sizeof(regs));
+	regs[0] = r0;
+	regs[1] = r1;
+	regs[2] = r2;
+	regs[3] = r3;
+	regs[15] = loadaddr;
+	regs[16] = 0x1000000;
+	regs[19] = 0;
+
+	cortexm_regs_write(t, regs);
+
+	if (target_check_error(t))
+		return -1;
+
+	/* Execute the stub */
+	cortexm_halt_resume(t, 0);
+	return 0;
+}
+
+/* Wait for a stub started with cortexm_run_stub_start() and return its
+ * exit code */
+int cortexm_run_stub_wait(target *t)
+{
+	enum target_halt_reason reason;
+	while ((reason = cortexm_halt_poll(t, NULL)) == TARGET_HALT_RUNNING)
+		;
+
+	if (reason == TARGET_HALT_ERROR)
+		raise_exception(EXCEPTION_ERROR, "Target lost in stub");
+
+	if (reason != TARGET_HALT_BREAKPOINT)
+		return -2;
+
+	uint32_t pc = cortexm_pc_read(t);
+	uint16_t bkpt_instr = target_mem_read16(t, pc);
+	if (bkpt_instr >> 8 != 0xbe)
+		return -2;
+
+	return bkpt_instr & 0xff;
+}
+
+int cortexm_run_stub(target *t, uint32_t loadaddr,
+                     uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
+{
+	int ret = cortexm_run_stub_start(t, loadaddr, r0, r1, r2, r3);
+	if (ret)
+		return ret;
+
+	return cortexm_run_stub_wait(t);
+}
+
+int cortexm_stub_flash_write(target *t, struct cortexm_stub *s,
+                             uint32_t dest, const void *src, size_t len)
+{
+	int ret;
+
+	/* Load the stub once per sequence; it stays resident */
+	if (!s->loaded) {
+		target_mem_write(t, s->loadaddr, s->code, s->code_size);
+		s->loaded = true;
+	}
+
+	/* Ping-pong buffers only when the part has RAM for two */
+	bool double_buf = target_ram_avail(t, s->bufaddr) >= 2 * s->bufsize;
+
+	while (len) {
+		size_t chunk = MIN(len, s->bufsize);
+		uint32_t buf = s->bufaddr + (s->which ? s->bufsize : 0);
+
+		/* With a single buffer the running stub must finish
+		 * before the next block can stage over it */
+		if (s->running && !double_buf) {
+			s->running = false;
+			if ((ret = cortexm_run_stub_wait(t)))
+				return ret;
+		}
+
+		/* Stage the next block; with two buffers this streams
+		 * while the stub is still programming the previous one */
+		target_mem_write(t, buf, src, chunk);
+
+		if (s->running) {
+			s->running = false;
+			if ((ret = cortexm_run_stub_wait(t)))
+				return ret;
+		}
+
+		if (cortexm_run_stub_start(t, s->loadaddr, dest, buf,
+		                           chunk, s->r3))
+			return -1;
+		s->running = true;
+		if (double_buf)
+			s->which ^= 1;
+
+		dest += chunk;
+		src = (const uint8_t *)src + chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+/* Collect a still-running stub without ending the sequence: the stub
+ * stays loaded and the buffers keep their roles.  Used to quiesce the
+ * flash controller before an interleaved erase. */
+int cortexm_stub_flash_drain(target *t, struct cortexm_stub *s)
+{
+	if (s->running) {
+		s->running = false;
+		return cortexm_run_stub_wait(t);
+	}
+	return 0;
+}
+
+int cortexm_stub_flash_done(target *t, struct cortexm_stub *s)
+{
+	int ret = 0;
+
+	/* Collect the status of the last pipelined block */
+	if (s->running) {
+		s->running = false;
+		ret = cortexm_run_stub_wait(t);
+	}
+	/* The target may run and clobber RAM before the next sequence */
+	s->loaded = false;
+	s->which = 0;
+	return ret;
+}
+
+/* The following routines implement hardware breakpoints and watchpoints.
+ * The Flash Patch and Breakpoint (FPB) and Data Watch and Trace (DWT)
+ * systems are used. */
+
+static uint32_t dwt_mask(size_t len)
+{
+	switch (len) {
+	case 1:
+		return CORTEXM_DWT_MASK_BYTE;
+	case 2:
+		return CORTEXM_DWT_MASK_HALFWORD;
+	case 4:
+		return CORTEXM_DWT_MASK_WORD;
+	default:
+		return -1;
+	}
+}
+
+static uint32_t dwt_func(target *t, enum target_breakwatch type)
+{
+	uint32_t x = 0;
+
+	if ((t->target_options & TOPT_FLAVOUR_V6M) == 0)
+		x = CORTEXM_DWT_FUNC_DATAVSIZE_WORD;
+
+	switch (type) {
+	case TARGET_WATCH_WRITE:
+		return CORTEXM_DWT_FUNC_FUNC_WRITE | x;
+	case TARGET_WATCH_READ:
+		return CORTEXM_DWT_FUNC_FUNC_READ | x;
+	case TARGET_WATCH_ACCESS:
+		return CORTEXM_DWT_FUNC_FUNC_ACCESS | x;
+	default:
+		return -1;
+	}
+}
+
+static int cortexm_breakwatch_set(target *t, struct breakwatch *bw)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+	uint32_t val = bw->addr;
+	uint32_t mask, func;
+
+	switch (bw->type) {
+	case TARGET_BREAK_SOFT:
+		if (bw->size != 2)
+			return 1;
+
+		/* Prefer the slot still caching this address */
+		for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+			if (priv->sw_bp[i].cached &&
+			    (priv->sw_bp[i].addr == bw->addr))
+				break;
+		if (i == CORTEXM_MAX_SW_BREAKPOINTS)
+			for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+				if (!priv->sw_bp[i].wanted &&
+				    !priv->sw_bp[i].armed &&
+				    !priv->sw_bp[i].cached)
+					break;
+		if (i == CORTEXM_MAX_SW_BREAKPOINTS)
+			/* Evict an idle slot's cache entry */
+			for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+				if (!priv->sw_bp[i].wanted &&
+				    !priv->sw_bp[i].armed) {
+					priv->sw_bp[i].cached = false;
+					break;
+				}
+		if (i == CORTEXM_MAX_SW_BREAKPOINTS)
+			/* Out of slots; let GDB fall back to patching
+			 * memory itself */
+			return 1;
+
+		if (!priv->sw_bp[i].cached) {
+			priv->sw_bp[i].addr = bw->addr;
+			priv->sw_bp[i].orig = target_mem_read16(t, bw->addr);
+			if (target_check_error(t))
+				return -1;
+			priv->sw_bp[i].cached = true;
+		}
+		/* The BKPT write itself is deferred to resume */
+		priv->sw_bp[i].wanted = true;
+		bw->reserved[0] = i;
+		return 0;
+
+	case TARGET_BREAK_HARD:
+		if (priv->flash_patch_revision == 0) {
+			val &= 0x1FFFFFFC;
+			val |= (bw->addr & 2)?0x80000000:0x40000000;
+		}
+		val |= 1;
+
+		/* Prefer a free unit whose comparator still holds this
+		 * value from a previous insertion */
+		for(i = 0; i < priv->hw_breakpoint_max; i++)
+			if (!priv->hw_breakpoint[i] &&
+			    (priv->hw_breakpoint_comp[i] == val))
+				break;
+		if (i == priv->hw_breakpoint_max)
+			for(i = 0; i < priv->hw_breakpoint_max; i++)
+				if (!priv->hw_breakpoint[i])
+					break;
+
+		if (i == priv->hw_breakpoint_max)
+			return -1;
+
+		priv->hw_breakpoint[i] = true;
+		if (priv->hw_breakpoint_comp[i] != val) {
+			target_mem_write32(t, CORTEXM_FPB_COMP(i), val);
+			priv->hw_breakpoint_comp[i] = val;
+		}
+		bw->reserved[0] = i;
+		return 0;
+
+	case TARGET_WATCH_WRITE:
+	case TARGET_WATCH_READ:
+	case TARGET_WATCH_ACCESS:
+		mask = dwt_mask(bw->size);
+		func = dwt_func(t, bw->type);
+
+		for(i = 0; i < priv->hw_watchpoint_max; i++)
+			if (!priv->hw_watchpoint[i] &&
+			    (priv->hw_watchpoint_comp[i] == val) &&
+			    (priv->hw_watchpoint_mask[i] == mask) &&
+			    (priv->hw_watchpoint_func[i] == func))
+				break;
+		if (i == priv->hw_watchpoint_max)
+			for(i = 0; i < priv->hw_watchpoint_max; i++)
+				if (!priv->hw_watchpoint[i])
+					break;
+
+		if (i == priv->hw_watchpoint_max)
+			return -1;
+
+		priv->hw_watchpoint[i] = true;
+
+		if (priv->hw_watchpoint_comp[i] != val) {
+			target_mem_write32(t, CORTEXM_DWT_COMP(i), val);
+			priv->hw_watchpoint_comp[i] = val;
+		}
+		if (priv->hw_watchpoint_mask[i] != mask) {
+			target_mem_write32(t, CORTEXM_DWT_MASK(i), mask);
+			priv->hw_watchpoint_mask[i] = mask;
+		}
+		if (priv->hw_watchpoint_func[i] != func) {
+			target_mem_write32(t, CORTEXM_DWT_FUNC(i), func);
+			priv->hw_watchpoint_func[i] = func;
+		}
+
+		bw->reserved[0] = i;
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static int cortexm_breakwatch_clear(target *t, struct breakwatch *bw)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i = bw->reserved[0];
+	switch (bw->type) {
+	case TARGET_BREAK_SOFT:
+		priv->sw_bp[i].wanted = false;
+		/* Restore the original instruction now: the core is
+		 * halted, and GDB may read or disassemble this memory
+		 * before resuming.  The cache entry stays, so a later
+		 * re-insertion costs a single write. */
+		if (priv->sw_bp[i].armed) {
+			cortexm_sw_bp_write16(t, priv->sw_bp[i].addr,
+			                      priv->sw_bp[i].orig);
+			priv->sw_bp[i].armed = false;
+		}
+		return 0;
+	case TARGET_BREAK_HARD:
+		/* The comparator is left programmed so that an identical
+		 * re-insertion is free; it is disarmed on resume if still
+		 * unclaimed.  The core is halted, so it cannot fire. */
+		priv->hw_breakpoint[i] = false;
+		return 0;
+	case TARGET_WATCH_WRITE:
+	case TARGET_WATCH_READ:
+	case TARGET_WATCH_ACCESS:
+		priv->hw_watchpoint[i] = false;
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static target_addr cortexm_check_watch(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+
+	for(i = 0; i < priv->hw_watchpoint_max; i++)
+		/* if SET and MATCHED then break */
+		if(priv->hw_watchpoint[i] &&
+		   (target_mem_read32(t, CORTEXM_DWT_FUNC(i)) &
+					CORTEXM_DWT_FUNC_MATCHED))
+			break;
+
+	if (i == priv->hw_watchpoint_max)
+		return 0;
+
+	return target_mem_read32(t, CORTEXM_DWT_COMP(i));
+}
+
+static bool cortexm_vector_catch(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+	const char *vectors[] = {"reset", NULL, NULL, NULL, "mm", "nocp",
+				"chk", "stat", "bus", "int", "hard"};
+	uint32_t tmp = 0;
+	unsigned i;
+
+	if ((argc < 3) || ((argv[1][0] != 'e') && (argv[1][0] != 'd'))) {
+		tc_printf(t, "usage: monitor vector_catch (enable|disable) "
+			     "(hard|int|bus|stat|chk|nocp|mm|reset)\n");
+	} else {
+		for (int j = 0; j < argc; j++)
+			for (i = 0; i < sizeof(vectors) / sizeof(char*); i++) {
+				if (vectors[i] && !strcmp(vectors[i], argv[j]))
+					tmp |= 1 << i;
+			}
+
+		if (argv[1][0] == 'e')
+			priv->demcr |= tmp;
+		else
+			priv->demcr &= ~tmp;
+
+		target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
+	}
+
+	tc_printf(t, "Catching vectors: ");
+	for (i = 0; i < sizeof(vectors) / sizeof(char*); i++) {
+		if (!vectors[i])
+			continue;
+		if (priv->demcr & (1 << i))
+			tc_printf(t, "%s ", vectors[i]);
+	}
+	tc_printf(t, "\n");
+	return true;
+}
+
+static bool cortexm_hostlog(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (argc < 2) {
+		if (priv->hostlog_cb)
+			tc_printf(t, "Host log channel at 0x%08"PRIx32"\n",
+			          priv->hostlog_cb);
+		else
+			tc_printf(t, "Host log channel disabled\n");
+		return true;
+	}
+
+	if (argv[1][0] == 'd') {
+		priv->hostlog_cb = 0;
+		return true;
+	}
+
+	target_addr addr = strtoul(argv[1], NULL, 0);
+	if (target_mem_read32(t, addr) != CORTEXM_HOSTLOG_MAGIC) {
+		tc_printf(t, "No log channel magic at 0x%08"PRIx32"\n", addr);
+		return false;
+	}
+	priv->hostlog_cb = addr;
+	return true;
+}
+
+#ifdef PLATFORM_HAS_TRACESWO
+static bool cortexm_profile(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if ((argc == 2) && !strcmp(argv[1], "start")) {
+		priv->demcr |= CORTEXM_DEMCR_TRCENA;
+		target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
+		priv->profile_last_pc = 0xffffffff;
+		priv->profile_rep = 0;
+		priv->profile_on = true;
+		tc_printf(t, "Profiling: PC samples stream on the trace "
+			     "interface while the target runs\n");
+	} else if ((argc == 2) && !strcmp(argv[1], "stop")) {
+		priv->profile_on = false;
+		/* Flush the run length of the final sample */
+		if (priv->profile_rep) {
+			cortexm_profile_emit((priv->profile_rep << 1) | 1);
+			priv->profile_rep = 0;
+		}
+	} else {
+		tc_printf(t, "usage: monitor profile (start|stop)\n");
+	}
+	return true;
+}
+
+static bool cortexm_watch(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+
+	if ((argc == 4) && !strcmp(argv[1], "add")) {
+		uint32_t addr = strtoul(argv[2], NULL, 0);
+		uint32_t len = strtoul(argv[3], NULL, 0);
+		if ((len < 1) || (len > 8)) {
+			tc_printf(t, "length must be 1 to 8 bytes\n");
+			return false;
+		}
+		for (i = 0; i < CORTEXM_WATCH_SLOTS; i++)
+			if (!priv->watch_list[i].len)
+				break;
+		if (i == CORTEXM_WATCH_SLOTS) {
+			tc_printf(t, "watch list full\n");
+			return false;
+		}
+		priv->watch_list[i].addr = addr;
+		priv->watch_list[i].len = len;
+		priv->watch_count++;
+		tc_printf(t, "watch %d: 0x%08"PRIx32"+%"PRIu32", streaming "
+			     "on the trace interface while the target runs\n",
+			  i, addr, len);
+	} else if ((argc == 2) && !strcmp(argv[1], "clear")) {
+		for (i = 0; i < CORTEXM_WATCH_SLOTS; i++)
+			priv->watch_list[i].len = 0;
+		priv->watch_count = 0;
+	} else if ((argc == 2) && !strcmp(argv[1], "show")) {
+		for (i = 0; i < CORTEXM_WATCH_SLOTS; i++)
+			if (priv->watch_list[i].len)
+				tc_printf(t, "watch %d: 0x%08"PRIx32"+%d\n",
+					  i, priv->watch_list[i].addr,
+					  priv->watch_list[i].len);
+	} else {
+		tc_printf(t, "usage: monitor watch "
+			     "(add <addr> <len>|show|clear)\n");
+	}
+	return true;
+}
+#endif
+
+/* Windows defines this with some other meaning... */
+#ifdef SYS_OPEN
+#	undef SYS_OPEN
+#endif
+
+/* Semihosting support */
+/* ARM Semihosting syscall numbers, from ARM doc DUI0471C, Chapter 8 */
+#define SYS_CLOSE	0x02
+#define SYS_CLOCK	0x10
+#define SYS_ELAPSED	0x30
+#define SYS_ERRNO	0x13
+#define SYS_FLEN	0x0C
+#define SYS_GET_CMDLINE	0x15
+#define SYS_HEAPINFO	0x16
+#define SYS_ISERROR	0x08
+#define SYS_ISTTY	0x09
+#define SYS_OPEN	0x01
+#define SYS_READ	0x06
+#define SYS_READC	0x07
+#define SYS_REMOVE	0x0E
+#define SYS_RENAME	0x0F
+#define SYS_SEEK	0x0A
+#define SYS_SYSTEM	0x12
+#define SYS_TICKFREQ	0x31
+#define SYS_TIME	0x11
+#define SYS_TMPNAM	0x0D
+#define SYS_WRITE	0x05
+#define SYS_WRITEC	0x03
+#define SYS_WRITE0	0x04
+
+static int cortexm_hostio_request(target *t)
+{
+	uint32_t arm_regs[t->regs_size];
+	uint32_t params[4];
+
+	t->tc->interrupted = false;
+	target_regs_read(t, arm_regs);
+	target_mem_read(t, params, arm_regs[1], sizeof(params));
+	uint32_t syscall = arm_regs[0];
+	int32_t ret = 0;
+
+	DEBUG("syscall 0"PRIx32"%"PRIx32" (%"PRIx32" %"PRIx32" %"PRIx32" %"PRIx32")\n",
+              syscall, params[0], params[1], params[2], params[3]);
+	switch (syscall) {
+	case SYS_OPEN:{	/* open */
+		/* Translate stupid fopen modes to open flags.
+		 * See DUI0471C, Table 8-3 */
+		const uint32_t flags[] = {
+			TARGET_O_RDONLY,	/* r, rb */
+			TARGET_O_RDWR,		/* r+, r+b */
+			TARGET_O_WRONLY | TARGET_O_CREAT | TARGET_O_TRUNC,/*w*/
+			TARGET_O_RDWR | TARGET_O_CREAT | TARGET_O_TRUNC,/*w+*/
+			TARGET_O_WRONLY | TARGET_O_CREAT | TARGET_O_APPEND,/*a*/
+			TARGET_O_RDWR | TARGET_O_CREAT | TARGET_O_APPEND,/*a+*/
+		};
+		uint32_t pflag = flags[params[1] >> 1];
+		char filename[4];
+
+		target_mem_read(t, filename, params[0], sizeof(filename));
+		/* handle requests for console i/o */
+		if (!strcmp(filename, ":tt")) {
+			if (pflag == TARGET_O_RDONLY)
+				ret = STDIN_FILENO;
+			else if (pflag & TARGET_O_TRUNC)
+				ret = STDOUT_FILENO;
+			else
+				ret = STDERR_FILENO;
+			ret++;
+			break;
+		}
+
+		ret = tc_open(t, params[0], params[2] + 1, pflag, 0644);
+		if (ret != -1)
+			ret++;
+		break;
+		}
+	case SYS_CLOSE:	/* close */
+		ret = tc_close(t, params[0] - 1);
+		break;
+	case SYS_READ:	/* read */
+		ret = tc_read(t, params[0] - 1, params[1], params[2]);
+		if (ret > 0)
+			ret = params[2] - ret;
+		break;
+	case SYS_WRITE:	/* write */
+		ret = tc_write(t, params[0] - 1, params[1], params[2]);
+		if (ret > 0)
+			ret = params[2] - ret;
+		break;
+	case SYS_WRITEC: /* writec */
+		ret = tc_write(t, 2, arm_regs[1], 1);
+		break;
+	case SYS_ISTTY:	/* isatty */
+		ret = tc_isatty(t, params[0] - 1);
+		break;
+	case SYS_SEEK:	/* lseek */
+		ret = tc_lseek(t, params[0] - 1, params[1], TARGET_SEEK_SET);
+		break;
+	case SYS_RENAME:/* rename */
+		ret = tc_rename(t, params[0] - 1, params[1] + 1,
+				params[2], params[3] + 1);
+		break;
+	case SYS_REMOVE:/* unlink */
+		ret = tc_unlink(t, params[0] - 1, params[1] + 1);
+		break;
+	case SYS_SYSTEM:/* system */
+		ret = tc_system(t, params[0] - 1, params[1] + 1);
+		break;
+
+	case SYS_FLEN:	/* Not supported, fake success */
+		t->tc->errno_ = 0;
+		break;
+
+	case SYS_ERRNO: /* Return last errno from GDB */
+		ret = t->tc->errno_;
+		break;
+
+	case SYS_TIME:	/* gettimeofday */
+		/* FIXME How do we use gdb's gettimeofday? */
+		break;
+	}
+
+	arm_regs[0] = ret;
+	target_regs_write(t, arm_regs);
+
+	return t->tc->interrupted;
+}
+
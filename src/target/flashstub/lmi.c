@@ -0,0 +1,72 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+
+#define LMI_FLASH_BASE       ((volatile uint32_t *)0x400FD000)
+#define LMI_FLASH_FMA        LMI_FLASH_BASE[0]
+#define LMI_FLASH_FMD        LMI_FLASH_BASE[1]
+#define LMI_FLASH_FMC        LMI_FLASH_BASE[2]
+#define LMI_FLASH_FMC2       LMI_FLASH_BASE[8]
+#define LMI_FLASH_FWB        (&LMI_FLASH_BASE[0x40])
+
+#define LMI_FLASH_FMC_WRITE  (1 << 0)
+#define LMI_FLASH_FMC_ERASE  (1 << 1)
+#define LMI_FLASH_FMC_MERASE (1 << 2)
+#define LMI_FLASH_FMC_COMT   (1 << 3)
+#define LMI_FLASH_FMC_WRKEY  0xA4420000
+
+#define LMI_FLASH_FMC2_WRBUF (1 << 0)
+
+/* use_fmb is nonzero on parts with the 32-word write buffer
+ * (Tempest/Tiva classes); aligned 32-word runs then go through
+ * FWB0..31 and FMC2.WRBUF, one flash operation per 128 bytes.
+ * Everything else (and all of it on older parts) is programmed a
+ * word at a time through FMD. */
+void __attribute__((naked))
+lmi_flash_write_stub(uint32_t *dest, uint32_t *src, uint32_t size,
+                     uint32_t use_fmb)
+{
+	size /= 4;
+	while (size) {
+		if (use_fmb && !((uint32_t)dest & 127) && (size >= 32)) {
+			LMI_FLASH_FMA = (uint32_t)dest;
+			stub_copy_words(LMI_FLASH_FWB, src, 128);
+			src += 32;
+			LMI_FLASH_FMC2 = LMI_FLASH_FMC_WRKEY |
+			                 LMI_FLASH_FMC2_WRBUF;
+			while (LMI_FLASH_FMC2 & LMI_FLASH_FMC2_WRBUF)
+				;
+			dest += 32;
+			size -= 32;
+		} else {
+			LMI_FLASH_FMA = (uint32_t)dest;
+			LMI_FLASH_FMD = *src++;
+			LMI_FLASH_FMC = LMI_FLASH_FMC_WRKEY |
+			                LMI_FLASH_FMC_WRITE;
+			while (LMI_FLASH_FMC & LMI_FLASH_FMC_WRITE)
+				;
+			dest++;
+			size--;
+		}
+	}
+
+	stub_exit(0);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "libopencm3/stm32/flash.h"
+#include "stub.h"
+
+#define SR_ERROR_MASK 0x14
+
+/* Fused erase+program.  dest must be page aligned when pagesize is
+ * given; pagesize == 0 programs without erasing (for pages known to be
+ * blank already).  Each page is erased immediately before it is
+ * programmed back, with FLASH_SR polled on-target throughout, so the
+ * debugger never busy-polls the flash controller over the wire. */
+void __attribute__((naked))
+stm32f1_flash_ep_stub(uint16_t *dest, uint16_t *src, uint32_t size,
+                      uint32_t pagesize)
+{
+	uint32_t done = 0;
+	while (done < size) {
+		if (pagesize) {
+			/* Erase the page under the write pointer */
+			FLASH_CR = FLASH_CR_PER;
+			FLASH_AR = (uint32_t)dest;
+			FLASH_CR = FLASH_CR_STRT | FLASH_CR_PER;
+			while (FLASH_SR & FLASH_SR_BSY)
+				;
+		}
+		uint32_t chunk = pagesize ? pagesize : size;
+		if (chunk > size - done)
+			chunk = size - done;
+		/* Program the chunk back, a halfword at a time */
+		FLASH_CR = FLASH_CR_PG;
+		uint16_t val = *src;
+		for (uint32_t i = 0; i < chunk; i += 2) {
+			*dest++ = val;
+			src++;
+			/* Stage the next halfword while the FPEC is busy;
+			 * reads at most one halfword past the buffer,
+			 * which is harmless in SRAM */
+			val = *src;
+			while (FLASH_SR & FLASH_SR_BSY)
+				;
+		}
+		done += chunk;
+	}
+
+	if (FLASH_SR & SR_ERROR_MASK)
+		stub_exit(1);
+
+	stub_exit(0);
+}
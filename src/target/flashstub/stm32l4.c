@@ -0,0 +1,62 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "stub.h"
+#include <stdint.h>
+
+/* No STM32L4 definitions in libopencm3 yet */
+#define FLASH_SR ((volatile uint32_t *) 0x40022010)
+#define FLASH_SR_EOP		(1 << 0)
+#define SR_ERROR_MASK		0xC3FA
+#define FLASH_SR_BSY		(1 << 16)
+
+#define FLASH_CR ((volatile uint32_t *) 0x40022014)
+#define FLASH_CR_PG			(1 << 0)
+#define FLASH_CR_FSTPG		(1 << 18)
+#define FLASH_CR_EOPIE		(1 << 24)
+#define FLASH_CR_ERRIE		(1 << 25)
+#define FLASH_SR_EOP		(1 << 0)
+
+/* fast != 0 selects the fast (row) programming mode: 32 double words
+ * are burst into an erased row per operation, with dest and size
+ * 256-byte aligned.  The burst must not be interrupted (MISSERR), so
+ * it has to run from this stub rather than over the wire. */
+void __attribute__((naked))
+stm32l4_flash_write_stub(uint32_t *dest, uint32_t *src, uint32_t size,
+                         uint32_t fast)
+{
+	uint32_t chunk = fast ? 256 : 8;
+	if ((size & (chunk - 1)) || ((uint32_t)dest & (chunk - 1)))
+		stub_exit(1);
+	for (int i = 0; i < size; i += chunk) {
+		*FLASH_CR = FLASH_CR_EOPIE | FLASH_CR_ERRIE |
+		            (fast ? FLASH_CR_FSTPG : FLASH_CR_PG);
+		stub_copy_words(dest, src, chunk);
+		dest += chunk / 4;
+		src += chunk / 4;
+		__asm("dsb");
+		while (*FLASH_SR & FLASH_SR_BSY)
+			;
+		if ((*FLASH_SR & SR_ERROR_MASK) || !(*FLASH_SR & FLASH_SR_EOP))
+			stub_exit(1);
+		*FLASH_SR |= FLASH_SR_EOP;
+	}
+	*FLASH_CR = 0;
+	stub_exit(0);
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __STUB_H
+#define __STUB_H
+
+static inline void __attribute__((always_inline))
+stub_exit(const int code)
+{
+	asm("bkpt %0"::"i"(code));
+}
+
+/* Copy whole words with multiple-register LDM/STM bursts; size must
+ * be a multiple of 8.  With the argument registers, a controller base
+ * and a counter already pinned, two words a burst is what reliably
+ * fits in the low registers the stubs have free; the hand-finished
+ * blobs unroll further where more can be spared. */
+static inline void __attribute__((always_inline))
+stub_copy_words(volatile uint32_t *dest, const uint32_t *src, uint32_t size)
+{
+	uint32_t t0, t1;
+	const uint32_t *end = src + size / 4;
+	while (src < end)
+		asm volatile (
+			"ldmia	%[s]!, {%[t0], %[t1]}\n\t"
+			"stmia	%[d]!, {%[t0], %[t1]}"
+			: [s]"+l"(src), [d]"+l"(dest),
+			  [t0]"=l"(t0), [t1]"=l"(t1) :: "memory");
+}
+
+#endif
+
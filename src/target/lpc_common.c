@@ -0,0 +1,248 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015 Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+#include "cortexm.h"
+#include "lpc_common.h"
+
+#include <stdarg.h>
+
+struct flash_param {
+	uint16_t opcode;
+	uint16_t pad0;
+	uint32_t command;
+	uint32_t words[4];
+	uint32_t result;
+} __attribute__((aligned(4)));
+
+
+struct lpc_flash *lpc_add_flash(target *t, target_addr addr, size_t length)
+{
+	struct lpc_flash *lf = calloc(1, sizeof(*lf));
+	struct target_flash *f = &lf->f;
+	f->start = addr;
+	f->length = length;
+	f->erase = lpc_flash_erase;
+	f->write = target_flash_write_buffered;
+	f->done = lpc_flash_done;
+	f->drain = lpc_flash_drain;
+	f->write_buf = lpc_flash_write;
+	f->erased = 0xff;
+	target_add_flash(t, f);
+	return lf;
+}
+
+/* Start an IAP ROM call without waiting for it; the MEM-AP reaches
+ * memory while the core runs, so the caller can keep staging data
+ * until it collects the result with lpc_iap_wait() */
+static void lpc_iap_start(struct lpc_flash *f, enum iap_cmd cmd,
+                          uint32_t w0, uint32_t w1,
+                          uint32_t w2, uint32_t w3)
+{
+	target *t = f->f.t;
+	struct flash_param param = {
+		.opcode = ARM_THUMB_BREAKPOINT,
+		.command = cmd,
+		.words = {w0, w1, w2, w3},
+	};
+
+	/* Pet WDT before each IAP call, if it is on */
+	if (f->wdt_kick)
+		f->wdt_kick(t);
+
+	/* copy the structure to RAM, bar the result word the ROM fills in */
+	target_mem_write(t, f->iap_ram, &param,
+	                 offsetof(struct flash_param, result));
+
+	/* set up for the call to the IAP ROM; only the registers the ROM
+	 * cares about are written, instead of syncing the whole register
+	 * file in both directions around every call */
+	uint32_t val;
+	val = f->iap_ram + offsetof(struct flash_param, command);
+	target_reg_write(t, 0, &val, sizeof(val));
+	val = f->iap_ram + offsetof(struct flash_param, result);
+	target_reg_write(t, 1, &val, sizeof(val));
+	val = f->iap_msp;
+	target_reg_write(t, REG_MSP, &val, sizeof(val));
+	val = f->iap_ram | 1;
+	target_reg_write(t, REG_LR, &val, sizeof(val));
+	val = f->iap_entry;
+	target_reg_write(t, REG_PC, &val, sizeof(val));
+
+	/* start the target */
+	target_halt_resume(t, false);
+}
+
+static enum iap_status lpc_iap_wait(struct lpc_flash *f)
+{
+	target *t = f->f.t;
+
+	/* wait for the ROM to hit the breakpoint in the opcode word */
+	while (!target_halt_poll(t, NULL));
+
+	/* fetch back just the result code */
+	return target_mem_read32(t, f->iap_ram +
+	                         offsetof(struct flash_param, result));
+}
+
+enum iap_status lpc_iap_call(struct lpc_flash *f, enum iap_cmd cmd, ...)
+{
+	uint32_t words[4];
+
+	va_list ap;
+	va_start(ap, cmd);
+	for (int i = 0; i < 4; i++)
+		words[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+
+	lpc_iap_start(f, cmd, words[0], words[1], words[2], words[3]);
+	return lpc_iap_wait(f);
+}
+
+/* Wait out any pipelined PROGRAM call before an interleaved erase: the
+ * erase's IAP calls would otherwise overwrite the parameter RAM and
+ * core registers of the running one.  All regions share the IAP, so
+ * every one is drained, not just the region being erased. */
+int lpc_flash_drain(struct target_flash *tf)
+{
+	for (struct target_flash *of = tf->t->flash; of; of = of->next) {
+		struct lpc_flash *olf = (struct lpc_flash *)of;
+		if ((of->write_buf == lpc_flash_write) && olf->iap_busy) {
+			olf->iap_busy = false;
+			if (lpc_iap_wait(olf))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static uint8_t lpc_sector_for_addr(struct lpc_flash *f, uint32_t addr)
+{
+	return f->base_sector + (addr - f->f.start) / f->f.blocksize;
+}
+
+int lpc_flash_erase(struct target_flash *tf, target_addr addr, size_t len)
+{
+	struct lpc_flash *f = (struct lpc_flash *)tf;
+	uint32_t start = lpc_sector_for_addr(f, addr);
+	uint32_t end = lpc_sector_for_addr(f, addr + len - 1);
+
+	if (lpc_iap_call(f, IAP_CMD_PREPARE, start, end, f->bank))
+		return -1;
+
+	/* and now erase them */
+	if (lpc_iap_call(f, IAP_CMD_ERASE, start, end, CPU_CLK_KHZ, f->bank))
+		return -2;
+
+	/* check erase ok */
+	if (lpc_iap_call(f, IAP_CMD_BLANKCHECK, start, end, f->bank))
+		return -3;
+
+	return 0;
+}
+
+int lpc_flash_write(struct target_flash *tf,
+                    target_addr dest, const void *src, size_t len)
+{
+	struct lpc_flash *f = (struct lpc_flash *)tf;
+	uint32_t bufaddr = ALIGN(f->iap_ram + sizeof(struct flash_param), 4);
+
+	if (f->pipelined) {
+		/* Only one IAP call can be in flight on the part, and all
+		 * the regions share the same IAP RAM; drain a call left
+		 * running through another region before touching it */
+		for (struct target_flash *of = f->f.t->flash;
+		     of; of = of->next) {
+			struct lpc_flash *olf = (struct lpc_flash *)of;
+			if ((of->write_buf == lpc_flash_write) &&
+			    (olf != f) && olf->iap_busy) {
+				olf->iap_busy = false;
+				if (lpc_iap_wait(olf))
+					return -2;
+			}
+		}
+
+		/* Stage into the idle buffer while the previous PROGRAM
+		 * call is still running on the target */
+		bufaddr += f->which * f->f.buf_size;
+		target_mem_write(f->f.t, bufaddr, src, len);
+
+		if (f->iap_busy) {
+			f->iap_busy = false;
+			if (lpc_iap_wait(f))
+				return -2;
+		}
+
+		uint32_t sector = lpc_sector_for_addr(f, dest);
+		if (lpc_iap_call(f, IAP_CMD_PREPARE, sector, sector, f->bank))
+			return -1;
+
+		lpc_iap_start(f, IAP_CMD_PROGRAM,
+		              dest, bufaddr, len, CPU_CLK_KHZ);
+		f->iap_busy = true;
+		f->which ^= 1;
+		return 0;
+	}
+
+	/* prepare... */
+	uint32_t sector = lpc_sector_for_addr(f, dest);
+	if (lpc_iap_call(f, IAP_CMD_PREPARE, sector, sector, f->bank))
+		return -1;
+
+	/* Write payload to target ram */
+	target_mem_write(f->f.t, bufaddr, src, len);
+
+	/* set the destination address and program */
+	if (lpc_iap_call(f, IAP_CMD_PROGRAM, dest, bufaddr, len, CPU_CLK_KHZ))
+		return -2;
+
+	return 0;
+}
+
+int lpc_flash_done(struct target_flash *tf)
+{
+	struct lpc_flash *f = (struct lpc_flash *)tf;
+	/* flush the partial last block first; it may start one more call */
+	int ret = target_flash_done_buffered(tf);
+
+	if (f->iap_busy) {
+		f->iap_busy = false;
+		if (lpc_iap_wait(f))
+			ret = -1;
+	}
+	f->which = 0;
+	return ret;
+}
+
+int lpc_flash_write_magic_vect(struct target_flash *f,
+                               target_addr dest, const void *src, size_t len)
+{
+	if (dest == 0) {
+		/* Fill in the magic vector to allow booting the flash */
+		uint32_t *w = (uint32_t *)src;
+		uint32_t sum = 0;
+
+		for (unsigned i = 0; i < 7; i++)
+			sum += w[i];
+		w[7] = ~sum + 1;
+	}
+	return lpc_flash_write(f, dest, src, len);
+}
+
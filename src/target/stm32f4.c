@@ -0,0 +1,736 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements STM32F4 target specific functions for detecting
+ * the device, providing the XML memory map and Flash memory programming.
+ *
+ * Refereces:
+ * ST doc - RM0090
+ *   Reference manual - STM32F405xx, STM32F407xx, STM32F415xx and STM32F417xx
+ *   advanced ARM-based 32-bit MCUs
+ * ST doc - PM0081
+ *   Programming manual - STM32F40xxx and STM32F41xxx Flash programming
+ *    manual
+ */
+
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+#include "cortexm.h"
+
+static bool stm32f4_cmd_erase_mass(target *t);
+static bool stm32f4_cmd_option(target *t, int argc, char *argv[]);
+static bool stm32f4_cmd_psize(target *t, int argc, char *argv[]);
+
+const struct command_s stm32f4_cmd_list[] = {
+	{"erase_mass", (cmd_handler)stm32f4_cmd_erase_mass, "Erase entire flash memory"},
+	{"option", (cmd_handler)stm32f4_cmd_option, "Manipulate option bytes"},
+	{"psize", (cmd_handler)stm32f4_cmd_psize, "Configure flash write parallelism: (x8|x32)"},
+	{NULL, NULL, NULL}
+};
+
+
+static int stm32f4_flash_erase(struct target_flash *f, target_addr addr, size_t len);
+static int stm32f4_flash_write(struct target_flash *f,
+                               target_addr dest, const void *src, size_t len);
+static int stm32f4_flash_done(struct target_flash *f);
+
+static const char stm32f4_driver_str[] = "STM32F4xx";
+static const char stm32f7_driver_str[] = "STM32F7xx";
+static const char stm32f2_driver_str[] = "STM32F2xx";
+
+/* Flash Program ad Erase Controller Register Map */
+#define FPEC_BASE	0x40023C00
+#define FLASH_ACR	(FPEC_BASE+0x00)
+#define FLASH_KEYR	(FPEC_BASE+0x04)
+#define FLASH_OPTKEYR	(FPEC_BASE+0x08)
+#define FLASH_SR	(FPEC_BASE+0x0C)
+#define FLASH_CR	(FPEC_BASE+0x10)
+#define FLASH_OPTCR	(FPEC_BASE+0x14)
+
+#define FLASH_CR_PG		(1 << 0)
+#define FLASH_CR_SER		(1 << 1)
+#define FLASH_CR_MER		(1 << 2)
+#define FLASH_CR_MER1		(1 << 15)	/* dual-bank parts only */
+#define FLASH_CR_PSIZE8		(0 << 8)
+#define FLASH_CR_PSIZE16	(1 << 8)
+#define FLASH_CR_PSIZE32	(2 << 8)
+#define FLASH_CR_PSIZE64	(3 << 8)
+#define FLASH_CR_STRT		(1 << 16)
+#define FLASH_CR_EOPIE		(1 << 24)
+#define FLASH_CR_ERRIE		(1 << 25)
+#define FLASH_CR_STRT		(1 << 16)
+#define FLASH_CR_LOCK		(1 << 31)
+
+#define FLASH_SR_BSY		(1 << 16)
+
+#define FLASH_OPTCR_OPTLOCK	(1 << 0)
+#define FLASH_OPTCR_OPTSTRT	(1 << 1)
+
+#define KEY1 0x45670123
+#define KEY2 0xCDEF89AB
+
+#define OPTKEY1 0x08192A3B
+#define OPTKEY2 0x4C5D6E7F
+
+#define SR_ERROR_MASK	0xF2
+#define SR_EOP		0x01
+
+#define DBGMCU_IDCODE	0xE0042000
+#define ARM_CPUID	0xE000ED00
+
+#define DBGMCU_CR		0xE0042004
+#define DBG_STANDBY		(1 << 0)
+#define DBG_STOP		(1 << 1)
+#define DBG_SLEEP		(1 << 2)
+
+#define DBGMCU_APB1_FZ	0xE0042008
+#define DBG_WWDG_STOP	(1 << 11)
+#define DBG_IWDG_STOP	(1 << 12)
+
+/* This routine uses word access.  Only usable on target voltage >2.7V */
+static const uint16_t stm32f4_flash_write_x32_stub[] = {
+#include "flashstub/stm32f4_x32.stub"
+};
+
+/* This routine uses byte access. Usable on target voltage <2.2V */
+static const uint16_t stm32f4_flash_write_x8_stub[] = {
+#include "flashstub/stm32f4_x8.stub"
+};
+
+#define SRAM_BASE 0x20000000
+#define STUB_BUFFER_BASE \
+	ALIGN(SRAM_BASE + MAX(sizeof(stm32f4_flash_write_x8_stub), \
+			      sizeof(stm32f4_flash_write_x32_stub)), 4)
+/* The two data buffers above the stub take the registered RAM up to
+ * this ceiling; incoming packets stage into one while the stub is
+ * still programming the other */
+#define STUB_BUFFER_SIZE_MAX 0x8000
+
+#define AXIM_BASE 0x8000000
+#define ITCM_BASE 0x0200000
+
+struct stm32f4_flash {
+	struct target_flash f;
+	uint8_t base_sector;
+	uint8_t psize;
+	/* Pipelined stub execution state */
+	bool stub_running;
+	uint8_t stub_loaded;	/* psize of the loaded stub, 0 = none */
+	uint8_t stub_buf;	/* data buffer the next block stages into */
+	uint32_t stub_buf_size;	/* sized from the RAM map, 0 = not yet */
+	target_addr stage_base;	/* flash address of the staged block */
+	uint32_t stage_len;
+};
+
+enum ID_STM32F47 {
+	ID_STM32F20X  = 0x411,
+	ID_STM32F40X  = 0x413,
+	ID_STM32F42X  = 0x419,
+	ID_STM32F446  = 0x421,
+	ID_STM32F401C = 0x423,
+	ID_STM32F411  = 0x431,
+	ID_STM32F401E = 0x433,
+	ID_STM32F46X  = 0x434,
+	ID_STM32F412  = 0x441,
+	ID_STM32F74X  = 0x449,
+	ID_STM32F76X  = 0x451,
+	ID_STM32F72X  = 0x452,
+	ID_STM32F410  = 0x458,
+	ID_STM32F413  = 0x463
+};
+
+/* The FPEC only permits x32 parallelism with VDD above 2.7V (PM0081).
+ * Pick the programming width from the supply measured by the probe
+ * where the hardware can, instead of defaulting blindly; the psize
+ * monitor command still overrides. */
+static uint8_t stm32f4_psize_auto(void)
+{
+	const char *v = platform_target_voltage();
+	if (!v || (v[0] < '0') || (v[0] > '9') || (v[1] != '.'))
+		return 32;	/* no measurement; assume a 3.3V rail */
+	/* Parse "D.DV" to tenths of a volt */
+	uint8_t dv = (v[0] - '0') * 10 + (v[2] - '0');
+	return (dv >= 27) ? 32 : 8;
+}
+
+static void stm32f4_add_flash(target *t,
+                              uint32_t addr, size_t length, size_t blocksize,
+                              uint8_t base_sector)
+{
+	struct stm32f4_flash *sf = calloc(1, sizeof(*sf));
+	struct target_flash *f = &sf->f;
+	f->start = addr;
+	f->length = length;
+	f->blocksize = blocksize;
+	f->erase = stm32f4_flash_erase;
+	f->write = stm32f4_flash_write;
+	f->done = stm32f4_flash_done;
+	f->align = 4;
+	f->erased = 0xff;
+	sf->base_sector = base_sector;
+	sf->psize = 32;
+	target_add_flash(t, f);
+}
+
+bool stm32f4_probe(target *t)
+{
+	bool f2 = false;
+	uint32_t idcode;
+
+	idcode = target_mem_read32(t, DBGMCU_IDCODE);
+	idcode &= 0xFFF;
+
+	if (idcode == ID_STM32F20X)
+	{
+		/* F405 revision A have a wrong IDCODE, use ARM_CPUID to make the
+		 * distinction with F205. Revision is also wrong (0x2000 instead
+		 * of 0x1000). See F40x/F41x errata. */
+		uint32_t cpuid = target_mem_read32(t, ARM_CPUID);
+		if ((cpuid & 0xFFF0) == 0xC240)
+			idcode = ID_STM32F40X;
+		else
+			f2 = true;
+	}
+
+	switch(idcode) {
+	case ID_STM32F42X: /* 427/437 */
+	case ID_STM32F46X: /* 469/479 */
+		/* Second bank for 2M parts. */
+		stm32f4_add_flash(t, 0x8100000, 0x10000, 0x4000, 12);
+		stm32f4_add_flash(t, 0x8110000, 0x10000, 0x10000, 16);
+		stm32f4_add_flash(t, 0x8120000, 0xE0000, 0x20000, 17);
+		/* Fall through for stuff common to F40x/F41x */
+	case ID_STM32F20X: /* F205 */
+	case ID_STM32F40X: /* F405 */
+		if (!f2)
+			target_add_ram(t, 0x10000000, 0x10000);
+		/* Fall through for devices w/o CCMRAM */
+	case ID_STM32F446: /* F446 */
+	case ID_STM32F401C: /* F401 B/C RM0368 Rev.3 */
+	case ID_STM32F411: /* F411     RM0383 Rev.4 */
+	case ID_STM32F412: /* F412     RM0402 Rev.4, 256 kB Ram */
+	case ID_STM32F401E: /* F401 D/E RM0368 Rev.3 */
+		t->driver = f2 ? stm32f2_driver_str : stm32f4_driver_str;
+		target_add_ram(t, 0x20000000, 0x40000);
+		stm32f4_add_flash(t, 0x8000000, 0x10000, 0x4000, 0);
+		stm32f4_add_flash(t, 0x8010000, 0x10000, 0x10000, 4);
+		stm32f4_add_flash(t, 0x8020000, 0xE0000, 0x20000, 5);
+		target_add_commands(t, stm32f4_cmd_list, f2 ? "STM32F2" :
+		                    "STM32F4");
+		break;
+	case ID_STM32F413: /* F413     RM0430 Rev.2, 320 kB Ram, 1.5 MB flash. */
+		t->driver = stm32f4_driver_str;
+		target_add_ram(t, 0x20000000, 0x50000);
+		stm32f4_add_flash(t, 0x8000000, 0x10000, 0x4000, 0);
+		stm32f4_add_flash(t, 0x8010000, 0x10000, 0x10000, 4);
+		stm32f4_add_flash(t, 0x8020000, 0x160000, 0x20000, 5);
+		target_add_commands(t, stm32f4_cmd_list, "STM32F413");
+		break;
+	case ID_STM32F74X: /* F74x RM0385 Rev.4 */
+		t->driver = stm32f7_driver_str;
+		target_add_ram(t, 0x00000000, 0x4000);
+		target_add_ram(t, 0x20000000, 0x50000);
+		/* AXIM Flash access */
+		stm32f4_add_flash(t, 0x8000000, 0x20000, 0x8000, 0);
+		stm32f4_add_flash(t, 0x8020000, 0x20000, 0x20000, 4);
+		stm32f4_add_flash(t, 0x8040000, 0xC0000, 0x40000, 5);
+		/* Flash aliased as ITCM */
+		stm32f4_add_flash(t, 0x0200000, 0x20000, 0x8000, 0);
+		stm32f4_add_flash(t, 0x0220000, 0x20000, 0x20000, 4);
+		stm32f4_add_flash(t, 0x0240000, 0xC0000, 0x40000, 5);
+		target_add_commands(t, stm32f4_cmd_list, "STM32F74x");
+		break;
+	case ID_STM32F76X: /* F76x F77x RM0410 */
+		t->driver = stm32f7_driver_str;
+		target_add_ram(t, 0x00000000, 0x4000);
+		target_add_ram(t, 0x20000000, 0x80000);
+		/* AXIM Flash access */
+		stm32f4_add_flash(t, 0x8000000, 0x020000, 0x8000, 0);
+		stm32f4_add_flash(t, 0x8020000, 0x020000, 0x20000, 4);
+		stm32f4_add_flash(t, 0x8040000, 0x1C0000, 0x40000, 5);
+		/* Flash aliased as ITCM */
+		stm32f4_add_flash(t, 0x200000, 0x020000, 0x8000, 0);
+		stm32f4_add_flash(t, 0x220000, 0x020000, 0x20000, 4);
+		stm32f4_add_flash(t, 0x240000, 0x1C0000, 0x40000, 5);
+		target_add_commands(t, stm32f4_cmd_list, "STM32F76x");
+		break;
+	case ID_STM32F72X: /* F72x F73x RM0431 */
+		t->driver = stm32f7_driver_str;
+		target_add_ram(t, 0x00000000, 0x2000);
+		target_add_ram(t, 0x20000000, 0x40000);
+		stm32f4_add_flash(t, 0x8000000, 0x010000, 0x4000,  0);
+		stm32f4_add_flash(t, 0x8010000, 0x010000, 0x10000, 4);
+		stm32f4_add_flash(t, 0x8020000, 0x060000, 0x20000, 3);
+		target_add_commands(t, stm32f4_cmd_list, "STM32F72x");
+		break;
+	default:
+		return false;
+	}
+	t->idcode = idcode;
+
+	/* Select the flash programming width for the measured supply */
+	uint8_t psize = stm32f4_psize_auto();
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		if (f->write == stm32f4_flash_write)
+			((struct stm32f4_flash *)f)->psize = psize;
+
+	return true;
+}
+
+static void stm32f4_flash_unlock(target *t)
+{
+	if (target_mem_read32(t, FLASH_CR) & FLASH_CR_LOCK) {
+		/* Enable FPEC controller access */
+		target_mem_write32(t, FLASH_KEYR, KEY1);
+		target_mem_write32(t, FLASH_KEYR, KEY2);
+	}
+}
+
+/* Start the stub on the staged block, first waiting out the block it
+ * is still programming */
+static int stm32f4_stub_flush(struct stm32f4_flash *sf)
+{
+	target *t = sf->f.t;
+	int ret;
+
+	if (!sf->stage_len)
+		return 0;
+
+	if (sf->stub_running) {
+		sf->stub_running = false;
+		if ((ret = cortexm_run_stub_wait(t)))
+			return ret;
+	}
+
+	/* (Re)load the stub; only safe while no stub is running */
+	if (sf->stub_loaded != sf->psize) {
+		if (sf->psize == 32)
+			target_mem_write(t, SRAM_BASE,
+			                 stm32f4_flash_write_x32_stub,
+			                 sizeof(stm32f4_flash_write_x32_stub));
+		else
+			target_mem_write(t, SRAM_BASE,
+			                 stm32f4_flash_write_x8_stub,
+			                 sizeof(stm32f4_flash_write_x8_stub));
+		sf->stub_loaded = sf->psize;
+	}
+
+	if (cortexm_run_stub_start(t, SRAM_BASE, sf->stage_base,
+	                           STUB_BUFFER_BASE +
+	                           (sf->stub_buf ? sf->stub_buf_size : 0),
+	                           sf->stage_len, 0))
+		return -1;
+	sf->stub_running = true;
+	sf->stub_buf ^= 1;
+	sf->stage_len = 0;
+	return 0;
+}
+
+/* Flush every bank's staged data and wait out the running stub.  At
+ * most one stub runs per target, but the banks share the stub area
+ * and data buffers, so this must happen before another bank stages
+ * or the FPEC is touched directly. */
+static int stm32f4_flush_all(target *t)
+{
+	int ret;
+	for (struct target_flash *f = t->flash; f; f = f->next) {
+		struct stm32f4_flash *sf = (struct stm32f4_flash *)f;
+		if (f->write != stm32f4_flash_write)
+			continue;
+		if ((ret = stm32f4_stub_flush(sf)))
+			return ret;
+		if (sf->stub_running) {
+			sf->stub_running = false;
+			if ((ret = cortexm_run_stub_wait(t)))
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static int stm32f4_flash_erase(struct target_flash *f, target_addr addr, size_t len)
+{
+	target *t = f->t;
+	uint16_t sr;
+	/* No address translation is needed here, as we erase by sector number */
+	uint8_t sector = ((struct stm32f4_flash *)f)->base_sector +
+	                  (addr - f->start)/f->blocksize;
+
+	if (stm32f4_flush_all(t))
+		return -1;
+	/* The target may have run and clobbered SRAM since the last write;
+	 * force a stub reload on the next one */
+	for (struct target_flash *sf = t->flash; sf; sf = sf->next)
+		if (sf->write == stm32f4_flash_write)
+			((struct stm32f4_flash *)sf)->stub_loaded = 0;
+
+	stm32f4_flash_unlock(t);
+
+	while(len) {
+		uint32_t cr = FLASH_CR_EOPIE | FLASH_CR_ERRIE | FLASH_CR_SER |
+		              (sector << 3);
+		/* Flash page erase instruction */
+		target_mem_write32(t, FLASH_CR, cr);
+		/* write address to FMA */
+		target_mem_write32(t, FLASH_CR, cr | FLASH_CR_STRT);
+
+		/* Read FLASH_SR to poll for BSY bit, throttled: sector
+		 * erase runs from half a second up to a few seconds */
+		platform_poll poll;
+		platform_poll_init(&poll, 100000);
+		while(target_mem_read32(t, FLASH_SR) & FLASH_SR_BSY) {
+			if(target_check_error(t))
+				return -1;
+			platform_poll_wait(&poll);
+		}
+
+		len -= f->blocksize;
+		sector++;
+	}
+
+	/* Check for error */
+	sr = target_mem_read32(t, FLASH_SR);
+	if(sr & SR_ERROR_MASK)
+		return -1;
+
+	return 0;
+}
+
+static int stm32f4_flash_write(struct target_flash *f,
+                               target_addr dest, const void *src, size_t len)
+{
+	struct stm32f4_flash *sf = (struct stm32f4_flash *)f;
+	target *t = f->t;
+	int ret;
+
+	/* Translate ITCM addresses to AXIM */
+	if ((dest >= ITCM_BASE) && (dest < AXIM_BASE)) {
+		dest = AXIM_BASE + (dest - ITCM_BASE);
+	}
+
+	if (!sf->stub_buf_size) {
+		/* Negotiate the buffer size from the registered RAM above
+		 * the stub: two word-aligned buffers share what is there */
+		size_t avail = (target_ram_avail(t, STUB_BUFFER_BASE) / 2) & ~3;
+		sf->stub_buf_size = MIN(avail, (size_t)STUB_BUFFER_SIZE_MAX);
+		if (!sf->stub_buf_size)
+			sf->stub_buf_size = 0x400;
+	}
+
+	/* Data staged by another bank shares the buffers */
+	if (!sf->stage_len && !sf->stub_running &&
+	    (ret = stm32f4_flush_all(t)))
+		return ret;
+
+	/* Only a contiguous write can extend the staged block */
+	if (sf->stage_len && (dest != sf->stage_base + sf->stage_len) &&
+	    (ret = stm32f4_stub_flush(sf)))
+		return ret;
+
+	while (len) {
+		if (sf->stage_len == sf->stub_buf_size &&
+		    (ret = stm32f4_stub_flush(sf)))
+			return ret;
+
+		/* Stage into the idle buffer; the running stub only reads
+		 * the other one */
+		size_t chunk = MIN(len, sf->stub_buf_size - sf->stage_len);
+		if (!sf->stage_len)
+			sf->stage_base = dest;
+		target_mem_write(t, STUB_BUFFER_BASE +
+		                 (sf->stub_buf ? sf->stub_buf_size : 0) +
+		                 sf->stage_len, src, chunk);
+		sf->stage_len += chunk;
+
+		dest += chunk;
+		src = (const uint8_t *)src + chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static int stm32f4_flash_done(struct target_flash *f)
+{
+	/* Program the staged tail and collect the last stub's status */
+	return stm32f4_flush_all(f->t);
+}
+
+static bool stm32f4_cmd_erase_mass(target *t)
+{
+	const char spinner[] = "|/-\\";
+	int spinindex = 0;
+
+	tc_printf(t, "Erasing flash... This may take a few seconds.  ");
+	stm32f4_flash_unlock(t);
+
+	/* Flash mass erase start instruction; dual-bank parts erase both
+	 * banks concurrently instead of one after the other */
+	uint32_t cr = FLASH_CR_MER;
+	if ((t->idcode == ID_STM32F42X) || (t->idcode == ID_STM32F46X))
+		cr |= FLASH_CR_MER1;
+	target_mem_write32(t, FLASH_CR, cr);
+	target_mem_write32(t, FLASH_CR, FLASH_CR_STRT | cr);
+
+	/* Read FLASH_SR to poll for BSY bit, pacing the spinner so the
+	 * host sees steady progress without flooding the link */
+	while (target_mem_read32(t, FLASH_SR) & FLASH_SR_BSY) {
+		tc_printf(t, "\b%c", spinner[spinindex++ % 4]);
+		platform_delay(100);
+		if(target_check_error(t)) {
+			tc_printf(t, "\n");
+			return false;
+		}
+	}
+	tc_printf(t, "\n");
+
+	/* Check for error */
+	uint16_t sr = target_mem_read32(t, FLASH_SR);
+	if ((sr & SR_ERROR_MASK) || !(sr & SR_EOP))
+		return false;
+
+	return true;
+}
+
+/* Dev   | DOC  |Rev|ID |OPTCR    |OPTCR   |OPTCR1   |OPTCR1 | OPTCR2
+                    |hex|default  |reserved|default  |resvd  | default|resvd
+ * F20x  |pm0059|5.1|411|0FFFAAED |F0000010|
+ * F40x  |rm0090|11 |413|0FFFAAED |F0000010|
+ * F42x  |rm0090|11 |419|0FFFAAED |30000000|0FFF0000 |F000FFFF
+ * F446  |rm0390| 2 |421|0FFFAAED |7F000010|
+ * F401BC|rm0368| 3 |423|0FFFAAED |7FC00010|
+ * F411  |rm0383| 2 |431|0FFFAAED |7F000010|
+ * F401DE|rm0368| 3 |433|0FFFAAED |7F000010|
+ * F46x  |rm0386| 2 |434|0FFFAAED |30000000|0FFF0000 |F000FFFF
+ * F412  |rm0402| 4 |441|0FFFAAED*|70000010|
+ * F74x  |rm0385| 4 |449|C0FFAAFD |3F000000|00400080*|00000000
+ * F76x  |rm0410| 2 |451|FFFFAAFD*|00000000|00400080*|00000000
+ * F72x  |rm0431| 1 |452|C0FFAAFD |3F000000|00400080*|00000000|00000000|800000FF
+ * F410  |rm0401| 2 |458|0FFFAAED*|7FE00010|
+ * F413  |rm0430| 2 |463|7FFFAAED*|00000010|
+ *
+ * * Documentation for F7 with OPTCR1 default = 0fff7f0080 seems wrong!
+ * * Documentation for F412 with OPTCR default = 0ffffffed seems wrong!
+ * * Documentation for F413 with OPTCR default = 0ffffffed seems wrong!
+ */
+
+bool optcr_mask(target *t, uint32_t *val)
+{
+	switch (t->idcode) {
+	case ID_STM32F20X:
+	case ID_STM32F40X:
+		val[0] &= ~0xF0000010;
+		break;
+	case ID_STM32F46X:
+	case ID_STM32F42X:
+		val[0] &= ~0x30000000;
+		val[1] &=  0x0fff0000;
+		break;
+	case ID_STM32F401C:
+		val[0] &= ~0x7FC00010;
+		break;
+	case ID_STM32F446:
+	case ID_STM32F411:
+	case ID_STM32F401E:
+		val[0] &= ~0x7F000010;
+		break;
+	case ID_STM32F410:
+		val[0] &= ~0x7FE00010;
+		break;
+	case ID_STM32F412:
+		val[0] &= ~0x70000010;
+		break;
+	case ID_STM32F413:
+		val[0] &= ~0x00000010;
+		break;
+	case ID_STM32F72X:
+		val[2] &=  ~0x800000ff;
+		/* Fall through*/
+	case ID_STM32F74X:
+		val[0] &= ~0x3F000000;
+		break;
+	case ID_STM32F76X:
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+static bool stm32f4_option_write(target *t, uint32_t *val, int count)
+{
+	target_mem_write32(t, FLASH_OPTKEYR, OPTKEY1);
+	target_mem_write32(t, FLASH_OPTKEYR, OPTKEY2);
+	while (target_mem_read32(t, FLASH_SR) & FLASH_SR_BSY)
+		if(target_check_error(t))
+			return -1;
+
+	/* WRITE option bytes instruction */
+	if (((t->idcode == ID_STM32F42X) || (t->idcode == ID_STM32F46X) ||
+		 (t->idcode == ID_STM32F72X) || (t->idcode == ID_STM32F74X) ||
+		 (t->idcode == ID_STM32F76X)) && (count > 1))
+	    /* Checkme: Do we need to read old value and then set it? */
+		target_mem_write32(t, FLASH_OPTCR + 4, val[1]);
+	if ((t->idcode == ID_STM32F72X) && (count > 2))
+			target_mem_write32(t, FLASH_OPTCR + 8, val[2]);
+
+	target_mem_write32(t, FLASH_OPTCR, val[0]);
+	target_mem_write32(t, FLASH_OPTCR, val[0] | FLASH_OPTCR_OPTSTRT);
+	/* Read FLASH_SR to poll for BSY bit */
+	while(target_mem_read32(t, FLASH_SR) & FLASH_SR_BSY)
+		if(target_check_error(t))
+			return false;
+	target_mem_write32(t, FLASH_OPTCR, FLASH_OPTCR_OPTLOCK);
+	return true;
+}
+
+static bool stm32f4_option_write_default(target *t)
+{
+	uint32_t val[3];
+	switch (t->idcode) {
+	case ID_STM32F42X:
+	case ID_STM32F46X:
+		val[0] = 0x0FFFAAED;
+		val[1] = 0x0FFF0000;
+		return stm32f4_option_write(t, val, 2);
+	case ID_STM32F72X:
+		val[0] = 0xC0FFAAFD;
+		val[1] = 0x00400080;
+		val[2] = 0;
+		return stm32f4_option_write(t, val, 3);
+	case ID_STM32F74X:
+		val[0] = 0xC0FFAAFD;
+		val[1] = 0x00400080;
+		return stm32f4_option_write(t, val, 2);
+	case ID_STM32F76X:
+		val[0] = 0xFFFFAAFD;
+		val[1] = 0x00400080;
+		return stm32f4_option_write(t, val, 2);
+	case ID_STM32F413:
+		val[0] = 0x7FFFAAFD;
+		return stm32f4_option_write(t, val, 1);
+	default:
+		val[0] = 0x0FFFAAED;
+		return stm32f4_option_write(t, val, 1);
+	}
+}
+
+static bool stm32f4_cmd_option(target *t, int argc, char *argv[])
+{
+	uint32_t start = 0x1FFFC000, val[3];
+	int count = 0, readcount = 1;
+
+	switch (t->idcode) {
+	case ID_STM32F72X: /* STM32F72|3 */
+		readcount++;
+		/* fall through.*/
+	case ID_STM32F74X:
+	case ID_STM32F76X:
+		/* F7 Devices have option bytes at 0x1FFF0000. */
+		start = 0x1FFF0000;
+		readcount++;
+		break;
+	case ID_STM32F42X:
+	case ID_STM32F46X:
+		readcount++;
+	}
+
+	if ((argc == 2) && !strcmp(argv[1], "erase")) {
+		stm32f4_option_write_default(t);
+	}
+	else if ((argc > 1) && !strcmp(argv[1], "write")) {
+		val[0] = strtoul(argv[2], NULL, 0);
+		count++;
+		if (argc > 2) {
+			val[1] = strtoul(argv[3], NULL, 0);
+			count ++;
+		}
+		if (argc > 3) {
+			val[2] = strtoul(argv[4], NULL, 0);
+			count ++;
+		}
+		if (optcr_mask(t, val))
+			stm32f4_option_write(t, val, count);
+		else
+			tc_printf(t, "error\n");
+	} else {
+		tc_printf(t, "usage: monitor option erase\n");
+		tc_printf(t, "usage: monitor option write <OPTCR>");
+		if (readcount > 1)
+			tc_printf(t, " <OPTCR1>");
+		if (readcount > 2)
+			tc_printf(t, " <OPTCR2>");
+		tc_printf(t, "\n");
+	}
+
+	val[0]  = (target_mem_read32(t, start + 8) & 0xffff) << 16;
+	val[0] |= (target_mem_read32(t, start    ) & 0xffff);
+	if (readcount > 1) {
+		if (start == 0x1FFFC000) /* F4 */ {
+			val[1] = target_mem_read32(t, start +  8 - 0x10000);
+			val[1] &= 0xffff;
+		} else {
+			val[1] =  (target_mem_read32(t, start + 0x18) & 0xffff) << 16;
+			val[1] |= (target_mem_read32(t, start + 0x10) & 0xffff);
+		}
+	}
+	if (readcount > 2) {
+			val[2] =  (target_mem_read32(t, start + 0x28) & 0xffff) << 16;
+			val[2] |= (target_mem_read32(t, start + 0x20) & 0xffff);
+	}
+	optcr_mask(t, val);
+	tc_printf(t, "OPTCR: 0x%08X ", val[0]);
+	if (readcount > 1)
+		tc_printf(t, "OPTCR1: 0x%08X ", val[1]);
+	if (readcount > 2)
+		tc_printf(t, "OPTCR2: 0x%08X" , val[2]);
+	tc_printf(t, "\n");
+	return true;
+}
+
+static bool stm32f4_cmd_psize(target *t, int argc, char *argv[])
+{
+	if (argc == 1) {
+		uint8_t psize = 8;
+		for (struct target_flash *f = t->flash; f; f = f->next) {
+			if (f->write == stm32f4_flash_write) {
+				psize = ((struct stm32f4_flash *)f)->psize;
+			}
+		}
+		tc_printf(t, "Flash write parallelism: %s\n",
+		          psize == 32 ? "x32" : "x8");
+	} else {
+		uint8_t psize;
+		if (!strcmp(argv[1], "x8")) {
+			psize = 8;
+		} else if (!strcmp(argv[1], "x32")) {
+			psize = 32;
+		} else {
+			tc_printf(t, "usage: monitor psize (x8|x32)\n");
+			return false;
+		}
+		for (struct target_flash *f = t->flash; f; f = f->next) {
+			if (f->write == stm32f4_flash_write) {
+				((struct stm32f4_flash *)f)->psize = psize;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,908 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+
+#include <stdarg.h>
+
+/* Fixed pools backing the attach-path allocations.  On the embedded
+ * probes these used to come from newlib malloc, so a long session of
+ * attach/detach cycles could fragment the tiny heap until a re-attach
+ * failed.  Pool sizes are worst-case small and may be overridden from
+ * platform.h; if a pool does run dry the allocation falls back to the
+ * heap so the host-side builds keep working with many targets. */
+#ifndef TARGET_POOL_TARGETS
+#define TARGET_POOL_TARGETS	4
+#endif
+#ifndef TARGET_POOL_COMMANDS
+#define TARGET_POOL_COMMANDS	8
+#endif
+#ifndef TARGET_POOL_RAM
+#define TARGET_POOL_RAM		8
+#endif
+#ifndef TARGET_POOL_BREAKWATCH
+#define TARGET_POOL_BREAKWATCH	8
+#endif
+/* Flash staging sectors larger than this fall back to malloc */
+#ifndef TARGET_POOL_FLASHBUF_SIZE
+#define TARGET_POOL_FLASHBUF_SIZE	1024
+#endif
+
+static struct target_s target_pool[TARGET_POOL_TARGETS];
+static uint8_t target_used[TARGET_POOL_TARGETS];
+static struct target_command_s command_pool[TARGET_POOL_COMMANDS];
+static uint8_t command_used[TARGET_POOL_COMMANDS];
+static struct target_ram ram_pool[TARGET_POOL_RAM];
+static uint8_t ram_used[TARGET_POOL_RAM];
+static struct breakwatch bw_pool[TARGET_POOL_BREAKWATCH];
+static uint8_t bw_used[TARGET_POOL_BREAKWATCH];
+static uint8_t flashbuf_pool[2][TARGET_POOL_FLASHBUF_SIZE];
+static uint8_t flashbuf_used[2];
+
+/* Deferred erase queue, see target_flash_erase_defer() */
+#define ERASE_QUEUE_SLOTS 8
+
+static struct erase_range {
+	target *t;
+	target_addr addr;	/* next address not yet erased */
+	size_t len;		/* remaining length, 0 = slot free */
+} erase_queue[ERASE_QUEUE_SLOTS];
+
+static void *pool_alloc(void *pool, uint8_t *used,
+                        unsigned count, size_t size)
+{
+	for (unsigned i = 0; i < count; i++)
+		if (!used[i]) {
+			used[i] = 1;
+			memset((uint8_t *)pool + i * size, 0, size);
+			return (uint8_t *)pool + i * size;
+		}
+	/* Pool exhausted, fall back to the heap */
+	return calloc(1, size);
+}
+
+static void pool_free(void *pool, uint8_t *used,
+                      unsigned count, size_t size, void *p)
+{
+	uint8_t *q = p;
+	uint8_t *base = pool;
+	if ((q >= base) && (q < base + count * size))
+		used[(q - base) / size] = 0;
+	else
+		free(p);
+}
+
+#define POOL_ALLOC(name) pool_alloc(name##_pool, name##_used, \
+			sizeof(name##_used), sizeof(name##_pool[0]))
+#define POOL_FREE(name, p) pool_free(name##_pool, name##_used, \
+			sizeof(name##_used), sizeof(name##_pool[0]), (p))
+
+static void *flash_buf_alloc(size_t size)
+{
+	if (size <= TARGET_POOL_FLASHBUF_SIZE)
+		return POOL_ALLOC(flashbuf);
+	return malloc(size);
+}
+
+static void flash_buf_free(void *p)
+{
+	if (p)
+		POOL_FREE(flashbuf, p);
+}
+
+target *target_list = NULL;
+
+target *target_new(void)
+{
+	target *t = POOL_ALLOC(target);
+	if (target_list) {
+		target *c = target_list;
+		while (c->next)
+			c = c->next;
+		c->next = t;
+	} else {
+		target_list = t;
+	}
+
+	return t;
+}
+
+bool target_foreach(void (*cb)(int, target *t, void *context), void *context)
+{
+	int i = 1;
+	target *t = target_list;
+	for (; t; t = t->next, i++)
+		cb(i, t, context);
+	return target_list != NULL;
+}
+
+void target_list_free(void)
+{
+	struct target_command_s *tc;
+
+	while(target_list) {
+		target *t = target_list->next;
+		/* Drop any deferred erases still queued for this target */
+		for (int i = 0; i < ERASE_QUEUE_SLOTS; i++)
+			if (erase_queue[i].t == target_list)
+				erase_queue[i].len = 0;
+		if (target_list->tc)
+			target_list->tc->destroy_callback(target_list->tc, target_list);
+		if (target_list->priv)
+			target_list->priv_free(target_list->priv);
+		while (target_list->commands) {
+			tc = target_list->commands->next;
+			POOL_FREE(command, target_list->commands);
+			target_list->commands = tc;
+		}
+		if (target_list->dyn_mem_map)
+			free(target_list->dyn_mem_map);
+		if (target_list->dyn_tdesc)
+			free(target_list->dyn_tdesc);
+		while (target_list->ram) {
+			void * next = target_list->ram->next;
+			POOL_FREE(ram, target_list->ram);
+			target_list->ram = next;
+		}
+		while (target_list->flash) {
+			void * next = target_list->flash->next;
+			for (int i = 0; i < 2; i++)
+				flash_buf_free(target_list->flash->buf[i]);
+			free(target_list->flash);
+			target_list->flash = next;
+		}
+		while (target_list->bw_list) {
+			void * next = target_list->bw_list->next;
+			POOL_FREE(bw, target_list->bw_list);
+			target_list->bw_list = next;
+		}
+		POOL_FREE(target, target_list);
+		target_list = t;
+	}
+}
+
+void target_add_commands(target *t, const struct command_s *cmds, const char *name)
+{
+	struct target_command_s *tc;
+	if (t->commands) {
+		for (tc = t->commands; tc->next; tc = tc->next);
+		tc = tc->next = POOL_ALLOC(command);
+	} else {
+		t->commands = tc = POOL_ALLOC(command);
+	}
+	tc->specific_name = name;
+	tc->cmds = cmds;
+	tc->next = NULL;
+}
+
+target *target_attach_n(int n, struct target_controller *tc)
+{
+	target *t;
+	int i;
+	for(t = target_list, i = 1; t; t = t->next, i++)
+		if(i == n)
+			return target_attach(t, tc);
+	return NULL;
+}
+
+target *target_attach(target *t, struct target_controller *tc)
+{
+	if (t->tc)
+		t->tc->destroy_callback(t->tc, t);
+
+	t->tc = tc;
+
+	if (!t->attach(t))
+		return NULL;
+
+	t->attached = true;
+	return t;
+}
+
+void target_add_ram(target *t, target_addr start, uint32_t len)
+{
+	struct target_ram *ram = POOL_ALLOC(ram);
+	ram->start = start;
+	ram->length = len;
+	ram->next = t->ram;
+	t->ram = ram;
+}
+
+/* Amount of registered RAM from addr to the end of its region, so
+ * drivers can size stub data buffers from the memory map instead of
+ * hardcoding a small transfer size */
+size_t target_ram_avail(target *t, target_addr addr)
+{
+	for (struct target_ram *r = t->ram; r; r = r->next)
+		if ((addr >= r->start) && (addr - r->start < r->length))
+			return r->length - (addr - r->start);
+	return 0;
+}
+
+void target_add_flash(target *t, struct target_flash *f)
+{
+	f->t = t;
+	f->buf_addr[0] = f->buf_addr[1] = -1;
+	f->next = t->flash;
+	t->flash = f;
+}
+
+static ssize_t map_ram(char *buf, size_t len, struct target_ram *ram)
+{
+	return snprintf(buf, len, "<memory type=\"ram\" start=\"0x%08"PRIx32
+	                          "\" length=\"0x%"PRIx32"\"/>",
+	                          ram->start, (uint32_t)ram->length);
+}
+
+static ssize_t map_flash(char *buf, size_t len, struct target_flash *f)
+{
+	int i = 0;
+	i += snprintf(&buf[i], len - i, "<memory type=\"flash\" start=\"0x%08"PRIx32
+	                                "\" length=\"0x%"PRIx32"\">",
+	                                f->start, (uint32_t)f->length);
+	i += snprintf(&buf[i], len - i, "<property name=\"blocksize\">0x%"PRIx32
+	                            "</property></memory>",
+	                            (uint32_t)f->blocksize);
+	return i;
+}
+
+const char *target_mem_map(target *t)
+{
+	if (t->dyn_mem_map)
+		return t->dyn_mem_map;
+
+	/* Size the buffer from the region counts so targets with many
+	 * flash regions (e.g. per-page maps) can't overflow it. */
+	size_t len = 64;
+	for (struct target_ram *r = t->ram; r; r = r->next)
+		len += 80;
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		len += 128;
+	char *tmp = malloc(len);
+	size_t i = 0;
+	i = snprintf(&tmp[i], len - i, "<memory-map>");
+	/* Map each defined RAM */
+	for (struct target_ram *r = t->ram; r; r = r->next)
+		i += map_ram(&tmp[i], len - i, r);
+	/* Map each defined Flash */
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		i += map_flash(&tmp[i], len - i, f);
+	i += snprintf(&tmp[i], len - i, "</memory-map>");
+
+	t->dyn_mem_map = tmp;
+
+	return t->dyn_mem_map;
+}
+
+static struct target_flash *flash_for_addr(target *t, uint32_t addr)
+{
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		if ((f->start <= addr) &&
+		    (addr < (f->start + f->length)))
+			return f;
+	return NULL;
+}
+
+/* Returns true if the range reads back as entirely erased */
+static bool flash_blank_check(struct target_flash *f,
+                              target_addr addr, size_t len)
+{
+	uint8_t tmp[128];
+	while (len) {
+		size_t chunk = MIN(sizeof(tmp), len);
+		if (target_mem_read(f->t, tmp, addr, chunk))
+			return false;	/* Can't tell: play safe and erase */
+		for (size_t i = 0; i < chunk; i++)
+			if (tmp[i] != f->erased)
+				return false;
+		addr += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/* Returns true if the range already holds exactly the given data */
+static bool flash_same_check(struct target_flash *f, target_addr addr,
+                             const void *data, size_t len)
+{
+	uint8_t tmp[128];
+	const uint8_t *src = data;
+	while (len) {
+		size_t chunk = MIN(sizeof(tmp), len);
+		if (target_mem_read(f->t, tmp, addr, chunk))
+			return false;
+		if (memcmp(tmp, src, chunk))
+			return false;
+		addr += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/* Deferred erase queue.  vFlashErase requests land here and the actual
+ * erase runs lazily, just ahead of the write cursor, so multi-second
+ * sector erases happen while later vFlashWrite data is still streaming
+ * in over USB instead of serializing ahead of the whole download.
+ * Each range tracks how far it has been erased; whatever a write never
+ * reaches is drained in target_flash_done(). */
+int target_flash_erase_defer(target *t, target_addr addr, size_t len)
+{
+	for (int i = 0; i < ERASE_QUEUE_SLOTS; i++) {
+		struct erase_range *r = &erase_queue[i];
+		if (!r->len) {
+			r->t = t;
+			r->addr = addr;
+			r->len = len;
+			return 0;
+		}
+	}
+	/* Queue full: erase synchronously as before */
+	return target_flash_erase(t, addr, len);
+}
+
+/* Erase any deferred range the write at [dest, dest+len) has caught up
+ * with, through to one block beyond the write, keeping the erase one
+ * sector ahead of the data. */
+static int flash_erase_ahead(target *t, target_addr dest, size_t len)
+{
+	int ret = 0;
+	for (int i = 0; i < ERASE_QUEUE_SLOTS; i++) {
+		struct erase_range *r = &erase_queue[i];
+		if (!r->len || (r->t != t) || (r->addr >= (dest + len)))
+			continue;
+		struct target_flash *f = flash_for_addr(t, r->addr);
+		if (!f)
+			continue;
+		/* Round the erase limit up to a block boundary, then one
+		 * block further for the look-ahead */
+		target_addr rel = dest + len - f->start;
+		rel = (rel + (2 * f->blocksize) - 1) / f->blocksize;
+		target_addr limit = f->start + (rel * f->blocksize);
+		size_t chunk = MIN(limit - r->addr, r->len);
+		ret |= target_flash_erase(t, r->addr, chunk);
+		r->addr += chunk;
+		r->len -= chunk;
+	}
+	return ret;
+}
+
+/* Erase whatever remains queued for this target; ranges the download
+ * never wrote into still have to end up blank. */
+static int flash_erase_drain(target *t)
+{
+	int ret = 0;
+	for (int i = 0; i < ERASE_QUEUE_SLOTS; i++) {
+		struct erase_range *r = &erase_queue[i];
+		if (!r->len || (r->t != t))
+			continue;
+		ret |= target_flash_erase(t, r->addr, r->len);
+		r->len = 0;
+	}
+	return ret;
+}
+
+int target_flash_erase(target *t, target_addr addr, size_t len)
+{
+	int ret = 0;
+	while (len) {
+		struct target_flash *f = flash_for_addr(t, addr);
+		size_t tmplen = MIN(len, f->length - (addr % f->length));
+		/* The deferred queue interleaves erases with writes, so a
+		 * pipelined write may still be running on the target; it
+		 * must finish before the controller is poked with an
+		 * erase (or before the blank check reads below, which
+		 * stall against a busy flash on some parts) */
+		if (f->drain)
+			ret |= f->drain(f);
+		/* Erase block by block, skipping blocks that already read
+		 * back blank: incremental images leave most sectors
+		 * untouched, and a read-back costs far less than an
+		 * erase.  Dirty blocks are batched into contiguous runs
+		 * so drivers still see as few erase calls as possible. */
+		target_addr run_start = addr;
+		size_t run_len = 0;
+		size_t remain = tmplen;
+		target_addr a = addr;
+		while (remain) {
+			size_t bl = MIN(remain,
+					f->blocksize - (a % f->blocksize));
+			if (flash_blank_check(f, a, bl)) {
+				if (run_len)
+					ret |= f->erase(f, run_start, run_len);
+				run_len = 0;
+			} else {
+				if (!run_len)
+					run_start = a;
+				run_len += bl;
+			}
+			a += bl;
+			remain -= bl;
+		}
+		if (run_len)
+			ret |= f->erase(f, run_start, run_len);
+		addr += tmplen;
+		len -= tmplen;
+	}
+	return ret;
+}
+
+int target_flash_write(target *t,
+                       target_addr dest, const void *src, size_t len)
+{
+	int ret = flash_erase_ahead(t, dest, len);
+	while (len) {
+		struct target_flash *f = flash_for_addr(t, dest);
+		size_t tmplen = MIN(len, f->length - (dest % f->length));
+		if (f->align > 1) {
+			uint32_t offset = dest % f->align;
+			uint8_t data[ALIGN(offset + len, f->align)];
+			memset(data, f->erased, sizeof(data));
+			memcpy((uint8_t *)data + offset, src, len);
+			ret |= f->write(f, dest - offset, data, sizeof(data));
+		} else {
+			ret |= f->write(f, dest, src, tmplen);
+		}
+		src += tmplen;
+		len -= tmplen;
+	}
+	return ret;
+}
+
+int target_flash_done(target *t)
+{
+	/* Drain first, but run the driver done hooks regardless: they
+	 * flush and release the staging buffers */
+	int ret = flash_erase_drain(t);
+	for (struct target_flash *f = t->flash; f; f = f->next) {
+		if (f->done)
+			ret |= f->done(f);
+	}
+	return ret;
+}
+
+static int flash_buf_flush(struct target_flash *f, int i)
+{
+	int ret = 0;
+	if ((f->buf[i] != NULL) && (f->buf_addr[i] != (uint32_t)-1)) {
+		/* Write sector to flash if valid, unless it already
+		 * holds exactly this data */
+		if (!flash_same_check(f, f->buf_addr[i], f->buf[i],
+				      f->buf_size))
+			ret = f->write_buf(f, f->buf_addr[i],
+					   f->buf[i], f->buf_size);
+		f->buf_addr[i] = -1;
+	}
+	return ret;
+}
+
+int target_flash_write_buffered(struct target_flash *f,
+                                target_addr dest, const void *src, size_t len)
+{
+	int ret = 0;
+
+	while (len) {
+		uint32_t offset = dest % f->buf_size;
+		uint32_t base = dest - offset;
+		int i;
+
+		/* Is this sector already staged? */
+		for (i = 0; i < 2; i++)
+			if (base == f->buf_addr[i])
+				break;
+		if (i == 2) {
+			/* Whole aligned sectors not already staged go
+			 * straight from the packet buffer to the driver,
+			 * skipping the staging copy entirely. */
+			if ((offset == 0) && (len >= f->buf_size)) {
+				if (!flash_same_check(f, dest, src,
+						      f->buf_size))
+					ret |= f->write_buf(f, dest, src,
+							    f->buf_size);
+				dest += f->buf_size;
+				src += f->buf_size;
+				len -= f->buf_size;
+				continue;
+			}
+			/* Flush and recycle the least recently used slot */
+			ret |= flash_buf_flush(f, 1);
+			if (f->buf[1] == NULL) {
+				/* Grab a flash sector staging buffer */
+				f->buf[1] = flash_buf_alloc(f->buf_size);
+			}
+			/* Setup buffer for a new sector */
+			f->buf_addr[1] = base;
+			memset(f->buf[1], f->erased, f->buf_size);
+			i = 1;
+		}
+		if (i == 1) {
+			/* Keep the most recently used sector in slot 0 */
+			void *tmp_buf = f->buf[0];
+			target_addr tmp_addr = f->buf_addr[0];
+			f->buf[0] = f->buf[1];
+			f->buf_addr[0] = f->buf_addr[1];
+			f->buf[1] = tmp_buf;
+			f->buf_addr[1] = tmp_addr;
+		}
+		/* Copy chunk into sector buffer */
+		size_t sectlen = MIN(f->buf_size - offset, len);
+		memcpy(f->buf[0] + offset, src, sectlen);
+		dest += sectlen;
+		src += sectlen;
+		len -= sectlen;
+	}
+	return ret;
+}
+
+int target_flash_done_buffered(struct target_flash *f)
+{
+	int ret = 0;
+	for (int i = 0; i < 2; i++) {
+		ret |= flash_buf_flush(f, i);
+		flash_buf_free(f->buf[i]);
+		f->buf[i] = NULL;
+	}
+
+	return ret;
+}
+
+/* Wrapper functions */
+void target_detach(target *t)
+{
+	t->detach(t);
+	t->attached = false;
+}
+
+bool target_check_error(target *t) { return t->check_error(t); }
+bool target_attached(target *t) { return t->attached; }
+
+/* Memory access functions */
+int target_mem_read(target *t, void *dest, target_addr src, size_t len)
+{
+	t->mem_read(t, dest, src, len);
+	return target_check_error(t);
+}
+
+size_t target_mem_read_partial(target *t, void *dest, target_addr src, size_t len)
+{
+	if (t->mem_read_partial)
+		return t->mem_read_partial(t, dest, src, len);
+	/* All-or-nothing fallback */
+	return target_mem_read(t, dest, src, len) ? 0 : len;
+}
+
+bool target_mem_verify_enabled = false;
+
+/* Reset timing profile, adjusted with the reset_timing monitor command.
+ * The defaults match the historic fixed behaviour: a minimal SRST pulse,
+ * no extra settle time, and a 200ms poll interval while waiting for the
+ * core to halt during attach. */
+unsigned target_srst_pulse_us = 0;
+unsigned target_reset_settle_us = 0;
+unsigned target_halt_poll_ms = 200;
+
+int target_mem_write(target *t, target_addr dest, const void *src, size_t len)
+{
+	t->mem_write(t, dest, src, len);
+	return target_check_error(t);
+}
+
+int target_mem_fill(target *t, target_addr dest, uint8_t val, size_t len)
+{
+	if (t->mem_fill) {
+		t->mem_fill(t, dest, val, len);
+	} else {
+		/* Fall back to writing a small constant buffer repeatedly */
+		uint8_t tmp[64];
+		memset(tmp, val, MIN(len, sizeof(tmp)));
+		while (len) {
+			size_t seg = MIN(len, sizeof(tmp));
+			t->mem_write(t, dest, tmp, seg);
+			dest += seg;
+			len -= seg;
+		}
+	}
+	return target_check_error(t);
+}
+
+/* Register access functions */
+void target_regs_read(target *t, void *data) { t->regs_read(t, data); }
+void target_regs_write(target *t, const void *data) { t->regs_write(t, data); }
+
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max)
+{
+	if (!t->reg_read)
+		return 0;
+	return t->reg_read(t, reg, data, max);
+}
+
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	if (!t->reg_write)
+		return 0;
+	return t->reg_write(t, reg, data, size);
+}
+
+/* Halt/resume functions */
+void target_reset(target *t) { t->reset(t); }
+void target_halt_request(target *t) { t->halt_request(t); }
+enum target_halt_reason target_halt_poll(target *t, target_addr *watch)
+{
+	return t->halt_poll(t, watch);
+}
+
+void target_halt_resume(target *t, bool step) { t->halt_resume(t, step); }
+
+/* Break-/watchpoint functions */
+int target_breakwatch_set(target *t,
+                          enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct breakwatch bw = {
+		.type = type,
+		.addr = addr,
+		.size = len,
+	};
+	int ret = 1;
+
+	if (t->breakwatch_set)
+		ret = t->breakwatch_set(t, &bw);
+
+	if (ret == 0) {
+		/* Success, make a pooled copy and add to list */
+		struct breakwatch *bwm = POOL_ALLOC(bw);
+		memcpy(bwm, &bw, sizeof(bw));
+		bwm->next = t->bw_list;
+		t->bw_list = bwm;
+	}
+
+	return ret;
+}
+
+int target_breakwatch_clear(target *t,
+                            enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct breakwatch *bwp = NULL, *bw;
+	int ret = 1;
+	for (bw = t->bw_list; bw; bwp = bw, bw = bw->next)
+		if ((bw->type == type) &&
+		    (bw->addr == addr) &&
+		    (bw->size == len))
+			break;
+
+	if (bw == NULL)
+		return -1;
+
+	if (t->breakwatch_clear)
+		ret = t->breakwatch_clear(t, bw);
+
+	if (ret == 0) {
+		if (bwp == NULL) {
+			t->bw_list = bw->next;
+		} else {
+			bwp->next = bw->next;
+		}
+		POOL_FREE(bw, bw);
+	}
+	return ret;
+}
+
+/* Accessor functions */
+size_t target_regs_size(target *t)
+{
+	return t->regs_size;
+}
+
+const char *target_tdesc(target *t)
+{
+	if (!t->tdesc)
+		return "";
+	if (!t->tdesc_extra)
+		return t->tdesc;
+
+	/* Splice the extra feature block in before the closing tag.
+	 * Like the memory map this is built on first request and cached,
+	 * so attach time doesn't grow with the register description. */
+	if (!t->dyn_tdesc) {
+		size_t close = strlen(t->tdesc) - strlen("</target>");
+		char *tmp = malloc(close + strlen(t->tdesc_extra) +
+		                   sizeof("</target>"));
+		memcpy(tmp, t->tdesc, close);
+		strcpy(&tmp[close], t->tdesc_extra);
+		strcat(tmp, "</target>");
+		t->dyn_tdesc = tmp;
+	}
+	return t->dyn_tdesc;
+}
+
+const char *target_driver_name(target *t)
+{
+	return t->driver;
+}
+
+uint32_t target_mem_read32(target *t, uint32_t addr)
+{
+	uint32_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write32(target *t, uint32_t addr, uint32_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+uint16_t target_mem_read16(target *t, uint32_t addr)
+{
+	uint16_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write16(target *t, uint32_t addr, uint16_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+uint8_t target_mem_read8(target *t, uint32_t addr)
+{
+	uint8_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write8(target *t, uint32_t addr, uint8_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+void target_command_help(target *t)
+{
+	for (struct target_command_s *tc = t->commands; tc; tc = tc->next) {
+		tc_printf(t, "%s specific commands:\n", tc->specific_name);
+		for(const struct command_s *c = tc->cmds; c->cmd; c++)
+			tc_printf(t, "\t%s -- %s\n", c->cmd, c->help);
+	}
+}
+
+int target_command(target *t, int argc, const char *argv[])
+{
+	for (struct target_command_s *tc = t->commands; tc; tc = tc->next)
+		for(const struct command_s *c = tc->cmds; c->cmd; c++)
+			if(!strncmp(argv[0], c->cmd, strlen(argv[0])))
+				return !c->handler(t, argc, argv);
+	return -1;
+}
+
+void tc_printf(target *t, const char *fmt, ...)
+{
+	(void)t;
+	va_list ap;
+
+	if (t->tc == NULL)
+		return;
+
+	va_start(ap, fmt);
+	t->tc->printf(t->tc, fmt, ap);
+	va_end(ap);
+}
+
+/* Interface to host system calls */
+int tc_open(target *t, target_addr path, size_t plen,
+            enum target_open_flags flags, mode_t mode)
+{
+	if (t->tc->open == NULL) {
+		t->tc->errno_ = TARGET_ENFILE;
+		return -1;
+	}
+	return t->tc->open(t->tc, path, plen, flags, mode);
+}
+
+int tc_close(target *t, int fd)
+{
+	if (t->tc->close == NULL) {
+		t->tc->errno_ = TARGET_EBADF;
+		return -1;
+	}
+	return t->tc->close(t->tc, fd);
+}
+
+int tc_read(target *t, int fd, target_addr buf, unsigned int count)
+{
+	if (t->tc->read == NULL)
+		return 0;
+	return t->tc->read(t->tc, fd, buf, count);
+}
+
+int tc_write(target *t, int fd, target_addr buf, unsigned int count)
+{
+	if (t->tc->write == NULL)
+		return 0;
+	return t->tc->write(t->tc, fd, buf, count);
+}
+
+long tc_lseek(target *t, int fd, long offset, enum target_seek_flag flag)
+{
+	if (t->tc->lseek == NULL)
+		return 0;
+	return t->tc->lseek(t->tc, fd, offset, flag);
+}
+
+int tc_rename(target *t, target_addr oldpath, size_t oldlen,
+                         target_addr newpath, size_t newlen)
+{
+	if (t->tc->rename == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->rename(t->tc, oldpath, oldlen, newpath, newlen);
+}
+
+int tc_unlink(target *t, target_addr path, size_t plen)
+{
+	if (t->tc->unlink == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->unlink(t->tc, path, plen);
+}
+
+int tc_stat(target *t, target_addr path, size_t plen, target_addr buf)
+{
+	if (t->tc->stat == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->stat(t->tc, path, plen, buf);
+}
+
+int tc_fstat(target *t, int fd, target_addr buf)
+{
+	if (t->tc->fstat == NULL) {
+		return 0;
+	}
+	return t->tc->fstat(t->tc, fd, buf);
+}
+
+int tc_gettimeofday(target *t, target_addr tv, target_addr tz)
+{
+	if (t->tc->gettimeofday == NULL) {
+		return -1;
+	}
+	return t->tc->gettimeofday(t->tc, tv, tz);
+}
+
+int tc_isatty(target *t, int fd)
+{
+	if (t->tc->isatty == NULL) {
+		return 1;
+	}
+	return t->tc->isatty(t->tc, fd);
+}
+
+int tc_system(target *t, target_addr cmd, size_t cmdlen)
+{
+	if (t->tc->system == NULL) {
+		return -1;
+	}
+	return t->tc->system(t->tc, cmd, cmdlen);
+}
+
@@ -0,0 +1,48 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Cooperative task layer.  See tasks.h for the model. */
+
+#include "general.h"
+#include "tasks.h"
+
+#ifndef TASK_MAX
+#define TASK_MAX 4
+#endif
+
+static task_fn task_table[TASK_MAX];
+static unsigned task_count;
+
+void task_add(task_fn fn)
+{
+	if (task_count < TASK_MAX)
+		task_table[task_count++] = fn;
+}
+
+void task_yield(void)
+{
+	/* Tasks run to completion, so a task reaching a yield point of
+	 * its own must not start the table over */
+	static bool in_yield;
+
+	if (in_yield)
+		return;
+	in_yield = true;
+	for (unsigned i = 0; i < task_count; i++)
+		task_table[i]();
+	in_yield = false;
+}